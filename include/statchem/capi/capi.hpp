@@ -66,6 +66,7 @@ STATCHEM_EXPORT size_t ligand_bond_count();
 STATCHEM_EXPORT size_t ligand_bonds(size_t* bonds);
 STATCHEM_EXPORT size_t ligand_get_neighbors(size_t atom_idx, size_t* neighbors);
 
+STATCHEM_EXPORT size_t set_scoring_cache(const char* cache_dir);
 STATCHEM_EXPORT size_t initialize_scoring(const char* obj_dir);
 
 STATCHEM_EXPORT size_t initialize_scoring_full(const char* obj_dir,
@@ -0,0 +1,75 @@
+/* This is asyncwriter.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef ASYNCWRITER_H
+#define ASYNCWRITER_H
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+
+namespace statchem {
+namespace fileio {
+
+/* Writes text to a stream from a dedicated thread. write() only appends to
+ * an in-memory buffer; each time it holds buffer_size bytes it is queued for
+ * the writer thread, so callers never wait for the disk. write() may be
+ * called from several threads, text is written in the order of the calls.
+ * A file named *.xz is compressed, see open_output_file.
+ */
+class AsyncWriter {
+    std::unique_ptr<std::ostream> __file;
+    std::ostream* __out;
+    const size_t __buffer_size;
+
+    std::string __buffer;
+    std::deque<std::string> __queue;
+    bool __busy;
+    bool __stop;
+    std::exception_ptr __error;
+
+    std::mutex __mutex;
+    std::condition_variable __work;
+    std::condition_variable __done;
+    std::thread __writer;
+
+    void __run();
+    void __queue_buffer();
+
+   public:
+    explicit AsyncWriter(std::ostream& out,
+                         const size_t buffer_size = 1 << 20);
+    explicit AsyncWriter(const std::string& filename,
+                         const size_t buffer_size = 1 << 20);  // throws Error
+    ~AsyncWriter();
+
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+    void write(const std::string& text);
+
+    // Waits until everything written so far has reached the stream and
+    // rethrows the first error of the writer thread
+    void flush();
+};
+}
+}
+
+#endif
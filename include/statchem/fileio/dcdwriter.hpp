@@ -0,0 +1,71 @@
+/* This is dcdwriter.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef DCDWRITER_H
+#define DCDWRITER_H
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "statchem/geometry/geometry.hpp"
+
+namespace statchem {
+namespace fileio {
+
+/* Writes a trajectory in the CHARMM/NAMD DCD format read by VMD, MDTraj and
+ * OpenMM: Fortran records in the byte order of the machine holding single
+ * precision x, y and z coordinates in Angstroms, no unit cell. The atoms are
+ * those of the topology (e.g. a PDB model) written alongside, in the same
+ * order. The frame count in the header is kept up to date so the file can
+ * be read while it is being written. With append, frames are added to an
+ * existing trajectory of the same number of atoms.
+ */
+class DcdWriter {
+    const std::string __filename;
+    std::fstream __file;
+    const size_t __num_atoms;
+    int32_t __first_step;
+    const int32_t __steps_per_frame;
+    int32_t __num_frames;
+    std::vector<float> __buffer;
+
+    void __write_header(const double time_step);
+    void __read_header(const std::string& filename);
+    std::streamoff __end_of_frames() const;
+    void __write_record(const void* data, const int32_t size);
+    void __update_header();
+
+   public:
+    // time_step is the integration step in picoseconds
+    DcdWriter(const std::string& filename, const size_t num_atoms,
+              const int32_t steps_per_frame, const double time_step,
+              const bool append = false);  // throws Error
+
+    void write_frame(const geometry::Point::Vec& crds);  // throws Error
+    // Atoms in the order of print_complex_pdb, the receptor's first
+    void write_frame(const geometry::Point::Vec& receptor,
+                     const geometry::Point::Vec& ligand);  // throws Error
+
+    size_t num_frames() const { return __num_frames; }
+
+    // Drops the frames after the first num_frames, e.g. those written after
+    // the checkpoint a simulation continues from
+    void truncate(const size_t num_frames);  // throws Error
+};
+}
+}
+
+#endif
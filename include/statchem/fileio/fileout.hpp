@@ -19,6 +19,9 @@
 
 #include <cmath>
 #include <iosfwd>
+#include <mutex>
+#include <sstream>
+#include "statchem/fileio/asyncwriter.hpp"
 #include "statchem/molib/molecule.hpp"
 
 namespace statchem {
@@ -32,12 +35,31 @@ void print_complex_pdb(std::ostream& ss, const molib::Molecule& ligand,
 
 void print_mol2(std::ostream& ss, const molib::Molecule& ligand);
 
-void print_complex_pdb_to_file(const molib::Molecule& ligand,
+// Writes complexes as print_complex_pdb does, through an AsyncWriter so that
+// callers (possibly several threads) never wait for the disk. With
+// receptor_once the receptor is written a single time ahead of the first
+// model and every model after that holds only the ligand.
+class PoseWriter {
+    AsyncWriter __writer;
+    const bool __receptor_once;
+    bool __receptor_written;
+    std::stringstream __format;
+    std::mutex __mutex;
+
+   public:
+    explicit PoseWriter(std::ostream& out, const bool receptor_once = false);
+    explicit PoseWriter(const std::string& filename,
+                        const bool receptor_once = false);  // throws Error
+
+    void write_complex(const molib::Molecule& ligand,
                        const molib::Molecule& receptor, const double energy,
                        const double potential = 0.0, const int model = 1,
                        const size_t max_clq_id = 1,
                        const double rmsd = std::nan(""));
-extern size_t pdb_num, pdb_counter;
+
+    // See AsyncWriter::flush
+    void flush() { __writer.flush(); }
+};
 }
 }
 
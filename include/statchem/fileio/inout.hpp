@@ -17,6 +17,7 @@
 #ifndef INOUT_H
 #define INOUT_H
 #include <fstream>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -40,6 +41,15 @@ void read_file(const std::string& name, std::string&,
                std::streampos& pos_in_file, f_not_found = panic,
                const int num_occur = -1,
                const std::string& pattern = "");  // throws Error
+// Opens name for reading line by line, decompressing it on the fly if its
+// name ends in xz
+std::unique_ptr<std::istream> open_input_file(
+    const std::string& name);  // throws Error
+// Opens name for writing, compressing with the given number of encoder
+// threads if its name ends in xz
+std::unique_ptr<std::ostream> open_output_file(
+    const std::string& name, const size_t threads = 1,
+    std::ios_base::openmode mode = std::ios_base::out);  // throws Error
 void read_stream(std::istream& in, std::vector<std::string>& s,
                  std::streampos& pos_in_file, const int num_occur = -1,
                  const std::string& pattern = "");
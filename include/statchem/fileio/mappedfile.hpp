@@ -0,0 +1,45 @@
+/* This is mappedfile.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <string>
+
+namespace statchem {
+namespace fileio {
+
+// Read-only view of the whole contents of a file. The file is memory mapped
+// where the platform supports it and read into a buffer otherwise.
+class MappedFile {
+    const char* __data;
+    size_t __size;
+    void* __map;
+    std::string __buffer;
+
+   public:
+    explicit MappedFile(const std::string& filename);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* data() const { return __data; }
+    size_t size() const { return __size; }
+};
+}
+}
+
+#endif
@@ -0,0 +1,47 @@
+/* This is moleculestore.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef MOLECULESTORE_H
+#define MOLECULESTORE_H
+
+#include <istream>
+#include <ostream>
+#include "statchem/molib/molecules.hpp"
+
+namespace statchem {
+namespace fileio {
+
+/* Binary store of typed molecules (*.stch, or *.stch.xz compressed). It
+ * holds the whole hierarchy with coordinates, the IDATM, GAFF and sybyl
+ * types and the properties of the atoms, and the bonds with their orders,
+ * GAFF bond types and rotatable flags, so molecules read from it need no
+ * typing. A header is followed by one length-prefixed record per molecule,
+ * which lets libraries of any size be written and read molecule by
+ * molecule. Numbers are in the byte order of the machine that wrote the
+ * store; reading it elsewhere fails on the header.
+ *
+ * Model level data of the docking code (rigid segments, remarks) and the
+ * biological assembly matrices of a Molecule are not stored.
+ */
+void write_molecule_store_header(std::ostream& out);
+void write_molecule(std::ostream& out, const molib::Molecule& molecule);
+
+void read_molecule_store_header(std::istream& in);  // throws Error
+// Appends the next molecule of the store to mols, returns false at its end
+bool read_molecule(std::istream& in, molib::Molecules& mols);  // throws Error
+}
+}
+
+#endif
@@ -16,13 +16,109 @@
 #ifndef XZFILE_H
 #define XZFILE_H
 
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
 #include <string>
+#include <vector>
 
 namespace statchem {
 namespace fileio {
 
 std::string read_xzfile(const std::string& filename);
 
+// Stream buffer that decompresses an .xz file in fixed-size chunks, so only
+// one chunk of compressed and one of decompressed data are held in memory.
+// Seeking is supported: within the current chunk it is free, forward it
+// decodes ahead and backward it decodes again from the start of the file.
+class XzStreamBuf : public std::streambuf {
+    struct Decoder;
+    std::unique_ptr<Decoder> __decoder;
+    std::vector<char> __out;
+    std::streamoff __out_start;  // uncompressed offset of eback()
+
+    void __restart();
+
+   protected:
+    int_type underflow() override;
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override;
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+
+   public:
+    explicit XzStreamBuf(const std::string& filename,
+                         const size_t chunk_size = 1 << 16);
+    ~XzStreamBuf();
+
+    bool is_open() const;
+};
+
+// std::ifstream look-alike reading an .xz file through XzStreamBuf. A
+// corrupt file sets badbit.
+class XzIfstream : public std::istream {
+    XzStreamBuf __buf;
+
+   public:
+    explicit XzIfstream(const std::string& filename)
+        : std::istream(nullptr), __buf(filename) {
+        rdbuf(&__buf);
+        if (!__buf.is_open()) setstate(std::ios_base::failbit);
+    }
+
+    bool is_open() const { return __buf.is_open(); }
+};
+
+// Stream buffer that compresses into an .xz file. Data is encoded a chunk at
+// a time; with more than one thread liblzma's multi-threaded encoder
+// compresses independent blocks in parallel. The .xz stream is completed by
+// close() or the destructor. Opening with std::ios_base::app appends a new
+// .xz stream, which XzStreamBuf reads as a continuation of the file.
+class XzOStreamBuf : public std::streambuf {
+    struct Encoder;
+    std::unique_ptr<Encoder> __encoder;
+    std::vector<char> __in;
+
+    bool __encode(const bool finish);
+
+   protected:
+    int_type overflow(int_type c) override;
+    int sync() override;
+
+   public:
+    explicit XzOStreamBuf(const std::string& filename,
+                          const size_t threads = 1,
+                          std::ios_base::openmode mode = std::ios_base::out,
+                          const uint32_t preset = 6,
+                          const size_t chunk_size = 1 << 16);
+    ~XzOStreamBuf();
+
+    bool is_open() const;
+
+    // Writes out the end of the .xz stream, returns false on an error
+    bool close();
+};
+
+// std::ofstream look-alike writing an .xz file through XzOStreamBuf. Errors
+// while compressing set badbit.
+class XzOfstream : public std::ostream {
+    XzOStreamBuf __buf;
+
+   public:
+    explicit XzOfstream(const std::string& filename, const size_t threads = 1,
+                        std::ios_base::openmode mode = std::ios_base::out)
+        : std::ostream(nullptr), __buf(filename, threads, mode) {
+        rdbuf(&__buf);
+        if (!__buf.is_open()) setstate(std::ios_base::failbit);
+    }
+
+    bool is_open() const { return __buf.is_open(); }
+
+    void close() {
+        if (!__buf.close()) setstate(std::ios_base::badbit);
+    }
+};
 }
 }
 
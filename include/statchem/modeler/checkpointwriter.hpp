@@ -0,0 +1,101 @@
+/* This is checkpointwriter.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef CHECKPOINTWRITER_H
+#define CHECKPOINTWRITER_H
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace statchem {
+namespace OMMIface {
+
+/* When a simulation is checkpointed: after step_interval integrator steps or
+ * after time_interval seconds of wall-clock time, whichever comes first. An
+ * interval of 0 turns that criterion off.
+ */
+struct CheckpointPolicy {
+    int step_interval;
+    double time_interval;
+
+    bool is_due(const int steps, const double seconds) const {
+        return (step_interval > 0 && steps >= step_interval) ||
+               (time_interval > 0 && seconds >= time_interval);
+    }
+};
+
+/* Writes checkpoints from a dedicated thread. write() only hands over a
+ * snapshot that was already serialized in memory, so the integration thread
+ * never waits for the disk. If the writer is still busy, a newer snapshot
+ * replaces the one waiting, as only the latest state is worth keeping.
+ *
+ * A checkpoint is a single file holding the state of the context and the
+ * progress of the program, e.g. its position in a loop, so the two always
+ * belong together. It is written under a temporary name, synced to the disk
+ * and renamed, so a crash or a power loss never leaves a torn checkpoint.
+ */
+class CheckpointWriter {
+    struct Snapshot {
+        std::string filename;
+        std::string state;
+        std::string progress;
+    };
+
+    Snapshot __pending;
+    bool __has_pending;
+    bool __busy;
+    bool __stop;
+    size_t __num_written;
+    size_t __num_skipped;
+
+    std::mutex __mutex;
+    std::condition_variable __work;
+    std::condition_variable __done;
+    std::thread __writer;
+
+    void __run();
+    static bool __write_file(const Snapshot& snapshot);
+
+   public:
+    CheckpointWriter();
+    ~CheckpointWriter();
+
+    CheckpointWriter(const CheckpointWriter&) = delete;
+    CheckpointWriter& operator=(const CheckpointWriter&) = delete;
+
+    void write(const std::string& filename, std::string state,
+               const std::string& progress);
+
+    // Waits until the last snapshot handed over is on disk
+    void flush();
+
+    // Snapshots written and those replaced by a newer one before that
+    size_t num_written();
+    size_t num_skipped();
+};
+
+// Reads a checkpoint written by CheckpointWriter
+void read_checkpoint(const std::string& filename, std::string& state,
+                     std::string& progress);  // throws Error
+
+// Checkpoints of releases before CheckpointWriter are the bare state of the
+// context, with the progress in a text file named filename + "_candock"
+bool is_legacy_checkpoint(const std::string& filename);  // throws Error
+}
+}
+
+#endif
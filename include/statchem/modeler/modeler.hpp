@@ -54,9 +54,13 @@ class Modeler {
 
     geometry::Point::Vec __positions;
     Topology __topology;
+    Topology __receptor_topology;
 
     int __dynamics_steps;
 
+    const ReceptorField* __receptor_field;
+    std::vector<Topology> __batch;
+
    public:
     SystemTopology __system_topology;
 
@@ -74,7 +78,33 @@ class Modeler {
                   const geometry::Point::Vec& crds);
     void add_random_crds(const molib::Atom::Vec& atoms);
 
+    // Ligand slot: the topology added so far (the receptor) is built into
+    // the system once by init_openmm, together with a slot large enough for
+    // every ligand passed to reserve_ligand. Ligands are then swapped into
+    // the initialized context with set_ligand. Ligand bonds are never
+    // constrained. A ligand whose bonded terms differ from those of the
+    // previous one costs a context reinitialization, as OpenMM cannot move
+    // bonded terms onto other particles in a context.
+    void reserve_ligand(const molib::Atom::Vec& atoms);
+    void set_ligand(const molib::Atom::Vec& atoms);
+
+    // The knowledge-based force of init_openmm also includes the
+    // interactions with the rigid receptor tabulated in field, which must
+    // outlive the modeler
+    void set_receptor_field(const ReceptorField& field) {
+        __receptor_field = &field;
+    }
+
+    // Batch: ligands added this way are minimized together in one system,
+    // without interacting with each other, against the rigid receptor of
+    // set_receptor_field. batch_energies returns the potential energy of
+    // each ligand in the order they were added.
+    void add_batch_ligand(const molib::Atom::Vec& atoms);
+    std::vector<double> batch_energies();
+
     geometry::Point::Vec get_state(const molib::Atom::Vec& atoms);
+    // Forces on atoms in kJ/mol/nm
+    geometry::Point::Vec get_forces(const molib::Atom::Vec& atoms);
 
 #ifndef NDEBUG
     void minimize_knowledge_based(molib::Molecule& ligand,
@@ -0,0 +1,63 @@
+/* This is receptorfield.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+#ifndef RECEPTORFIELD_H
+#define RECEPTORFIELD_H
+#include <map>
+#include <vector>
+#include "statchem/geometry/geometry.hpp"
+#include "statchem/molib/atom.hpp"
+
+namespace statchem {
+
+namespace OMMIface {
+struct ForceField;
+
+// Knowledge-based interaction energy of a rigid receptor with a single atom,
+// tabulated on a regular grid for each ligand atom type. The grid covers the
+// given ligand atoms padded by the knowledge-based cutoff, and values are
+// indexed x-fastest as OpenMM's Continuous3DFunction expects them.
+class ReceptorField {
+    geometry::Point __min, __max;
+    int __nx, __ny, __nz;
+    std::map<int, std::vector<double>> __maps;
+
+   public:
+    // Values are capped at this energy, which is also felt by atoms outside
+    // of the grid once they are ramp_width angstroms away from it
+    static const double max_energy;
+    static const double ramp_width;
+
+    ReceptorField(const ForceField& ffield, const molib::Atom::Vec& receptor,
+                  const molib::Atom::Vec& ligand, const double spacing);
+
+    // Corners of the grid in angstroms
+    const geometry::Point& get_min() const { return __min; }
+    const geometry::Point& get_max() const { return __max; }
+
+    int size_x() const { return __nx; }
+    int size_y() const { return __ny; }
+    int size_z() const { return __nz; }
+
+    bool has_map(const int idatm_type) const {
+        return __maps.count(idatm_type) != 0;
+    }
+    const std::vector<double>& get_map(const int idatm_type) const {
+        return __maps.at(idatm_type);
+    }
+};
+}  // namespace OMMIface
+}  // namespace statchem
+
+#endif
@@ -15,12 +15,16 @@
 
 #ifndef SYSTEMTOPOLOGY_H
 #define SYSTEMTOPOLOGY_H
+#include <chrono>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
 #include "statchem/geometry/geometry.hpp"
 #include "statchem/helper/debug.hpp"
+#include "statchem/modeler/checkpointwriter.hpp"
+#include "statchem/modeler/forcefield.hpp"
 #include "statchem/modeler/topology.hpp"
 #include "statchem/molib/molecule.hpp"
 
@@ -32,6 +36,9 @@ class HarmonicAngleForce;
 class HarmonicBondForce;
 class PeriodicTorsionForce;
 class CustomNonbondedForce;
+class CustomBondForce;
+class NonbondedForce;
+class Vec3;
 }  // namespace OpenMM
 
 namespace statchem {
@@ -43,6 +50,7 @@ class Molecule;
 
 namespace OMMIface {
 struct ForceField;
+class ReceptorField;
 
 class SystemTopology {
    public:
@@ -56,6 +64,12 @@ class SystemTopology {
    private:
     #define num_checkpoints 5
     int checkpoint_num;
+
+    CheckpointPolicy __checkpoint_policy;
+    int __steps_since_checkpoint;
+    std::chrono::steady_clock::time_point __last_checkpoint;
+    std::string __checkpoint_progress;
+    std::unique_ptr<CheckpointWriter> __checkpoint_writer;
     
     OpenMM::System* system;
     OpenMM::Integrator* integrator;
@@ -68,6 +82,10 @@ class SystemTopology {
     OpenMM::HarmonicBondForce* bondStretch;
     OpenMM::HarmonicAngleForce* bondBend;
     OpenMM::PeriodicTorsionForce* bondTorsion;
+    // Ligands added by init_batch_ligand. Each one has bonded forces of its
+    // own, of which the three above only hold the last, so a batch cannot be
+    // masked
+    int __num_batch_ligands;
 
     const ForceField* __ffield;
 
@@ -75,6 +93,27 @@ class SystemTopology {
     std::vector<bool> masked;
     std::vector<double> masses;
 
+    // Bitmap of the particles last (un)masked, and the same particles as a
+    // list. Changes to the bonded forces are only sent to the context when
+    // the outermost mask batch is committed
+    std::vector<bool> __substruct;
+    std::vector<int> __substruct_idx;
+    int __mask_batch_depth;
+    bool __stretch_changed, __bend_changed, __torsion_changed;
+
+    // Ligand slot: particles [__slot_begin, __slot_begin + __slot_size) hold
+    // the current ligand and are followed by __num_anchors particles which
+    // the unused bonded terms of the slot are parked on
+    static const int __num_anchors = 4;
+    int __slot_begin, __slot_size;
+    int __slot_bonds, __slot_angles, __slot_torsions;
+    int __slot_bond_idx, __slot_angle_idx, __slot_torsion_idx;
+    std::set<int> __slot_idatm_types;
+    std::map<int, int> __idatm_to_internal;
+    int __dummy_type;
+    OpenMM::NonbondedForce* nonbond;
+    OpenMM::CustomBondForce* slot_pairs;
+
     class AtomPoint {
        private:
         const geometry::Point __crd;
@@ -102,21 +141,72 @@ class SystemTopology {
         bondTorsionData;
 
     void retype_amber_protein_atom_to_gaff(const molib::Atom& atom, int& type);
+    std::vector<int> get_term_types(const Topology& topology,
+                                    const molib::Atom::ConstVec& atoms);
+    ForceField::BondType get_bond_type(const Topology& topology,
+                                       const molib::Atom& atom1,
+                                       const molib::Atom& atom2);
+    ForceField::AngleType get_angle_type(const Topology& topology,
+                                         const molib::Atom& atom1,
+                                         const molib::Atom& atom2,
+                                         const molib::Atom& atom3);
+    ForceField::TorsionTypeVec get_torsion_types(
+        const Topology& topology, const molib::Atom& atom1,
+        const molib::Atom& atom2, const molib::Atom& atom3,
+        const molib::Atom& atom4, const bool improper);
+
+    void init_slot_pairs(const std::vector<double>& off);
+    OpenMM::Vec3 parked_position(const int idx) const;
+    // Particles of the bonded terms of the ligand slot, in term order
+    std::vector<int> slot_bonded_particles() const;
+
+    void set_substruct(const Topology& topology,
+                       const molib::Atom::Vec& atoms);
+    void set_forces(const int atom_idx, const std::vector<bool>& substruct,
+                    const bool enable);
 
    public:
     SystemTopology()
-        : system(nullptr),
+        : checkpoint_num(0),
+          __checkpoint_policy{1, 0.0},
+          __steps_since_checkpoint(0),
+          __last_checkpoint(std::chrono::steady_clock::now()),
+          system(nullptr),
           integrator(nullptr),
           context(nullptr),
+          forcefield(nullptr),
           __integrator_used(integrator_type::none),
-          __thermostat_idx(-1) {}
+          __thermostat_idx(-1),
+          __num_batch_ligands(0),
+          __mask_batch_depth(0),
+          __stretch_changed(false),
+          __bend_changed(false),
+          __torsion_changed(false),
+          __slot_begin(0),
+          __slot_size(0),
+          __slot_bonds(0),
+          __slot_angles(0),
+          __slot_torsions(0),
+          __dummy_type(-1),
+          nonbond(nullptr),
+          slot_pairs(nullptr) {}
     ~SystemTopology();
     static void loadPlugins(const std::string& extra_dir = "");
+    // Both throw Error on a system of batch ligands
     void mask(Topology& topology, const molib::Atom::Vec& atoms);
     void unmask(Topology& topology, const molib::Atom::Vec& atoms);
 
-    void mask_forces(const int atom_idx, const std::set<int>& substruct);
-    void unmask_forces(const int atom_idx, const std::set<int>& substruct);
+    /**
+     * Defers the context updates of mask and unmask until the matching
+     * commit_mask_batch, which updates each changed force once. Batches may
+     * be nested; only the outermost commit reaches the context. Use
+     * ScopedMaskBatch to keep them balanced.
+     */
+    void begin_mask_batch();
+    void commit_mask_batch();
+
+    void mask_forces(const int atom_idx, const std::vector<bool>& substruct);
+    void unmask_forces(const int atom_idx, const std::vector<bool>& substruct);
 
     void init_integrator(SystemTopology::integrator_type type,
                          const double step_size_in_ps,
@@ -133,9 +223,32 @@ class SystemTopology {
                                     double cutoff);
     void init_knowledge_based_force_3d(Topology& topology,
                                        double scale, double cutoff);
+    // Knowledge-based interactions with a rigid receptor which is not part
+    // of the system, read from the grid maps of field
+    void init_receptor_field_force(Topology& topology,
+                                   const ReceptorField& field, double scale);
+
+    // Ligands of a batch share the system but interact neither with each
+    // other nor with a receptor other than through field. The forces of
+    // each ligand go into their own force group, which limits the batch
+    // to max_batch_size ligands.
+    static const int max_batch_size = 32;
+    void init_batch_ligand(Topology& topology, const ReceptorField& field,
+                           double scale, double cutoff,
+                           const bool use_constraints, const int group);
     void init_bonded(Topology& topology, const bool use_constraints);
     void init_positions(const geometry::Point::Vec& crds);
 
+    // Grows the ligand slot so that the ligand described by topology fits
+    // into it; must be called before init_particles
+    void reserve_ligand(const Topology& topology);
+    bool has_ligand_slot() const { return __slot_size > 0; }
+    // Swaps the ligand, i.e. the atoms of topology following the receptor,
+    // into the slot of an initialized context. Only parameters are updated
+    // if the bonded terms stay on the same particles, e.g. for another pose
+    // of the previous ligand; otherwise the context is reinitialized.
+    void set_ligand(const Topology& topology);
+
     void update_thermostat(const double temperature_in_kelvin,
                            const double collision_frequency);
 
@@ -143,14 +256,30 @@ class SystemTopology {
     geometry::Point::Vec get_forces();
 
     double get_potential_energy();
+    double get_potential_energy(const int group);
     double get_kinetic_energy();
 
     void set_temperature();
     void set_box_vector();
 
+    // Also loads checkpoints of earlier releases, see is_legacy_checkpoint
     void load_checkpoint(const std::string& checkpoint);
+
+    // checkpoint_if_due() saves a checkpoint whenever the policy says one is
+    // due, by default after every run of dynamics()
+    void set_checkpoint_policy(const CheckpointPolicy& policy);
+    bool checkpoint_due() const;
+    void checkpoint_if_due();
+
+    // Takes a snapshot of the context which is written to the next of the
+    // rotating checkpoint files in the background
     void save_checkpoint();
-    void save_checkpoint_candock(int x, int y);
+
+    // Program state stored in the following checkpoints, see read_checkpoint
+    void set_checkpoint_progress(const std::string& progress);
+
+    // Waits until all checkpoints taken so far are written
+    void flush_checkpoints();
 
     // Print kinetic, potential, and total energies to stderr
     void print_energies();
@@ -162,6 +291,22 @@ class SystemTopology {
     double get_energies();
     void set_forcefield(const ForceField& ffield) { __ffield = &ffield; }
 };
+
+// Mask batch of a SystemTopology that is committed when it goes out of scope,
+// also when an exception leaves it
+class ScopedMaskBatch {
+    SystemTopology& __system_topology;
+
+   public:
+    explicit ScopedMaskBatch(SystemTopology& system_topology)
+        : __system_topology(system_topology) {
+        __system_topology.begin_mask_batch();
+    }
+    ~ScopedMaskBatch();
+
+    ScopedMaskBatch(const ScopedMaskBatch&) = delete;
+    ScopedMaskBatch& operator=(const ScopedMaskBatch&) = delete;
+};
 }  // namespace OMMIface
 }  // namespace statchem
 
@@ -49,15 +49,19 @@ class Topology {
     BondedExclusions bonded_exclusions;
 
    private:
+    int first_index;
     std::map<const molib::Atom*, const int> atom_to_type;
     std::map<const molib::Atom*, const int> atom_to_index;
 
    public:
+    // A topology of particles first_index onwards of a larger system
+    explicit Topology(const int first_index = 0) : first_index(first_index) {}
     ~Topology() { dbgmsg("calling destructor of Topology"); }
 
     Topology& add_topology(const molib::Atom::Vec& atoms,
                            const ForceField& ffield);
     int get_index(const molib::Atom& atom) const;
+    std::vector<int> get_indices(const molib::Atom::Vec& atoms) const;
     int get_type(const molib::Atom& atom) const;
 };
 
@@ -157,6 +157,13 @@ class Atom : public template_vector_container<Atom*, Atom> {
         if (__smiles_prop.count(prop) == 0) return 0;
         return __smiles_prop.at(prop);
     }
+    const std::map<std::string, int>& get_smiles_prop() const {
+        return __smiles_prop;
+    }
+    const std::string& smiles_label() const { return __smiles_label; }
+    void set_smiles_label(const std::string& smiles_label) {
+        __smiles_label = smiles_label;
+    }
     int get_num_bond_with_bond_gaff_type(const std::string& prop) const;
     int compute_num_property(const std::string& prop) const;
     void set_crd(const geometry::Coordinate& crd) { __crd = crd; }
@@ -176,6 +183,7 @@ class Atom : public template_vector_container<Atom*, Atom> {
     double distance() const { return 0.0; }  // just dummy : needed by grid
     void distance(double) const {}           // just dummy : needed by grid
     const std::map<int, int>& get_aps() const { return __aps; }
+    void set_aps(const std::map<int, int>& aps) { __aps = aps; }
     void set_members(const std::string& str);
     const Residue& br() const { return *static_cast<const Residue*>(__br); }
     void set_br(void* br) { __br = br; }
@@ -84,7 +84,9 @@ class Bond : public template_vector_container<Bond*, Bond> {
     void set_members(const std::string& str);
     bool is_adjacent(const Bond& other);
     void set_angle(int angle) { __angles.insert(angle); }
+    const std::set<int>& get_angles() const { return __angles; }
     void set_drive_id(int drive_id) { __drive_id = drive_id; }
+    int get_drive_id() const { return __drive_id; }
     void set_rotatable(const std::string& rotatable) {
         __rotatable = rotatable;
     }
@@ -15,6 +15,7 @@
 
 #ifndef GRID_H
 #define GRID_H
+#include <cmath>
 #include <fstream>
 #include <map>
 #include <sstream>
@@ -33,7 +34,14 @@ class Grid {
     typedef std::vector<T*> Points;
 
    private:
-    Points*** storage;
+    // Cell list : points are sorted by cell (keeping their input order inside
+    // a cell) and __cell_start[c] .. __cell_start[c + 1] is the range of cell
+    // c = (i * szj + j) * szk + k. Coordinates are copied into parallel x/y/z
+    // arrays when the grid is built, so the grid must be rebuilt if the
+    // points move.
+    Points __points;
+    std::vector<size_t> __cell_start;
+    std::vector<double> __x, __y, __z;
     int szi, szj, szk;
     geometry::Coordinate __min_crd;
 
@@ -57,63 +65,45 @@ class Grid {
 
         return crd;
     }
-    void __allocate(const int szii, const int szjj, const int szkk) {
-        storage = new Points**[szii];  // allocate memory
 
-        for (int i = 0; i < szii; ++i) {
-            storage[i] = new Points*[szjj];
-
-            for (int j = 0; j < szjj; ++j) {
-                storage[i][j] = new Points[szkk];
-            }
-        }
+    size_t __cell(const int i, const int j, const int k) const {
+        return (static_cast<size_t>(i) * szj + j) * szk + k;
     }
-    // Windows defines a macro called __deallocate, thus I had to rename this
-    void __my_deallocate() {
-        for (int i = 0; i < szi; ++i) {
-            for (int j = 0; j < szj; ++j) {
-                for (int k = 0; k < szk; ++k) {
-                    storage[i][j][k].clear();
-                }
 
-                delete[] storage[i][j];
-            }
+    // Calls fn(n, d_sq) for every stored point n in the cells between cmin
+    // and cmax. For each (i, j) the cells along k are adjacent, so each of
+    // these runs is one linear scan. Stops early and returns true as soon as
+    // fn returns true.
+    template <typename F>
+    bool __scan(const geometry::Coordinate& crd,
+                const geometry::Coordinate& cmin,
+                const geometry::Coordinate& cmax, F fn) const {
+        const double px = crd.x(), py = crd.y(), pz = crd.z();
 
-            delete[] storage[i];
-        }
+        if (cmin.k() > cmax.k()) return false;
 
-        delete[] storage;
-    }
+        for (int i = cmin.i(); i <= cmax.i(); ++i)
+            for (int j = cmin.j(); j <= cmax.j(); ++j) {
+                const size_t first = __cell_start[__cell(i, j, cmin.k())];
+                const size_t last = __cell_start[__cell(i, j, cmax.k()) + 1];
 
-   public:
-    Grid& operator=(const Grid& rhs) {
-        dbgmsg("Grid assignment operator");
-
-        if (this != &rhs) {
-            // Deallocate, allocate new space, copy values...
-            this->__my_deallocate();
-            this->__allocate(rhs.szi, rhs.szj, rhs.szk);
-            this->__min_crd = rhs.__min_crd;
-            this->szi = rhs.szi;
-            this->szj = rhs.szj;
-            this->szk = rhs.szk;
-
-            for (int i = 0; i < szi; ++i) {
-                for (int j = 0; j < szj; ++j) {
-                    for (int k = 0; k < szk; ++k)
-                        storage[i][j][k].assign(rhs.storage[i][j][k].begin(),
-                                                rhs.storage[i][j][k].end());
+                for (size_t n = first; n < last; ++n) {
+                    const double dx = px - __x[n];
+                    const double dy = py - __y[n];
+                    const double dz = pz - __z[n];
+
+                    if (fn(n, dx * dx + dy * dy + dz * dz)) return true;
                 }
             }
-        }
 
-        return *this;
+        return false;
     }
 
-    Grid() : storage(nullptr), szi(0), szj(0), szk(0) {}
+   public:
+    Grid() : szi(0), szj(0), szk(0) {}
 
     template <typename P>
-    Grid(const P& points) : storage(nullptr), szi(0), szj(0), szk(0) {
+    Grid(const P& points) : szi(0), szj(0), szk(0) {
         dbgmsg("size of points in grid " << points.size());
         dbgmsg("points is empty " << points.empty());
 
@@ -148,66 +138,135 @@ class Grid {
             szi = corr.i() + 1;
             szj = corr.j() + 1;
             szk = corr.k() + 1;
-            this->__allocate(szi, szj, szk);
 
-            for (auto& point : points) {  // set data points to grid cells
+            // counting sort of the data points into grid cells
+            std::vector<size_t> cells;
+            cells.reserve(points.size());
+            __cell_start.assign(static_cast<size_t>(szi) * szj * szk + 1, 0);
+
+            for (auto& point : points) {
                 geometry::Coordinate crd = point->crd() - min_crd;
-                //~ storage[crd.i()][crd.j()][crd.k()].push_back(&*point);
-                storage[crd.i()][crd.j()][crd.k()].push_back(&*point);
+                cells.push_back(__cell(crd.i(), crd.j(), crd.k()));
+                ++__cell_start[cells.back() + 1];
+            }
+
+            for (size_t c = 1; c < __cell_start.size(); ++c)
+                __cell_start[c] += __cell_start[c - 1];
+
+            const size_t num_points = cells.size();
+            __points.resize(num_points);
+            __x.resize(num_points);
+            __y.resize(num_points);
+            __z.resize(num_points);
+
+            std::vector<size_t> next(__cell_start.begin(),
+                                     __cell_start.end() - 1);
+            size_t p = 0;
+
+            for (auto& point : points) {
+                const size_t n = next[cells[p++]]++;
+                __points[n] = &*point;
+                __x[n] = point->crd().x();
+                __y[n] = point->crd().y();
+                __z[n] = point->crd().z();
             }
         }
 
         dbgmsg("points is empty2 " << std::boolalpha << points.empty());
     }
 
-    ~Grid() {
-        dbgmsg("Grid destructor");
-        this->__my_deallocate();
+    // All points, in cell order
+    const Points& get_points() const { return __points; }
+
+    // Calls fn(neighbor, d_sq) for every point within dist of point, excluding
+    // points that coincide with it. Nothing is allocated, so this is the
+    // preferred way to visit neighbors in hot loops.
+    template <typename U, typename F>
+    void for_each_neighbor(const U& point, const double& dist, F fn) const {
+        geometry::Coordinate cmin = __correct(point, -dist);
+        geometry::Coordinate cmax = __correct(point, dist);
+        const double dist_sq = pow(dist, 2);
+
+        __scan(point, cmin, cmax, [&](size_t n, double d_sq) {
+            if (d_sq < dist_sq && d_sq > 0) fn(__points[n], d_sq);
+            return false;
+        });
     }
 
-    template <typename U>
-    Points get_neighbors(const U& point, const double& dist) const {
+    // Same as for_each_neighbor, but also visits points at distance zero
+    template <typename U, typename F>
+    void for_each_neighbor_including_self(const U& point, const double& dist,
+                                          F fn) const {
         geometry::Coordinate cmin = __correct(point, -dist);
         geometry::Coordinate cmax = __correct(point, dist);
-        Points points;
         const double dist_sq = pow(dist, 2);
 
-        for (int i = cmin.i(); i <= cmax.i(); ++i)
-            for (int j = cmin.j(); j <= cmax.j(); ++j)
-                for (int k = cmin.k(); k <= cmax.k(); ++k) {
-                    for (auto neighbor : storage[i][j][k]) {
-                        const double d_sq = point.distance_sq(neighbor->crd());
-
-                        if (d_sq < dist_sq && d_sq > 0) {
-                            neighbor->distance(d_sq);
-                            points.push_back(neighbor);
-                        }
-                    }
-                }
+        __scan(point, cmin, cmax, [&](size_t n, double d_sq) {
+            if (d_sq < dist_sq) fn(__points[n], d_sq);
+            return false;
+        });
+    }
 
-        return points;
+    template <typename U, typename F>
+    void for_each_neighbor_within_tolerance_asymmetric(
+        const U& point, const double& dist, const double& lower_tol,
+        const double& upper_tol, F fn) const {
+        geometry::Coordinate cmin = __correct(point, -(dist + upper_tol));
+        geometry::Coordinate cmax = __correct(point, dist + upper_tol);
+        const double dist_sq_max = pow(dist + upper_tol, 2);
+        const double dist_sq_min =
+            dist > lower_tol ? pow(dist - lower_tol, 2) : 0.0;
+
+        __scan(point, cmin, cmax, [&](size_t n, double d_sq) {
+            dbgmsg("neighbor = " << __points[n]->crd());
+            if (d_sq < dist_sq_max && d_sq > dist_sq_min)
+                fn(__points[n], d_sq);
+            return false;
+        });
     }
 
-    template <typename U>
-    Points get_neighbors_including_self(const U& point, const double& dist) {
+    // Calls fn(points, x, y, z, n) for each run of adjacent cells that may
+    // hold points within dist of point. The n points of a run and their
+    // coordinates are contiguous, which suits vectorized distance kernels.
+    // No distance filtering is done here.
+    template <typename U, typename F>
+    void for_each_candidate_run(const U& point, const double& dist,
+                                F fn) const {
         geometry::Coordinate cmin = __correct(point, -dist);
         geometry::Coordinate cmax = __correct(point, dist);
-        Points points;
-        const double dist_sq = pow(dist, 2);
+
+        if (cmin.k() > cmax.k()) return;
 
         for (int i = cmin.i(); i <= cmax.i(); ++i)
-            for (int j = cmin.j(); j <= cmax.j(); ++j)
-                for (int k = cmin.k(); k <= cmax.k(); ++k) {
-                    for (auto neighbor : storage[i][j][k]) {
-                        const double d_sq = point.distance_sq(neighbor->crd());
-
-                        if (d_sq < dist_sq) {
-                            neighbor->distance(d_sq);
-                            points.push_back(neighbor);
-                        }
-                    }
+            for (int j = cmin.j(); j <= cmax.j(); ++j) {
+                const size_t first = __cell_start[__cell(i, j, cmin.k())];
+                const size_t last = __cell_start[__cell(i, j, cmax.k()) + 1];
+
+                if (last > first) {
+                    fn(&__points[first], &__x[first], &__y[first],
+                       &__z[first], last - first);
                 }
+            }
+    }
 
+    template <typename U>
+    Points get_neighbors(const U& point, const double& dist) const {
+        Points points;
+        for_each_neighbor(point, dist, [&points](T* neighbor, double d_sq) {
+            neighbor->distance(d_sq);
+            points.push_back(neighbor);
+        });
+        return points;
+    }
+
+    template <typename U>
+    Points get_neighbors_including_self(const U& point, const double& dist) {
+        Points points;
+        for_each_neighbor_including_self(
+            point, dist, [&points](T* neighbor, double d_sq) {
+                neighbor->distance(d_sq);
+                points.push_back(neighbor);
+            });
         return points;
     }
 
@@ -222,26 +281,10 @@ class Grid {
                                                      const double& dist,
                                                      const double& lower_tol,
                                                      const double& upper_tol) {
-        geometry::Coordinate cmin = __correct(point, -(dist + upper_tol));
-        geometry::Coordinate cmax = __correct(point, dist + upper_tol);
         Points points;
-        const double dist_sq_max = pow(dist + upper_tol, 2);
-        const double dist_sq_min =
-            dist > lower_tol ? pow(dist - lower_tol, 2) : 0.0;
-
-        for (int i = cmin.i(); i <= cmax.i(); ++i)
-            for (int j = cmin.j(); j <= cmax.j(); ++j)
-                for (int k = cmin.k(); k <= cmax.k(); ++k) {
-                    for (auto neighbor : storage[i][j][k]) {
-                        dbgmsg("neighbor = " << neighbor->crd());
-                        const double d_sq = point.distance_sq(neighbor->crd());
-
-                        if (d_sq < dist_sq_max && d_sq > dist_sq_min) {
-                            points.push_back(neighbor);
-                        }
-                    }
-                }
-
+        for_each_neighbor_within_tolerance_asymmetric(
+            point, dist, lower_tol, upper_tol,
+            [&points](T* neighbor, double) { points.push_back(neighbor); });
         return points;
     }
 
@@ -251,19 +294,9 @@ class Grid {
         geometry::Coordinate cmax = __correct(point, dist);
         const double dist_sq = pow(dist, 2);
 
-        for (int i = cmin.i(); i <= cmax.i(); ++i)
-            for (int j = cmin.j(); j <= cmax.j(); ++j)
-                for (int k = cmin.k(); k <= cmax.k(); ++k) {
-                    for (auto neighbor : storage[i][j][k]) {
-                        const double d_sq = point.distance_sq(neighbor->crd());
-
-                        if (d_sq < dist_sq && d_sq > 0) {
-                            return true;
-                        }
-                    }
-                }
-
-        return false;
+        return __scan(point, cmin, cmax, [&](size_t, double d_sq) {
+            return d_sq < dist_sq && d_sq > 0;
+        });
     }
 
     template <typename U>
@@ -283,20 +316,14 @@ class Grid {
         geometry::Coordinate cmax = __correct(atom.crd(), dist);
         Points points;
 
-        for (int i = cmin.i(); i <= cmax.i(); ++i)
-            for (int j = cmin.j(); j <= cmax.j(); ++j)
-                for (int k = cmin.k(); k <= cmax.k(); ++k) {
-                    for (auto neighbor : storage[i][j][k]) {
-                        const double d_sq =
-                            atom.crd().distance_sq(neighbor->crd());
-                        const double vdw2 = neighbor->radius();
-
-                        if (d_sq < pow(clash_coeff * (vdw1 + vdw2), 2) &&
-                            d_sq > 0) {
-                            points.push_back(neighbor);
-                        }
-                    }
-                }
+        __scan(atom.crd(), cmin, cmax, [&](size_t n, double d_sq) {
+            const double vdw2 = __points[n]->radius();
+
+            if (d_sq < pow(clash_coeff * (vdw1 + vdw2), 2) && d_sq > 0) {
+                points.push_back(__points[n]);
+            }
+            return false;
+        });
 
         return points;
     }
@@ -308,22 +335,11 @@ class Grid {
         geometry::Coordinate cmin = __correct(atom.crd(), -dist);
         geometry::Coordinate cmax = __correct(atom.crd(), dist);
 
-        for (int i = cmin.i(); i <= cmax.i(); ++i)
-            for (int j = cmin.j(); j <= cmax.j(); ++j)
-                for (int k = cmin.k(); k <= cmax.k(); ++k) {
-                    for (auto neighbor : storage[i][j][k]) {
-                        const double d_sq =
-                            atom.crd().distance_sq(neighbor->crd());
-                        const double vdw2 = neighbor->radius();
-
-                        if (d_sq < pow(clash_coeff * (vdw1 + vdw2), 2) &&
-                            d_sq > 0) {
-                            return true;
-                        }
-                    }
-                }
+        return __scan(atom.crd(), cmin, cmax, [&](size_t n, double d_sq) {
+            const double vdw2 = __points[n]->radius();
 
-        return false;
+            return d_sq < pow(clash_coeff * (vdw1 + vdw2), 2) && d_sq > 0;
+        });
     }
 };
 }
@@ -222,6 +222,12 @@ class template_map_container {
     bool empty() const { return (begin() == end()); }
     size_t size() const { return __m.size(); }
     void erase(Z p) { __m.erase(p); }
+    // takes element p out of the container, handing over its ownership
+    std::unique_ptr<T> release(Z p) {
+        std::unique_ptr<T> t = std::move(__m.at(p));
+        __m.erase(p);
+        return t;
+    }
     void erase_shrink(Z p) {
         __m[p].swap(__m.rbegin()->second);
         __m.erase(__m.rbegin()->first);
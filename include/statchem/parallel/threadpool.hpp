@@ -0,0 +1,105 @@
+/* This is threadpool.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "statchem/helper/benchmark.hpp"
+
+namespace statchem {
+
+namespace parallel {
+
+/* A fixed set of worker threads, each with its own deque of work. Workers
+ * take work from the back of their own deque and, when it is empty, steal
+ * from the front of the others, so threads that drew cheap items help those
+ * that drew expensive ones.
+ */
+class ThreadPool {
+   public:
+    struct ThreadStats {
+        size_t items;         // loop indices executed
+        size_t chunks;        // chunks executed
+        size_t stolen;        // chunks taken from another worker's deque
+        double busy_seconds;  // time spent executing chunks
+        ThreadStats() : items(0), chunks(0), stolen(0), busy_seconds(0) {}
+    };
+
+   private:
+    struct Job;
+    struct Task {
+        Job* job;
+        size_t begin, end;
+    };
+    struct Worker {
+        std::mutex mtx;
+        std::deque<Task> tasks;
+        ThreadStats stats;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> __workers;
+    std::mutex __sleep_mtx;
+    std::condition_variable __wake;
+    std::atomic<size_t> __pending;
+    bool __stop;
+    Benchmark __since;
+
+    bool __pop(const size_t id, Task& task);
+    bool __steal(const size_t id, Task& task);
+    void __run(const size_t id, const Task& task, const bool stolen);
+    void __work(const size_t id);
+
+   public:
+    // num_threads == 0 uses std::thread::hardware_concurrency()
+    explicit ThreadPool(const size_t num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const { return __workers.size(); }
+
+    /* Calls fn(i) for every i in [begin, end) and returns when all calls
+     * are done. The range is cut into chunks of chunk_size indices (0 picks
+     * a size that gives each thread several chunks) which are dealt out to
+     * the workers and rebalanced by stealing. The first exception thrown by
+     * fn is rethrown here. May be called from inside fn; the calling worker
+     * then helps with the work instead of blocking.
+     */
+    void parallel_for(const size_t begin, const size_t end,
+                      const std::function<void(size_t)>& fn,
+                      const size_t chunk_size = 0);
+
+    // Per-worker statistics since construction or the last reset_stats().
+    // Only meaningful between parallel_for calls.
+    std::vector<ThreadStats> get_stats() const;
+    void reset_stats();
+    // Reports per-thread utilization through log_benchmark
+    void log_stats(const std::string& what) const;
+};
+}
+}
+
+#endif
@@ -28,14 +28,45 @@ namespace parser {
 class FileParser {
    private:
     class PdbParser : public Parser {
+        template <class Lines>
+        bool __parse_records(molib::Molecules&, const Lines& lines);
+
+       protected:
+        bool __starts_molecule(const std::string& line) const override;
+        bool __parse_lines(molib::Molecules&,
+                           const std::vector<std::string>& lines) override;
+
        public:
         using Parser::Parser;
         void parse_molecule(molib::Molecules&);
     };
     class Mol2Parser : public Parser {
+       protected:
+        bool __starts_molecule(const std::string& line) const override;
+        bool __parse_lines(molib::Molecules&,
+                           const std::vector<std::string>& lines) override;
+
        public:
         using Parser::Parser;
         void parse_molecule(molib::Molecules&);
+        void parse_molecule(molib::Molecules&, parallel::ThreadPool& pool);
+    };
+    // reads the binary store of typed molecules, see fileio/moleculestore
+    class StchParser : public Parser {
+        bool __header_read;
+        void __read_header();
+
+       protected:
+        bool __starts_molecule(const std::string& line) const override;
+        bool __parse_lines(molib::Molecules&,
+                           const std::vector<std::string>& lines) override;
+
+       public:
+        StchParser(std::istream& molecule_file, unsigned int hm = all_models,
+                   const int num_occur = -1)
+            : Parser(molecule_file, hm, num_occur), __header_read(false) {}
+        void parse_molecule(molib::Molecules&) override;
+        bool parse_next_molecule(molib::Molecules&) override;
     };
     std::shared_ptr<std::istream> molecule_stream;
     std::unique_ptr<Parser> p;
@@ -51,7 +82,16 @@ class FileParser {
                         unsigned int hm = all_models, const int num_occur = -1);
     void set_flags(unsigned int hm);
     bool parse_molecule(molib::Molecules& mols);
+    // As above; the molecules of a mol2 file opened by name are parsed
+    // concurrently on pool and added to mols in file order
+    bool parse_molecule(molib::Molecules& mols, parallel::ThreadPool& pool);
     molib::Molecules parse_molecule();
+
+    // Incremental mode : appends the next molecule of the file to mols and
+    // returns false once the file is exhausted. Only the lines of a single
+    // molecule are held in memory, so files of any size can be processed
+    // molecule by molecule. Must not be mixed with parse_molecule.
+    bool parse_next_molecule(molib::Molecules& mols);
 };
 }
 }
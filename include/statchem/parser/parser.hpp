@@ -17,7 +17,9 @@
 #define PARSER_H
 
 #include <string>
+#include <vector>
 #include "statchem/molib/molecules.hpp"
+#include "statchem/parallel/threadpool.hpp"
 
 namespace statchem {
 
@@ -40,6 +42,26 @@ class Parser {
     unsigned int __hm;
     const int __num_occur;
     bool __giant_molecule;
+    // file behind __stream, if the parser may read it through a memory map
+    std::string __mapped_file;
+    // Where a read of the mapped file starts : the position of __stream, so
+    // that the mapped and the streamed reads agree. Returns false if the
+    // stream has nothing left to read. The caller moves __stream to the end
+    // of what it read.
+    bool __mapped_offset(const size_t file_size, size_t& offset);
+    // state of the incremental reader : lines of the current molecule and
+    // the already read first line of the next one
+    std::vector<std::string> __block;
+    std::string __lookahead;
+    bool __has_lookahead;
+    bool __exhausted;
+    bool __read_block();
+    // true if line opens a new molecule in the file format
+    virtual bool __starts_molecule(const std::string& line) const = 0;
+    // parses lines into mols, returns true if the rest of the file is to
+    // be skipped
+    virtual bool __parse_lines(molib::Molecules&,
+                               const std::vector<std::string>& lines) = 0;
     void __generate_molecule(molib::Molecules&, bool&, const std::string&);
     void __generate_assembly(molib::Molecules&, bool&, int, const std::string&);
     void __generate_model(molib::Molecules&, bool&, int);
@@ -50,9 +72,17 @@ class Parser {
         : __stream(molecule_file),
           __hm(hm),
           __num_occur(num_occur),
-          __giant_molecule(false) {}
+          __giant_molecule(false),
+          __has_lookahead(false),
+          __exhausted(false) {}
     virtual ~Parser() {}
     virtual void parse_molecule(molib::Molecules&) = 0;
+    // parsers that can split the file into independent molecules parse them
+    // concurrently on pool, the others just call parse_molecule
+    virtual void parse_molecule(molib::Molecules& mols,
+                                parallel::ThreadPool& pool);
+    virtual bool parse_next_molecule(molib::Molecules&);
+    void map_file(const std::string& filename) { __mapped_file = filename; }
     virtual void set_pos(std::streampos pos);
     virtual void set_hm(unsigned int hm);
 };
@@ -0,0 +1,60 @@
+/* This is distkernel.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef DISTKERNEL_H
+#define DISTKERNEL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "statchem/geometry/coordinate.hpp"
+
+namespace statchem {
+
+namespace score {
+
+// Largest number of points handed to distances_within in one call; callers
+// size their output buffers with it
+const size_t distance_kernel_block = 64;
+
+/* Computes the distances between crd and n points given as separate x, y and
+ * z arrays, and keeps those with 0 < d_sq < cutoff_sq (the same test as
+ * Grid::for_each_neighbor). For each kept point its position in the input,
+ * its distance and, if bins is not null, its histogram bin
+ * floor((d + 0.0000000001) / step) are written to which, dist and bins.
+ * Input order is preserved. Returns the number of kept points (n must not
+ * exceed distance_kernel_block).
+ *
+ * The AVX2 or SSE2 implementation is picked at the first call on x86-64
+ * Linux, with a scalar fallback elsewhere. All of them give the same results
+ * as the scalar code bit for bit.
+ */
+size_t distances_within(const double* x, const double* y, const double* z,
+                        const size_t n, const geometry::Coordinate& crd,
+                        const double cutoff_sq, const double step,
+                        uint32_t* which, double* dist, int* bins);
+
+// Name of the implementation used by distances_within
+const char* distance_kernel_name();
+
+// Switches distances_within to the "scalar", "sse2" or "avx2" implementation,
+// e.g. to compare them in tests. Returns false, leaving the implementation
+// unchanged, if the name is unknown or the CPU lacks the instructions. Not
+// thread-safe, call it before scoring.
+bool set_distance_kernel(const std::string& name);
+}
+}
+
+#endif
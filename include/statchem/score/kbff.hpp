@@ -25,6 +25,12 @@ class KBFF : public Score {
     double __step_non_bond;
     std::set<pair_of_ints> __unavailible;
 
+    void __parse_objective_archive(const std::string& archive_file);
+    // fits the objective function of one pair, throws InterpolationError
+    // if it cannot be fitted
+    std::vector<double> __compile_pair(const pair_of_ints& atom_pair,
+                                       std::string& note) const;
+
    public:
     KBFF(const std::string& ref_state, const std::string& comp,
          const std::string& rad_or_raw, const double& dist_cutoff,
@@ -38,12 +44,24 @@ class KBFF : public Score {
     const std::set<pair_of_ints>& get_unavailible() const { return __unavailible; }
     bool is_availible(int idatm1, int idatm2);
 
-    KBFF& compile_objective_function();
+    KBFF& compile_objective_function(const size_t nthreads = 1);
+    KBFF& compile_objective_function(parallel::ThreadPool& pool);
+    // Compiles both the scoring and objective functions from
+    // distributions_file, going through the TableCache in cache_dir like
+    // Score::compile_scoring_function(distributions_file, cache_dir)
+    KBFF& compile_objective_function(const std::string& distributions_file,
+                                     const std::string& cache_dir,
+                                     const size_t nthreads = 1);
     KBFF& parse_objective_function(const std::string& obj_dir,
                                    const double scale_non_bond,
                                    const size_t max_step);
     KBFF& output_objective_function(const std::string& obj_dir);
 
+    // writes the whole objective function to the single indexed file
+    // obj_dir/<step>.bin, which parse_objective_function prefers over
+    // the per pair text files
+    KBFF& output_objective_archive(const std::string& obj_dir);
+
     friend std::ostream& operator<<(std::ostream& stream, const KBFF& kbff);
 };
 }
@@ -0,0 +1,73 @@
+/* This is multiscore.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef MULTISCORE_H
+#define MULTISCORE_H
+#include "statchem/score/score.hpp"
+
+namespace statchem {
+
+namespace score {
+
+/* Evaluates several compiled scoring functions in a single pass. The
+ * receptor neighbors of each ligand atom are found once at the largest
+ * cutoff, the distance bin is computed once per atom pair, and that bin adds
+ * into every function through a table that stacks their energies. Each
+ * result equals Score::non_bonded_energy of the corresponding function.
+ *
+ * Only the atom types of the functions' compositions are supported, and all
+ * functions must have been compiled from the same distributions.
+ */
+class MultiScore {
+    std::vector<int> __type_index;
+    size_t __num_types;
+    size_t __num_bins;
+    double __step_in_file;
+    double __dist_cutoff;
+
+    // Functions sorted by decreasing cutoff, so the functions whose cutoff
+    // includes bin b are the first __num_active[b]; __order maps them back
+    // to the order they were given in.
+    std::vector<size_t> __order;
+    std::vector<size_t> __num_active;
+    std::vector<size_t> __bin_offset;
+    size_t __pair_size;
+
+    // For each pair of local atom types in upper-triangular order and each
+    // bin, the energies of the active functions
+    std::vector<double> __energies_table;
+    std::vector<bool> __pair_defined;
+
+    size_t __get_pair_index(const int atom_1, const int atom_2) const;
+
+   public:
+    explicit MultiScore(const std::vector<const Score*>& scores);
+
+    size_t size() const { return __order.size(); }
+
+    // The score of ligand by each function, in the order they were given
+    std::vector<double> non_bonded_energy(const molib::Atom::Grid& gridrec,
+                                          const molib::Molecule& ligand) const;
+
+    // out[i] holds the scores of ligands[i]
+    void score_batch(const molib::Atom::Grid& gridrec,
+                     const std::vector<const molib::Molecule*>& ligands,
+                     std::vector<std::vector<double>>& out,
+                     parallel::ThreadPool& pool) const;
+};
+}
+}
+
+#endif
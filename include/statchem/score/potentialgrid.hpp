@@ -0,0 +1,100 @@
+/* This is potentialgrid.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef POTENTIALGRID_H
+#define POTENTIALGRID_H
+
+#include <cstdint>
+#include <set>
+#include <string>
+#include <vector>
+#include "statchem/geometry/geometry.hpp"
+#include "statchem/molib/atom.hpp"
+
+namespace statchem {
+
+namespace molib {
+class Molecule;
+}
+
+namespace score {
+
+class Score;
+
+/* Precomputed potential maps of a rigid receptor, one per ligand IDATM type.
+ * Each map holds Score::compute_energy sampled on a regular 3D lattice, and
+ * ligand atoms are scored by trilinear interpolation, so scoring a pose costs
+ * O(ligand atoms) instead of O(ligand atoms x receptor neighbors). Points
+ * outside the lattice get zero energy, therefore the box should extend at
+ * least the scoring cutoff beyond the receptor atoms (the constructor taking
+ * receptor atoms does this).
+ *
+ * A saved grid records the settings of the scoring function and a checksum
+ * of the receptor it was computed from, and is only loaded for the same ones.
+ */
+class ReceptorPotentialGrid {
+    geometry::Coordinate __origin;
+    double __spacing;
+    size_t __ni, __nj, __nk;
+    std::vector<int> __types;       // ligand idatm types that have a map
+    std::vector<int> __type_index;  // idatm type -> map number or -1
+    std::vector<double> __values;   // [map][i][j][k]
+    std::string __score_settings;   // Score::get_settings()
+    uint64_t __receptor_checksum;
+
+    size_t __num_points() const { return __ni * __nj * __nk; }
+    size_t __index(const size_t i, const size_t j, const size_t k) const {
+        return (i * __nj + j) * __nk + k;
+    }
+    void __init_types(const std::set<int>& ligand_atom_types);
+    void __compute(const Score& score, const molib::Atom::Grid& gridrec,
+                   const size_t num_threads);
+
+   public:
+    ReceptorPotentialGrid(const Score& score, const molib::Atom::Grid& gridrec,
+                          const geometry::Coordinate& min_crd,
+                          const geometry::Coordinate& max_crd,
+                          const std::set<int>& ligand_atom_types,
+                          const double spacing = 0.375,
+                          const size_t num_threads = 1);
+    ReceptorPotentialGrid(const Score& score,
+                          const molib::Atom::Vec& receptor_atoms,
+                          const std::set<int>& ligand_atom_types,
+                          const double spacing = 0.375,
+                          const size_t num_threads = 1);
+    // Loads a saved grid, throws Error unless it was computed with score for
+    // the receptor in gridrec
+    ReceptorPotentialGrid(const std::string& filename, const Score& score,
+                          const molib::Atom::Grid& gridrec);
+
+    void save(const std::string& filename) const;  // throws Error
+
+    double get_spacing() const { return __spacing; }
+    const geometry::Coordinate& get_origin() const { return __origin; }
+    bool has_type(const int idatm_type) const {
+        return idatm_type >= 0 &&
+               static_cast<size_t>(idatm_type) < __type_index.size() &&
+               __type_index[idatm_type] != -1;
+    }
+
+    double energy(const int idatm_type, const geometry::Coordinate& crd) const;
+    double non_bonded_energy(const molib::Molecule& ligand) const;
+    double non_bonded_energy(const molib::Atom::Vec& atoms,
+                             const geometry::Point::Vec& crds) const;
+};
+}
+}
+
+#endif
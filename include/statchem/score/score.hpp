@@ -15,7 +15,9 @@
 
 #ifndef SCORE_H
 #define SCORE_H
+#include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <exception>
 #include <map>
 #include <set>
@@ -24,6 +26,7 @@
 #include "statchem/helper/array1d.hpp"
 #include "statchem/helper/error.hpp"
 #include "statchem/molib/atom.hpp"
+#include "statchem/parallel/threadpool.hpp"
 
 namespace statchem {
 
@@ -42,7 +45,22 @@ struct AtomicDistributions {
     AtomPairValues values;
     double step_in_file;
     size_t max_distance;
+
+    // The text file is parsed once and stored next to it as a binary cache,
+    // filename + ".bin", which later loads read instead of the text. If the
+    // directory of filename is not writable, the cache goes to the user's
+    // cache directory. The cache is used while it matches the size and
+    // modification time of filename and its checksum is valid.
     AtomicDistributions(const std::string& filename);
+
+   private:
+    void __read_text(const std::string& filename);
+    bool __load_cache(const std::string& cache_file, const uint64_t source_size,
+                      const int64_t source_time);
+    bool __save_cache(const std::string& cache_file, const uint64_t source_size,
+                      const int64_t source_time) const;
+    // Cache of filename in the user's cache directory, empty if there is none
+    static std::string __user_cache_file(const std::string& filename);
 };
 
 class Score {
@@ -50,6 +68,15 @@ class Score {
     AtomPairValues __gij_of_r_numerator;
     AtomPairValues __energies_scoring;  // scoring function
 
+    // Dense copy of __energies_scoring used by the scoring loops. Atom types
+    // are compacted to local indices and pairs are stored in upper-triangular
+    // order, each followed by __num_bins energies.
+    std::vector<int> __type_index;
+    std::vector<double> __energies_table;
+    std::vector<bool> __pair_defined;
+    size_t __num_types;
+    size_t __num_bins;
+
     AtomPairSum __sum_gij_of_r_numerator;
 
     std::vector<double> __gij_of_r_bin_range_sum, __bin_range_sum;
@@ -63,8 +90,8 @@ class Score {
 
     double __step_in_file;
 
-    double __energy_mean(const pair_of_ints&, const double&);
-    double __energy_cumulative(const pair_of_ints&, const double&);
+    double __energy_mean(const pair_of_ints&, const double&) const;
+    double __energy_cumulative(const pair_of_ints&, const double&) const;
 
     int __get_index(const double d) const {
         return (int)floor((d + 0.0000000001) / (double)__step_in_file);
@@ -72,11 +99,38 @@ class Score {
     double __get_lower_bound(const int idx) const {
         return (double)idx * (double)__step_in_file;
     }
+    size_t __get_pair_index_unchecked(const pair_of_ints& atom_pair) const {
+        const size_t i = __type_index[atom_pair.first];
+        const size_t j = __type_index[atom_pair.second];
+        return i * (2 * __num_types - i + 1) / 2 + j - i;
+    }
+    size_t __get_pair_index(const int atom_1, const int atom_2) const {
+        const pair_of_ints atom_pair = std::minmax(atom_1, atom_2);
+        if (__type_index.at(atom_pair.first) < 0 ||
+            __type_index.at(atom_pair.second) < 0) {
+            throw Error("undefined atom_pair in Score");
+        }
+        const size_t pair_idx = __get_pair_index_unchecked(atom_pair);
+        if (!__pair_defined[pair_idx]) {
+            throw Error("undefined atom_pair in Score");
+        }
+        return pair_idx;
+    }
+    const double* __get_energies(const size_t pair_idx) const {
+        return &__energies_table[pair_idx * __num_bins];
+    }
+    void __sum_gij_of_r_bin_ranges();
+    void __compile_energies_table();
+    // Describes everything besides the distributions that determines the
+    // compiled tables, see TableCache
+    std::string __cache_settings() const;
 
    public:
     Score(const std::string& ref_state, const std::string& comp,
           const std::string& rad_or_raw, const double& dist_cutoff)
-        : __total_quantity(0),
+        : __num_types(0),
+          __num_bins(0),
+          __total_quantity(0),
           __eps(0.0000001),
           __ref_state(ref_state),
           __comp(comp),
@@ -90,24 +144,53 @@ class Score {
                              const molib::Atom::Vec& atoms,
                              const geometry::Point::Vec& crds) const;
 
+    // Scores each ligand against the same receptor grid using nthreads
+    // threads that share gridrec read-only. out[i] is the score of ligands[i].
+    void score_batch(const molib::Atom::Grid& gridrec,
+                     const std::vector<const molib::Molecule*>& ligands,
+                     std::vector<double>& out, const size_t nthreads) const;
+    void score_batch(const molib::Atom::Grid& gridrec,
+                     const std::vector<const molib::Molecule*>& ligands,
+                     std::vector<double>& out,
+                     parallel::ThreadPool& pool) const;
+
     Array1d<double> compute_energy(
         const molib::Atom::Grid& gridrec, const geometry::Coordinate& crd,
         const std::set<int>& ligand_atom_types) const;
 
     double get_dist_cutoff() const { return __dist_cutoff; }
 
+    // Describes the settings of the compiled scoring function together with a
+    // checksum of its energies, so that data derived from it can be checked
+    // against it later
+    std::string get_settings() const;
+
     Score& define_composition(const std::set<int>& receptor_idatm_types,
                               const std::set<int>& ligand_idatm_types);
 
     Score& process_distributions(const AtomicDistributions& distributions);
     Score& process_distributions(const std::string& distributions_file);
+    // Reuses the distributions processed by wider, a Score with the same
+    // composition and func but a cutoff at least as large. The result is
+    // the same as processing them again at this Score's cutoff. Throws Error
+    // if wider was loaded from the compiled table cache, which keeps no
+    // distributions.
+    Score& process_distributions(const Score& wider);
     Score& compile_scoring_function();
+    // Same as process_distributions(distributions_file) followed by
+    // compile_scoring_function(), except that the compiled tables are loaded
+    // from the TableCache in cache_dir when present, and stored there
+    // otherwise. An empty cache_dir disables the cache. Loaded tables come
+    // without the distributions, see process_distributions(const Score&).
+    Score& compile_scoring_function(const std::string& distributions_file,
+                                    const std::string& cache_dir);
 
     friend std::ostream& operator<<(std::ostream& stream,
                                     const std::vector<double>& energy);
     friend std::ostream& operator<<(std::ostream& stream,
                                     const AtomPairValues& energies);
     friend std::ostream& operator<<(std::ostream& stream, const Score& score);
+    friend class MultiScore;
 };
 }  // namespace score
 }  // namespace statchem
@@ -0,0 +1,59 @@
+/* This is tablecache.hpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef TABLECACHE_H
+#define TABLECACHE_H
+
+#include <set>
+#include <string>
+#include "statchem/score/score.hpp"
+
+namespace statchem {
+namespace score {
+
+// The result of compiling a scoring (and optionally objective) function
+struct CompiledTables {
+    double step_in_file;
+    AtomPairValues scoring;
+    AtomPairValues objective;
+    std::set<pair_of_ints> unavailable;
+};
+
+// Directory of compiled tables addressed by the contents of the
+// distributions file they were compiled from and a description of the
+// settings used. The description is stored with the tables and compared on
+// load, so a hash collision is a cache miss rather than a wrong result.
+class TableCache {
+    std::string __cache_dir;
+
+   public:
+    explicit TableCache(const std::string& cache_dir)
+        : __cache_dir(cache_dir) {}
+
+    // Name of the tables compiled from distributions_file with settings
+    std::string key(const std::string& distributions_file,
+                    const std::string& settings) const;
+
+    bool load(const std::string& key, const std::string& settings,
+              CompiledTables& tables) const;
+
+    // Failing to write the cache is not an error, it is only logged
+    void save(const std::string& key, const std::string& settings,
+              const CompiledTables& tables) const;
+};
+}
+}
+
+#endif
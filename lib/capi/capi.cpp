@@ -37,6 +37,7 @@ std::unique_ptr<statchem::molib::Atom::Grid> __gridrec;
 std::unique_ptr<statchem::OMMIface::ForceField> __ffield;
 std::unique_ptr<statchem::OMMIface::Modeler> __modeler;
 std::string __error_string = "";
+std::string __cache_dir = "";
 
 const char* cd_get_error() { return __error_string.c_str(); }
 
@@ -450,6 +451,22 @@ size_t ligand_get_neighbors(size_t atom_idx, size_t* neighbors) {
     }
 }
 
+size_t set_scoring_cache(const char* cache_dir) {
+    if (cache_dir == nullptr) {
+        __error_string = std::string("The cache directory must not be null");
+        return 0;
+    }
+
+    try {
+        __cache_dir = cache_dir;
+        return 1;
+    } catch (std::exception& e) {
+        __error_string =
+            std::string("Error in setting the scoring cache: ") + e.what();
+        return 0;
+    }
+}
+
 size_t initialize_scoring(const char* obj_dir) {
     return initialize_scoring_full(obj_dir, "radial", "mean", "complete", 15.0,
                                    0.01, 10.0);
@@ -471,12 +488,9 @@ size_t initialize_scoring_full(const char* obj_dir, const char* ref,
         boost::filesystem::path p(obj_dir);
         p /= "csd_complete_distance_distributions.txt.xz";
 
-        __score
-            ->define_composition(__receptor->get_idatm_types(),
-                                 __ligand->get_idatm_types())
-            .process_distributions(p.string())
-            .compile_scoring_function();
-        __score->compile_objective_function();
+        __score->define_composition(__receptor->get_idatm_types(),
+                                    __ligand->get_idatm_types());
+        __score->compile_objective_function(p.string(), __cache_dir);
 
         return 1;
     } catch (std::exception& e) {
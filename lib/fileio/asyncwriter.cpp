@@ -0,0 +1,110 @@
+/* This is asyncwriter.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/fileio/asyncwriter.hpp"
+#include "statchem/fileio/inout.hpp"
+#include "statchem/helper/error.hpp"
+#include "statchem/helper/logger.hpp"
+
+namespace statchem {
+namespace fileio {
+
+AsyncWriter::AsyncWriter(std::ostream& out, const size_t buffer_size)
+    : __out(&out),
+      __buffer_size(buffer_size),
+      __busy(false),
+      __stop(false),
+      __writer(&AsyncWriter::__run, this) {}
+
+AsyncWriter::AsyncWriter(const std::string& filename, const size_t buffer_size)
+    : __file(open_output_file(filename)),
+      __out(__file.get()),
+      __buffer_size(buffer_size),
+      __busy(false),
+      __stop(false),
+      __writer(&AsyncWriter::__run, this) {}
+
+AsyncWriter::~AsyncWriter() {
+    try {
+        flush();
+    } catch (std::exception& e) {
+        log_error << e.what() << "\n";
+    }
+    {
+        std::lock_guard<std::mutex> lock(__mutex);
+        __stop = true;
+    }
+    __work.notify_one();
+    __writer.join();
+}
+
+void AsyncWriter::__queue_buffer() {
+    __queue.push_back(std::string());
+    __queue.back().swap(__buffer);
+    __work.notify_one();
+}
+
+void AsyncWriter::write(const std::string& text) {
+    std::lock_guard<std::mutex> lock(__mutex);
+    __buffer.append(text);
+    if (__buffer.size() >= __buffer_size) {
+        __queue_buffer();
+    }
+}
+
+void AsyncWriter::flush() {
+    std::unique_lock<std::mutex> lock(__mutex);
+    if (!__buffer.empty()) {
+        __queue_buffer();
+    }
+    __done.wait(lock, [this] { return __queue.empty() && !__busy; });
+    if (__error) {
+        std::exception_ptr error = __error;
+        __error = nullptr;
+        std::rethrow_exception(error);
+    }
+}
+
+void AsyncWriter::__run() {
+    std::unique_lock<std::mutex> lock(__mutex);
+    while (true) {
+        __work.wait(lock, [this] { return __stop || !__queue.empty(); });
+        if (__queue.empty()) {
+            return;
+        }
+
+        std::string text;
+        text.swap(__queue.front());
+        __queue.pop_front();
+        const bool drained = __queue.empty();
+        __busy = true;
+        lock.unlock();
+
+        __out->write(text.data(), text.size());
+        if (drained) {
+            __out->flush();
+        }
+        const bool failed = !*__out;
+
+        lock.lock();
+        __busy = false;
+        if (failed && !__error) {
+            __error = std::make_exception_ptr(Error("Cannot write output"));
+        }
+        __done.notify_all();
+    }
+}
+}
+}
@@ -19,14 +19,11 @@
 
 namespace statchem {
 namespace fileio {
-size_t pdb_num = 0;
-size_t pdb_counter = 0;
-
-void print_complex_pdb(std::ostream& ss, const molib::Molecule& ligand,
-                       const molib::Molecule& receptor, const double energy,
-                       const double potential, const int model,
-                       const size_t max_clq_id, const double rmsd) {
-
+namespace {
+void print_complex_header(std::ostream& ss, const molib::Molecule& ligand,
+                          const molib::Molecule& receptor, const double energy,
+                          const double potential, const int model,
+                          const size_t max_clq_id, const double rmsd) {
     ss << "MODEL    " << model << "\n";
 
     ss << "REMARK   1 MINIMIZED COMPLEX OF " << ligand.name() << " AND "
@@ -45,7 +42,10 @@ void print_complex_pdb(std::ostream& ss, const molib::Molecule& ligand,
         ss << "REMARK   3 DOCKED CONFORMATION HAS AN RMSD OF " << rmsd
            << " FROM ORIGINAL STRUCTURE"
            << "\n";
+}
 
+// returns the last atom number of the receptor
+int print_receptor(std::ostream& ss, const molib::Molecule& receptor) {
     int reenum = 0;
 
     for (auto& patom : receptor.get_atoms()) {
@@ -67,8 +67,12 @@ void print_complex_pdb(std::ostream& ss, const molib::Molecule& ligand,
         }
     }
 
-    ss << "TER   " << std::setw(5) << std::right << ++reenum << "\n";
+    return reenum;
+}
 
+// ligand atoms are renumbered to follow the receptor's
+void print_ligand(std::ostream& ss, const molib::Molecule& ligand,
+                  int reenum) {
     for (auto& patom : ligand.get_atoms()) {
         patom->set_atom_number(++reenum);
         ss << std::setw(66) << std::left << *patom;
@@ -81,70 +85,76 @@ void print_complex_pdb(std::ostream& ss, const molib::Molecule& ligand,
     ss << "ENDMDL"
        << "\n";
 }
+}
+
+void print_complex_pdb(std::ostream& ss, const molib::Molecule& ligand,
+                       const molib::Molecule& receptor, const double energy,
+                       const double potential, const int model,
+                       const size_t max_clq_id, const double rmsd) {
+    print_complex_header(ss, ligand, receptor, energy, potential, model,
+                         max_clq_id, rmsd);
+
+    int reenum = print_receptor(ss, receptor);
+
+    ss << "TER   " << std::setw(5) << std::right << ++reenum << "\n";
 
-void print_complex_pdb_to_file(const molib::Molecule& ligand,
-                           const molib::Molecule& receptor, const double energy,
-                           const double potential, const int model,
-                           const size_t max_clq_id, const double rmsd) {
-
-        std::string file_name = "pdb" + std::to_string(pdb_num++) + ".pdb"; 
-        std::ofstream ss(file_name,std::ofstream::out | std::ofstream::app);
-        ss << "MODEL    " << model << "\n";
-    
-        ss << "REMARK   1 MINIMIZED COMPLEX OF " << ligand.name() << " AND "
-           << receptor.name() << " WITH SCORE OF " << std::setprecision(6) << energy
-           << std::endl;
-    
-        if (!std::isnan(potential))
-            ss << "REMARK   2 POTENTIAL ENERGY OF " << ligand.name() << " IS "
-               << potential << "\n";
-    
-        if (max_clq_id != 0xFFFFFF)
-            ss << "REMARK   3 THIS IS CONFIGUATION " << ligand.name() << " NUMBER "
-               << max_clq_id << "\n";
-    
-        if (!std::isnan(rmsd))
-            ss << "REMARK   3 DOCKED CONFORMATION HAS AN RMSD OF " << rmsd
-               << " FROM ORIGINAL STRUCTURE"
-               << "\n";
-    
+    print_ligand(ss, ligand, reenum);
+}
+
+PoseWriter::PoseWriter(std::ostream& out, const bool receptor_once)
+    : __writer(out), __receptor_once(receptor_once), __receptor_written(false) {
+    __format.copyfmt(out);
+}
+
+PoseWriter::PoseWriter(const std::string& filename, const bool receptor_once)
+    : __writer(filename),
+      __receptor_once(receptor_once),
+      __receptor_written(false) {}
+
+void PoseWriter::write_complex(const molib::Molecule& ligand,
+                               const molib::Molecule& receptor,
+                               const double energy, const double potential,
+                               const int model, const size_t max_clq_id,
+                               const double rmsd) {
+    // formatting flags carry over from one complex to the next as they do
+    // when printing to a single stream
+    std::stringstream ss;
+    {
+        std::lock_guard<std::mutex> lock(__mutex);
+
+        // the receptor must reach the writer before any model
+        if (__receptor_once && !__receptor_written) {
+            std::stringstream rs;
+            rs.copyfmt(__format);
+            rs << "REMARK   1 RECEPTOR " << receptor.name() << "\n";
+            int reenum = print_receptor(rs, receptor);
+            rs << "TER   " << std::setw(5) << std::right << ++reenum << "\n";
+            __writer.write(rs.str());
+            __format.copyfmt(rs);
+            __receptor_written = true;
+        }
+        ss.copyfmt(__format);
+    }
+
+    if (__receptor_once) {
+        // numbered as in print_complex_pdb, after the receptor and TER
         int reenum = 0;
-    
         for (auto& patom : receptor.get_atoms()) {
-            ss << std::setw(66) << std::left << *patom;
             reenum = patom->atom_number();
         }
-    
-        for (auto& presd : receptor.get_residues()) {
-            if (help::standard_residues.count(presd->resn()) != 0) continue;
-    
-            // Print internal bonds
-            for (auto pbond : get_bonds_in(presd->get_atoms())) {
-                ss << pbond->get_pdb_remark();
-            }
-    
-            // Print external bonds
-            for (auto pbond : get_bonds_in(presd->get_atoms(), false)) {
-                ss << pbond->get_pdb_remark();
-            }
-        }
-    
-        ss << "TER"
-           << "\n";
-    
-        for (auto& patom : ligand.get_atoms()) {
-            patom->set_atom_number(++reenum);
-            ss << std::setw(66) << std::left << *patom;
-        }
-    
-        for (auto& pbond : get_bonds_in(ligand.get_atoms())) {
-            ss << pbond->get_pdb_remark();
-        }
-    
-        ss << "ENDMDL"
-           << "\n";
-}
 
+        print_complex_header(ss, ligand, receptor, energy, potential, model,
+                             max_clq_id, rmsd);
+        print_ligand(ss, ligand, reenum + 1);
+    } else {
+        print_complex_pdb(ss, ligand, receptor, energy, potential, model,
+                          max_clq_id, rmsd);
+    }
+
+    std::lock_guard<std::mutex> lock(__mutex);
+    __format.copyfmt(ss);
+    __writer.write(ss.str());
+}
 
 }  // namespace fileio
 }  // namespace statchem
@@ -0,0 +1,195 @@
+/* This is dcdwriter.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/fileio/dcdwriter.hpp"
+#include "statchem/fileio/inout.hpp"
+#include "statchem/helper/error.hpp"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+
+namespace statchem {
+namespace fileio {
+
+namespace {
+// sizes of the header records, each with its two 4 byte markers
+const std::streamoff control_record = 4 + 84 + 4;
+const std::streamoff title_record = 4 + 4 + 80 + 4;
+const std::streamoff atoms_record = 4 + 4 + 4;
+const std::streamoff header_size = control_record + title_record + atoms_record;
+
+// AKMA time unit in picoseconds, the unit of the time step in the header
+const double akma_time = 0.04888821;
+}
+
+DcdWriter::DcdWriter(const std::string& filename, const size_t num_atoms,
+                     const int32_t steps_per_frame, const double time_step,
+                     const bool append)
+    : __filename(filename),
+      __num_atoms(num_atoms),
+      __first_step(steps_per_frame),
+      __steps_per_frame(steps_per_frame),
+      __num_frames(0),
+      __buffer(num_atoms) {
+    if (append && file_size(filename) > 0) {
+        __file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
+        if (!__file.is_open()) {
+            throw Error("Cannot open output file: " + filename);
+        }
+        __read_header(filename);
+        // drops a frame left incomplete by an interrupted run
+        __file.seekp(__end_of_frames());
+    } else {
+        __file.open(filename,
+                    std::ios::out | std::ios::trunc | std::ios::binary);
+        if (!__file.is_open()) {
+            throw Error("Cannot open output file: " + filename);
+        }
+        __write_header(time_step);
+    }
+}
+
+void DcdWriter::__write_record(const void* data, const int32_t size) {
+    __file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    __file.write(reinterpret_cast<const char*>(data), size);
+    __file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+}
+
+void DcdWriter::__write_header(const double time_step) {
+    char control[84] = {};
+    int32_t icntrl[20] = {};
+    icntrl[0] = 0;  // number of frames
+    icntrl[1] = __first_step;
+    icntrl[2] = __steps_per_frame;
+    icntrl[3] = 0;  // last step
+    const float delta = time_step / akma_time;
+    std::memcpy(&icntrl[9], &delta, sizeof(delta));
+    icntrl[19] = 24;  // mimics CHARMM version 24
+    std::memcpy(control, "CORD", 4);
+    std::memcpy(control + 4, icntrl, sizeof(icntrl));
+    __write_record(control, sizeof(control));
+
+    char title[4 + 80];
+    const int32_t num_titles = 1;
+    std::memcpy(title, &num_titles, sizeof(num_titles));
+    std::memset(title + 4, ' ', 80);
+    const std::string text = "REMARKS Created by StatChemLIB";
+    std::memcpy(title + 4, text.data(), text.size());
+    __write_record(title, sizeof(title));
+
+    const int32_t num_atoms = __num_atoms;
+    __write_record(&num_atoms, sizeof(num_atoms));
+
+    if (!__file) {
+        throw Error("Cannot write DCD header");
+    }
+}
+
+void DcdWriter::__read_header(const std::string& filename) {
+    char header[header_size];
+    __file.read(header, header_size);
+
+    int32_t icntrl[20], num_atoms;
+    std::memcpy(icntrl, header + 8, sizeof(icntrl));
+    std::memcpy(&num_atoms, header + control_record + title_record + 4,
+                sizeof(num_atoms));
+
+    if (!__file || std::memcmp(header + 4, "CORD", 4) != 0) {
+        throw Error(filename + " is not a DCD trajectory");
+    } else if (num_atoms < 0 ||
+               static_cast<size_t>(num_atoms) != __num_atoms) {
+        throw Error(filename + " holds " + std::to_string(num_atoms) +
+                    " atoms instead of " + std::to_string(__num_atoms));
+    } else if (icntrl[2] != __steps_per_frame) {
+        throw Error(filename + " has frames every " +
+                    std::to_string(icntrl[2]) + " steps instead of " +
+                    std::to_string(__steps_per_frame));
+    }
+
+    __num_frames = icntrl[0];
+    __first_step = icntrl[1];
+}
+
+std::streamoff DcdWriter::__end_of_frames() const {
+    const std::streamoff frame_size = 3 * (4 + 4 * __num_atoms + 4);
+    return header_size + __num_frames * frame_size;
+}
+
+void DcdWriter::write_frame(const geometry::Point::Vec& crds) {
+    write_frame(crds, geometry::Point::Vec());
+}
+
+void DcdWriter::write_frame(const geometry::Point::Vec& receptor,
+                            const geometry::Point::Vec& ligand) {
+    if (receptor.size() + ligand.size() != __num_atoms) {
+        throw Error("Frame of " +
+                    std::to_string(receptor.size() + ligand.size()) +
+                    " atoms written to a trajectory of " +
+                    std::to_string(__num_atoms));
+    }
+
+    typedef double (geometry::Point::*Component)() const;
+    const Component components[] = {&geometry::Point::x, &geometry::Point::y,
+                                     &geometry::Point::z};
+
+    for (auto component : components) {
+        auto out = __buffer.begin();
+        for (auto& crd : receptor) *out++ = (crd.*component)();
+        for (auto& crd : ligand) *out++ = (crd.*component)();
+        __write_record(__buffer.data(), 4 * __num_atoms);
+    }
+
+    // the header counts the frame only once all of it is written
+    ++__num_frames;
+    __update_header();
+
+    if (!__file) {
+        throw Error("Cannot write DCD frame");
+    }
+}
+
+void DcdWriter::__update_header() {
+    const int32_t last_step =
+        __first_step + (__num_frames - 1) * __steps_per_frame;
+    __file.seekp(8);
+    __file.write(reinterpret_cast<const char*>(&__num_frames), 4);
+    __file.seekp(20);
+    __file.write(reinterpret_cast<const char*>(&last_step), 4);
+    __file.seekp(__end_of_frames());
+    __file.flush();
+}
+
+void DcdWriter::truncate(const size_t num_frames) {
+    if (num_frames > static_cast<size_t>(__num_frames)) {
+        throw Error(__filename + " holds " + std::to_string(__num_frames) +
+                    " frames, cannot keep " + std::to_string(num_frames));
+    }
+
+    __num_frames = num_frames;
+    __update_header();
+    __file.close();
+
+    boost::system::error_code ec;
+    boost::filesystem::resize_file(__filename, __end_of_frames(), ec);
+
+    __file.open(__filename, std::ios::in | std::ios::out | std::ios::binary);
+    __file.seekp(__end_of_frames());
+
+    if (ec || !__file) {
+        throw Error("Cannot truncate DCD trajectory " + __filename);
+    }
+}
+}
+}
@@ -80,6 +80,10 @@ void __unlock(int fd) {
 }
 #endif
 
+bool __is_xz(const string& name) {
+    return name.size() >= 2 && name.compare(name.size() - 2, 2, "xz") == 0;
+}
+
 size_t file_size(const string& name) {
     if (boost::filesystem::exists(name) &&
         boost::filesystem::is_regular_file(name)) {
@@ -110,10 +114,16 @@ void read_file(const string& name, string& s, streampos& pos_in_file,
 void read_file(const string& name, vector<string>& s, streampos& pos_in_file,
                f_not_found w, const int num_occur, const string& pattern) {
     dbgmsg(pos_in_file);
-    if(name.substr( name.length() - 2 ) == "xz") {
-        auto ss = read_xzfile(name);
-        auto sss = std::stringstream(ss);
-        read_stream(sss, s, pos_in_file, num_occur, pattern);
+    if (__is_xz(name)) {
+        XzIfstream in(name);
+        if (!in.is_open() && w == panic) {
+            throw Error("Cannot read " + name);
+        }
+        read_stream(in, s, pos_in_file, num_occur, pattern);
+        if (in.bad()) {
+            throw Error("Problem with decompressing " + name);
+        }
+        return;
     }
 #ifndef _MSC_VER
     int fd = __lock(name);
@@ -134,6 +144,45 @@ void read_file(const string& name, vector<string>& s, streampos& pos_in_file,
 #endif
 }
 
+std::unique_ptr<std::istream> open_input_file(const string& name) {
+    std::unique_ptr<std::istream> in;
+    if (__is_xz(name)) {
+        std::unique_ptr<XzIfstream> xz(new XzIfstream(name));
+        if (!xz->is_open()) {
+            throw Error("Cannot read " + name);
+        }
+        in = std::move(xz);
+    } else {
+        std::unique_ptr<ifstream> file(new ifstream(name, ios::in));
+        if (!file->is_open()) {
+            throw Error("Cannot read " + name);
+        }
+        in = std::move(file);
+    }
+    return in;
+}
+
+std::unique_ptr<std::ostream> open_output_file(const string& name,
+                                               const size_t threads,
+                                               ios_base::openmode mode) {
+    __mkdir(name);
+    std::unique_ptr<std::ostream> out;
+    if (__is_xz(name)) {
+        std::unique_ptr<XzOfstream> xz(new XzOfstream(name, threads, mode));
+        if (!xz->is_open()) {
+            throw Error("Cannot open output file: " + name);
+        }
+        out = std::move(xz);
+    } else {
+        std::unique_ptr<ofstream> file(new ofstream(name, mode));
+        if (!file->is_open()) {
+            throw Error("Cannot open output file: " + name);
+        }
+        out = std::move(file);
+    }
+    return out;
+}
+
 void read_stream(std::istream& in, vector<string>& s, streampos& pos_in_file,
                  const int num_occur, const string& pattern) {
     in.seekg(pos_in_file);
@@ -180,6 +229,26 @@ void file_open_put_contents(const string& name, const vector<string>& v,
 void file_open_put_stream(const string& name, const stringstream& ss,
                           ios_base::openmode mode) {
     __mkdir(name);
+    if (__is_xz(name)) {
+#ifndef _MSC_VER
+        int fd = __lock(name);
+#endif
+        XzOfstream output_file(name, 1, mode);
+        const bool opened = output_file.is_open();
+        if (opened) {
+            output_file << ss.str();
+            output_file.close();
+        }
+#ifndef _MSC_VER
+        __unlock(fd);
+#endif
+        if (!opened) {
+            throw Error("Cannot open output file: " + name);
+        } else if (output_file.bad()) {
+            throw Error("Problem with compressing " + name);
+        }
+        return;
+    }
 #ifndef _MSC_VER
     int fd = __lock(name);
     ofstream output_file(name, mode);
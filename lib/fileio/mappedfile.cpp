@@ -0,0 +1,95 @@
+/* This is mappedfile.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/fileio/mappedfile.hpp"
+
+#ifndef _MSC_VER
+
+#include <fcntl.h>    /* for open(2) */
+#include <sys/mman.h> /* for mmap(2) */
+#include <sys/stat.h> /* for fstat(2) */
+#include <unistd.h>   /* for close(2) */
+
+#else
+
+#include <fstream>
+#include <sstream>
+
+#endif
+
+#include "statchem/helper/error.hpp"
+
+namespace statchem {
+namespace fileio {
+
+#ifndef _MSC_VER
+
+MappedFile::MappedFile(const std::string& filename)
+    : __data(nullptr), __size(0), __map(nullptr) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd == -1) {
+        throw Error("die : cannot open " + filename);
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        throw Error("die : cannot stat " + filename);
+    }
+
+    __size = static_cast<size_t>(st.st_size);
+
+    if (__size > 0) {
+        void* map = mmap(nullptr, __size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            close(fd);
+            throw Error("die : cannot map " + filename);
+        }
+        // the file is read front to back exactly once
+        madvise(map, __size, MADV_SEQUENTIAL);
+        __map = map;
+        __data = static_cast<const char*>(map);
+    }
+
+    close(fd);  // the mapping stays valid
+}
+
+MappedFile::~MappedFile() {
+    if (__map != nullptr) {
+        munmap(__map, __size);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+    : __data(nullptr), __size(0), __map(nullptr) {
+    std::ifstream in(filename, std::ios::in | std::ios::binary);
+    if (!in.is_open()) {
+        throw Error("die : cannot open " + filename);
+    }
+
+    std::stringstream ss;
+    ss << in.rdbuf();
+    __buffer = ss.str();
+    __data = __buffer.data();
+    __size = __buffer.size();
+}
+
+MappedFile::~MappedFile() {}
+
+#endif
+}
+}
@@ -0,0 +1,334 @@
+/* This is moleculestore.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/fileio/moleculestore.hpp"
+#include "statchem/helper/error.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <string>
+
+using namespace std;
+using namespace statchem::molib;
+
+namespace statchem {
+namespace fileio {
+
+namespace {
+const char magic[8] = {'S', 'T', 'C', 'H', 'M', 'O', 'L', 'S'};
+const uint32_t version = 1;
+const uint32_t byte_order = 0x01020304;
+
+class Encoder {
+    string& __out;
+
+   public:
+    explicit Encoder(string& out) : __out(out) {}
+
+    template <class T>
+    void put(const T value) {
+        __out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    void put(const string& s) {
+        put<uint32_t>(s.size());
+        __out.append(s);
+    }
+    void put(const geometry::Coordinate& crd) {
+        put(crd.x());
+        put(crd.y());
+        put(crd.z());
+    }
+};
+
+class Decoder {
+    const char* __pos;
+    const char* const __end;
+
+    void __need(const size_t size) {
+        if (static_cast<size_t>(__end - __pos) < size) {
+            throw Error("die : molecule record of the store is truncated");
+        }
+    }
+
+   public:
+    Decoder(const char* begin, const char* end) : __pos(begin), __end(end) {}
+
+    template <class T>
+    T get() {
+        __need(sizeof(T));
+        T value;
+        memcpy(&value, __pos, sizeof(T));
+        __pos += sizeof(T);
+        return value;
+    }
+    string get_string() {
+        const uint32_t size = get<uint32_t>();
+        __need(size);
+        string s(__pos, size);
+        __pos += size;
+        return s;
+    }
+    geometry::Coordinate get_crd() {
+        const double x = get<double>();
+        const double y = get<double>();
+        const double z = get<double>();
+        return geometry::Coordinate(x, y, z);
+    }
+};
+
+void encode_atom(Encoder& enc, const Atom& atom) {
+    enc.put<int32_t>(atom.atom_number());
+    enc.put(atom.atom_name());
+    enc.put(atom.crd());
+    enc.put<int32_t>(atom.idatm_type());
+    enc.put(atom.sybyl_type());
+    enc.put(atom.gaff_type());
+    enc.put<int32_t>(atom.element().number());
+    enc.put(atom.smiles_label());
+    enc.put<uint32_t>(atom.get_smiles_prop().size());
+    for (auto& kv : atom.get_smiles_prop()) {
+        enc.put(kv.first);
+        enc.put<int32_t>(kv.second);
+    }
+    enc.put<uint32_t>(atom.get_aps().size());
+    for (auto& kv : atom.get_aps()) {
+        enc.put<int32_t>(kv.first);
+        enc.put<int32_t>(kv.second);
+    }
+}
+
+Atom* decode_atom(Decoder& dec) {
+    const int atom_number = dec.get<int32_t>();
+    const string atom_name = dec.get_string();
+    const geometry::Coordinate crd = dec.get_crd();
+    const int idatm_type = dec.get<int32_t>();
+    const string sybyl_type = dec.get_string();
+    const string gaff_type = dec.get_string();
+    const Element element(dec.get<int32_t>());
+
+    unique_ptr<Atom> atom(new Atom(atom_number, atom_name, crd, idatm_type,
+                                   element.name(), sybyl_type));
+    atom->set_element(element);
+    atom->set_gaff_type(gaff_type);
+    atom->set_smiles_label(dec.get_string());
+
+    for (uint32_t n = dec.get<uint32_t>(); n != 0; --n) {
+        const string prop = dec.get_string();
+        atom->insert_property(prop, dec.get<int32_t>());
+    }
+
+    map<int, int> aps;
+    for (uint32_t n = dec.get<uint32_t>(); n != 0; --n) {
+        const int key = dec.get<int32_t>();
+        aps[key] = dec.get<int32_t>();
+    }
+    atom->set_aps(aps);
+
+    return atom.release();
+}
+
+// bonds are stored by the indices of their atoms in the model, after the
+// neighbours of each atom in their original order
+void encode_bonds(Encoder& enc, const Model& model) {
+    const Atom::Vec atoms = model.get_atoms();
+    map<const Atom*, uint32_t> index;
+    for (auto& patom : atoms) index.insert({patom, index.size()});
+
+    for (auto& patom : atoms) {
+        uint32_t num_neighbours = 0;
+        for (auto& neighbour : *patom) {
+            num_neighbours += index.count(&neighbour);
+        }
+        enc.put(num_neighbours);
+        for (auto& neighbour : *patom) {
+            if (index.count(&neighbour)) enc.put(index.at(&neighbour));
+        }
+    }
+
+    const BondSet bonds = get_bonds_in(atoms);
+    enc.put<uint32_t>(bonds.size());
+    for (auto& pbond : bonds) {
+        enc.put(index.at(&pbond->atom1()));
+        enc.put(index.at(&pbond->atom2()));
+        enc.put<int32_t>(pbond->idx1());
+        enc.put<int32_t>(pbond->idx2());
+        enc.put(pbond->get_rotatable());
+        enc.put(pbond->get_bond_gaff_type());
+        enc.put(pbond->stereo());
+        enc.put<int32_t>(pbond->get_bo());
+        enc.put<uint8_t>(pbond->is_ring());
+        enc.put<uint32_t>(pbond->get_angles().size());
+        for (auto angle : pbond->get_angles()) enc.put<int32_t>(angle);
+        enc.put<int32_t>(pbond->get_drive_id());
+    }
+}
+
+void decode_bonds(Decoder& dec, Model& model) {
+    const Atom::Vec atoms = model.get_atoms();
+    auto atom = [&](const uint32_t i) -> Atom& {
+        if (i >= atoms.size()) {
+            throw Error("die : bond to a missing atom in the store");
+        }
+        return *atoms[i];
+    };
+
+    for (auto& patom : atoms) {
+        for (uint32_t n = dec.get<uint32_t>(); n != 0; --n) {
+            patom->add(&atom(dec.get<uint32_t>()));
+        }
+    }
+
+    for (uint32_t n = dec.get<uint32_t>(); n != 0; --n) {
+        Atom& atom1 = atom(dec.get<uint32_t>());
+        Atom& atom2 = atom(dec.get<uint32_t>());
+        const int idx1 = dec.get<int32_t>();
+        const int idx2 = dec.get<int32_t>();
+
+        shared_ptr<Bond> bond(new Bond(&atom1, &atom2, idx1, idx2));
+        bond->set_rotatable(dec.get_string());
+        bond->set_bond_gaff_type(dec.get_string());
+        bond->set_stereo(dec.get_string());
+        bond->set_bo(dec.get<int32_t>());
+        bond->set_ring(dec.get<uint8_t>() != 0);
+        for (uint32_t m = dec.get<uint32_t>(); m != 0; --m) {
+            bond->set_angle(dec.get<int32_t>());
+        }
+        bond->set_drive_id(dec.get<int32_t>());
+
+        atom1.insert_bond(atom2, bond);
+        atom2.insert_bond(atom1, bond);
+    }
+
+    connect_bonds(get_bonds_in(atoms));
+}
+}
+
+void write_molecule_store_header(std::ostream& out) {
+    out.write(magic, sizeof(magic));
+    out.write(reinterpret_cast<const char*>(&version), sizeof(version));
+    out.write(reinterpret_cast<const char*>(&byte_order), sizeof(byte_order));
+}
+
+void write_molecule(std::ostream& out, const Molecule& molecule) {
+    string record;
+    Encoder enc(record);
+
+    enc.put(molecule.name());
+    enc.put<uint32_t>(molecule.size());
+    for (auto& assembly : molecule) {
+        enc.put<int32_t>(assembly.number());
+        enc.put(assembly.name());
+        enc.put<uint32_t>(assembly.size());
+        for (auto& model : assembly) {
+            enc.put<int32_t>(model.number());
+            enc.put<uint32_t>(model.size());
+            for (auto& chain : model) {
+                enc.put(chain.chain_id());
+                enc.put(chain.crd());
+                enc.put<uint32_t>(chain.size());
+                for (auto& residue : chain) {
+                    enc.put(residue.resn());
+                    enc.put<int32_t>(residue.resi());
+                    enc.put(residue.ins_code());
+                    enc.put<int32_t>(residue.rest());
+                    enc.put(residue.crd());
+                    enc.put<uint32_t>(residue.size());
+                    for (auto& atom : residue) encode_atom(enc, atom);
+                }
+            }
+            encode_bonds(enc, model);
+        }
+    }
+
+    const uint64_t size = record.size();
+    out.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    out.write(record.data(), record.size());
+}
+
+void read_molecule_store_header(std::istream& in) {
+    char header[sizeof(magic) + sizeof(version) + sizeof(byte_order)];
+    in.read(header, sizeof(header));
+
+    uint32_t file_version, file_byte_order;
+    memcpy(&file_version, header + sizeof(magic), sizeof(file_version));
+    memcpy(&file_byte_order, header + sizeof(magic) + sizeof(version),
+           sizeof(file_byte_order));
+
+    if (!in || memcmp(header, magic, sizeof(magic)) != 0) {
+        throw Error("die : not a molecule store");
+    } else if (file_byte_order != byte_order) {
+        throw Error("die : molecule store written with another byte order");
+    } else if (file_version != version) {
+        throw Error("die : molecule store version " +
+                    to_string(file_version) + " is not supported");
+    }
+}
+
+bool read_molecule(std::istream& in, Molecules& mols) {
+    uint64_t size;
+    if (!in.read(reinterpret_cast<char*>(&size), sizeof(size))) {
+        if (in.gcount() != 0) {
+            throw Error("die : molecule record of the store is truncated");
+        }
+        return false;
+    }
+
+    // grown as the data arrives, so that a corrupt size fails as a truncated
+    // record instead of allocating more than the file holds
+    const uint64_t chunk_size = 1 << 20;
+    string record;
+    while (record.size() < size) {
+        const size_t read = record.size();
+        record.resize(read + std::min<uint64_t>(chunk_size, size - read));
+        if (!in.read(&record[read], record.size() - read)) {
+            throw Error("die : molecule record of the store is truncated");
+        }
+    }
+    Decoder dec(record.data(), record.data() + record.size());
+
+    unique_ptr<Molecule> molecule(new Molecule(dec.get_string()));
+    for (uint32_t a = dec.get<uint32_t>(); a != 0; --a) {
+        const int number = dec.get<int32_t>();
+        Assembly& assembly =
+            molecule->add(new Assembly(number, dec.get_string()));
+        for (uint32_t m = dec.get<uint32_t>(); m != 0; --m) {
+            Model& model = assembly.add(new Model(dec.get<int32_t>()));
+            for (uint32_t c = dec.get<uint32_t>(); c != 0; --c) {
+                Chain& chain = model.add(new Chain(dec.get<char>()));
+                chain.crd() = dec.get_crd();
+                for (uint32_t r = dec.get<uint32_t>(); r != 0; --r) {
+                    const string resn = dec.get_string();
+                    const int resi = dec.get<int32_t>();
+                    const char ins_code = dec.get<char>();
+                    const auto rest =
+                        static_cast<Residue::res_type>(dec.get<int32_t>());
+                    Residue& residue =
+                        chain.add(new Residue(resn, resi, ins_code, rest));
+                    residue.crd() = dec.get_crd();
+                    for (uint32_t n = dec.get<uint32_t>(); n != 0; --n) {
+                        residue.add(decode_atom(dec));
+                    }
+                }
+            }
+            decode_bonds(dec, model);
+        }
+    }
+
+    mols.add(molecule.release());
+    return true;
+}
+}
+}
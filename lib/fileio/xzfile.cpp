@@ -18,65 +18,270 @@
 
 #include <lzma.h>
 #include <fstream>
-#include <vector>
+#include <iterator>
 
 namespace statchem {
 namespace fileio {
 
-std::string read_xzfile(const std::string& filename) {
-    
-    std::ifstream checking(filename, std::ifstream::binary);
-    std::vector<char> src((std::istreambuf_iterator<char>(checking)),
-                           std::istreambuf_iterator<char>());
-    
-    std::vector<char> dst(src.size());
+struct XzStreamBuf::Decoder {
+    std::ifstream file;
+    std::vector<char> in;
+    lzma_stream strm;
+    bool finished;
+
+    Decoder(const std::string& filename, const size_t chunk_size)
+        : file(filename, std::ifstream::binary),
+          in(chunk_size),
+          strm(LZMA_STREAM_INIT),
+          finished(false) {
+        init();
+    }
+    ~Decoder() { lzma_end(&strm); }
+
+    void init() {
+        // appended output is a series of .xz streams
+        if (lzma_stream_decoder(&strm, UINT64_MAX, LZMA_CONCATENATED) !=
+            LZMA_OK) {
+            throw Error("Problem with Initializing LZMA");
+        }
+        strm.next_in = nullptr;
+        strm.avail_in = 0;
+        finished = false;
+    }
+
+    // decodes into out until it holds some data or the stream has ended,
+    // returns the number of bytes written
+    size_t decode(char* out, const size_t size) {
+        strm.next_out = reinterpret_cast<uint8_t*>(out);
+        strm.avail_out = size;
+
+        while (strm.avail_out == size && !finished) {
+            lzma_action action = LZMA_RUN;
+
+            if (strm.avail_in == 0) {
+                file.read(in.data(), in.size());
+                strm.next_in = reinterpret_cast<const uint8_t*>(in.data());
+                strm.avail_in = static_cast<size_t>(file.gcount());
+                if (file.eof()) action = LZMA_FINISH;
+            } else if (file.eof()) {
+                action = LZMA_FINISH;
+            }
+
+            const lzma_ret status = lzma_code(&strm, action);
+
+            if (status == LZMA_STREAM_END) {
+                finished = true;
+            } else if (status != LZMA_OK) {
+                throw Error("Problem with decompressing LZMA");
+            }
+        }
+
+        return size - strm.avail_out;
+    }
+};
+
+XzStreamBuf::XzStreamBuf(const std::string& filename, const size_t chunk_size)
+    : __decoder(new Decoder(filename, chunk_size)),
+      __out(chunk_size),
+      __out_start(0) {
+    setg(__out.data(), __out.data(), __out.data());
+}
+
+XzStreamBuf::~XzStreamBuf() {}
+
+bool XzStreamBuf::is_open() const { return __decoder->file.is_open(); }
+
+void XzStreamBuf::__restart() {
+    lzma_end(&__decoder->strm);
+    __decoder->strm = LZMA_STREAM_INIT;
+    __decoder->init();
+    __decoder->file.clear();
+    __decoder->file.seekg(0);
+    __out_start = 0;
+    setg(__out.data(), __out.data(), __out.data());
+}
+
+XzStreamBuf::int_type XzStreamBuf::underflow() {
+    if (gptr() < egptr()) {
+        return traits_type::to_int_type(*gptr());
+    }
+
+    if (!is_open()) {
+        return traits_type::eof();
+    }
+
+    __out_start += egptr() - eback();
+    const size_t n = __decoder->decode(__out.data(), __out.size());
+    setg(__out.data(), __out.data(), __out.data() + n);
+
+    return n == 0 ? traits_type::eof() : traits_type::to_int_type(*gptr());
+}
+
+XzStreamBuf::pos_type XzStreamBuf::seekoff(off_type off,
+                                           std::ios_base::seekdir dir,
+                                           std::ios_base::openmode which) {
+    if (dir == std::ios_base::cur) {
+        return seekpos(__out_start + (gptr() - eback()) + off, which);
+    } else if (dir == std::ios_base::beg) {
+        return seekpos(off, which);
+    }
+
+    return pos_type(off_type(-1));  // the uncompressed size is unknown
+}
 
-    size_t dataLength = src.size();
-    size_t expdLength = dataLength * 5;
+XzStreamBuf::pos_type XzStreamBuf::seekpos(pos_type pos,
+                                           std::ios_base::openmode which) {
+    const std::streamoff target = pos;
 
-    bool done = false;
+    if (!(which & std::ios_base::in) || target < 0 || !is_open()) {
+        return pos_type(off_type(-1));
+    }
+
+    if (target < __out_start) {
+        __restart();
+    }
+
+    while (target > __out_start + (egptr() - eback())) {
+        setg(eback(), egptr(), egptr());
+        if (traits_type::eq_int_type(underflow(), traits_type::eof())) {
+            return pos_type(off_type(-1));
+        }
+    }
 
-    lzma_stream strm = LZMA_STREAM_INIT;
-    strm.next_in = reinterpret_cast<unsigned char*>(src.data());
-    strm.avail_in = dataLength;
-    strm.total_out = 0;
+    setg(eback(), eback() + (target - __out_start), egptr());
+    return pos;
+}
 
-    lzma_ret status = lzma_stream_decoder(&strm, UINT64_MAX, 0);
+struct XzOStreamBuf::Encoder {
+    std::ofstream file;
+    std::vector<char> out;
+    lzma_stream strm;
+    bool finished;
 
-    if (status != LZMA_OK) {
-	    throw Error("Problem with Initializing LZMA");
+    Encoder(const std::string& filename, const size_t threads,
+            std::ios_base::openmode mode, const uint32_t preset,
+            const size_t chunk_size)
+        : file(filename, mode | std::ios_base::binary),
+          out(chunk_size),
+          strm(LZMA_STREAM_INIT),
+          finished(false) {
+        lzma_ret status;
+        if (threads > 1) {
+            lzma_mt mt = {};
+            mt.threads = threads;
+            mt.preset = preset;
+            mt.check = LZMA_CHECK_CRC64;
+            status = lzma_stream_encoder_mt(&strm, &mt);
+        } else {
+            status = lzma_easy_encoder(&strm, preset, LZMA_CHECK_CRC64);
+        }
+        if (status != LZMA_OK) {
+            throw Error("Problem with Initializing LZMA");
+        }
+        strm.next_out = reinterpret_cast<uint8_t*>(out.data());
+        strm.avail_out = out.size();
     }
+    ~Encoder() { lzma_end(&strm); }
 
-    lzma_action action = LZMA_RUN;
+    void write_out() {
+        file.write(out.data(), out.size() - strm.avail_out);
+        strm.next_out = reinterpret_cast<uint8_t*>(out.data());
+        strm.avail_out = out.size();
+    }
 
-    do {
+    // encodes all of data, with finish also the end of the stream
+    bool encode(const char* data, const size_t size, const bool finish) {
+        if (size == 0 && !finish) {
+            return static_cast<bool>(file);
+        }
 
-	    // extend decompressed if too short
-	    if (strm.total_out >= dst.size()) {
-		    dst.resize(dst.size() + expdLength);
-	    }
+        strm.next_in = reinterpret_cast<const uint8_t*>(data);
+        strm.avail_in = size;
 
-	    strm.next_out = reinterpret_cast<unsigned char*>(dst.data() + strm.total_out);
-    	strm.avail_out = dst.size() - strm.total_out;
+        while (true) {
+            const lzma_ret status =
+                lzma_code(&strm, finish ? LZMA_FINISH : LZMA_RUN);
 
-        status = lzma_code(&strm, action);
+            if (strm.avail_out == 0 || status == LZMA_STREAM_END) {
+                write_out();
+            }
 
-        if (status == LZMA_STREAM_END) {
-		    done = true;
-        } else if (status != LZMA_OK) {
-		    lzma_end(&strm);
-            throw Error("Problem with decompressing LZMA");
-	    }
-    } while(!done);
+            if (status == LZMA_STREAM_END) {
+                finished = true;
+                return static_cast<bool>(file.flush());
+            } else if (status != LZMA_OK) {
+                return false;
+            } else if (!finish && strm.avail_in == 0) {
+                return static_cast<bool>(file);
+            }
+        }
+    }
+};
 
-    lzma_end (&strm);
+XzOStreamBuf::XzOStreamBuf(const std::string& filename, const size_t threads,
+                           std::ios_base::openmode mode, const uint32_t preset,
+                           const size_t chunk_size)
+    : __encoder(new Encoder(filename, threads, mode, preset, chunk_size)),
+      __in(chunk_size) {
+    setp(__in.data(), __in.data() + __in.size());
+}
+
+XzOStreamBuf::~XzOStreamBuf() { close(); }
 
-    // set actual length, shrinking the vector is
-    // very efficient in C++11!
-    dst.resize(strm.total_out);
+bool XzOStreamBuf::is_open() const { return __encoder->file.is_open(); }
+
+bool XzOStreamBuf::__encode(const bool finish) {
+    if (!is_open() || __encoder->finished) {
+        return false;
+    }
 
-    return std::string(dst.data(), dst.size());
+    const bool ok = __encoder->encode(pbase(), pptr() - pbase(), finish);
+    setp(__in.data(), __in.data() + __in.size());
+    return ok;
 }
 
+XzOStreamBuf::int_type XzOStreamBuf::overflow(int_type c) {
+    if (!__encode(false)) {
+        return traits_type::eof();
+    }
+
+    if (!traits_type::eq_int_type(c, traits_type::eof())) {
+        *pptr() = traits_type::to_char_type(c);
+        pbump(1);
+    }
+
+    return traits_type::not_eof(c);
+}
+
+int XzOStreamBuf::sync() {
+    // compressed data still held by the encoder only reaches the file with
+    // the following blocks or at close()
+    if (!__encode(false) || !__encoder->file.flush()) {
+        return -1;
+    }
+    return 0;
+}
+
+bool XzOStreamBuf::close() {
+    if (__encoder->finished) {
+        return true;
+    } else if (!is_open()) {
+        return false;
+    }
+
+    const bool ok = __encode(true);
+    __encoder->file.close();
+    return ok;
+}
+
+std::string read_xzfile(const std::string& filename) {
+    XzIfstream in(filename);
+    if (!in.is_open()) {
+        throw Error("Cannot read " + filename);
+    }
+
+    return std::string(std::istreambuf_iterator<char>(in),
+                       std::istreambuf_iterator<char>());
+}
 }
 }
@@ -0,0 +1,231 @@
+/* This is checkpointwriter.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/modeler/checkpointwriter.hpp"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include "statchem/helper/debug.hpp"
+#include "statchem/helper/error.hpp"
+#include "statchem/helper/logger.hpp"
+
+#ifndef _MSC_VER
+
+#include <fcntl.h>  /* for open(2) */
+#include <unistd.h> /* for fsync(2), close(2) */
+
+#else
+
+#include <io.h> /* for _commit */
+
+#endif
+
+namespace statchem {
+namespace OMMIface {
+
+namespace {
+// A checkpoint file is the magic, the size of the progress, the progress,
+// the size of the state and the state
+const char checkpoint_magic[8] = {'S', 'T', 'C', 'H', 'C', 'H', 'K', '1'};
+
+void put_size(std::string& out, const uint64_t size) {
+    out.append(reinterpret_cast<const char*>(&size), sizeof(size));
+}
+
+bool get_size(const std::string& in, size_t& pos, uint64_t& size) {
+    if (in.size() - pos < sizeof(size)) return false;
+    in.copy(reinterpret_cast<char*>(&size), sizeof(size), pos);
+    pos += sizeof(size);
+    return true;
+}
+
+// Flushes the file down to the disk, so that it cannot be renamed before
+// its contents are written
+bool sync_file(std::FILE* file) {
+    if (std::fflush(file) != 0) return false;
+#ifndef _MSC_VER
+    return fsync(fileno(file)) == 0;
+#else
+    return _commit(_fileno(file)) == 0;
+#endif
+}
+
+// Makes a rename in the directory durable
+void sync_directory(const std::string& filename) {
+#ifndef _MSC_VER
+    std::string dir = boost::filesystem::path(filename).parent_path().string();
+    const int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY);
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+#endif
+}
+}
+
+CheckpointWriter::CheckpointWriter()
+    : __has_pending(false),
+      __busy(false),
+      __stop(false),
+      __num_written(0),
+      __num_skipped(0),
+      __writer(&CheckpointWriter::__run, this) {}
+
+CheckpointWriter::~CheckpointWriter() {
+    flush();
+    {
+        std::lock_guard<std::mutex> lock(__mutex);
+        __stop = true;
+    }
+    __work.notify_one();
+    __writer.join();
+}
+
+void CheckpointWriter::write(const std::string& filename, std::string state,
+                             const std::string& progress) {
+    std::lock_guard<std::mutex> lock(__mutex);
+    if (__has_pending) {
+        log_warning << "Warning: checkpoint " << __pending.filename
+                    << " was skipped, the disk is slower than the simulation"
+                    << "\n";
+        ++__num_skipped;
+    }
+    __pending.filename = filename;
+    __pending.state = std::move(state);
+    __pending.progress = progress;
+    __has_pending = true;
+    __work.notify_one();
+}
+
+void CheckpointWriter::flush() {
+    std::unique_lock<std::mutex> lock(__mutex);
+    __done.wait(lock, [this] { return !__has_pending && !__busy; });
+}
+
+size_t CheckpointWriter::num_written() {
+    std::lock_guard<std::mutex> lock(__mutex);
+    return __num_written;
+}
+
+size_t CheckpointWriter::num_skipped() {
+    std::lock_guard<std::mutex> lock(__mutex);
+    return __num_skipped;
+}
+
+void CheckpointWriter::__run() {
+    std::unique_lock<std::mutex> lock(__mutex);
+    while (true) {
+        __work.wait(lock, [this] { return __stop || __has_pending; });
+        if (!__has_pending) {
+            return;
+        }
+
+        Snapshot snapshot;
+        std::swap(snapshot, __pending);
+        __has_pending = false;
+        __busy = true;
+        lock.unlock();
+
+        dbgmsg("writing checkpoint to file " << snapshot.filename);
+        const bool written = __write_file(snapshot);
+        if (!written) {
+            log_warning << "Warning: could not write checkpoint "
+                        << snapshot.filename << "\n";
+        }
+
+        lock.lock();
+        __busy = false;
+        __num_written += written;
+        __done.notify_all();
+    }
+}
+
+bool CheckpointWriter::__write_file(const Snapshot& snapshot) {
+    std::string header(checkpoint_magic, sizeof(checkpoint_magic));
+    put_size(header, snapshot.progress.size());
+    header.append(snapshot.progress);
+    put_size(header, snapshot.state.size());
+
+    // written under a temporary name and renamed, so the file is either the
+    // previous checkpoint or the complete new one
+    const std::string temp_file =
+        snapshot.filename + "." + boost::filesystem::unique_path().string();
+
+    std::FILE* file = std::fopen(temp_file.c_str(), "wb");
+    if (file == nullptr) {
+        return false;
+    }
+    bool ok = std::fwrite(header.data(), 1, header.size(), file) ==
+                  header.size() &&
+              std::fwrite(snapshot.state.data(), 1, snapshot.state.size(),
+                          file) == snapshot.state.size() &&
+              sync_file(file);
+    ok = std::fclose(file) == 0 && ok;
+
+    boost::system::error_code ec;
+    if (ok) {
+        boost::filesystem::rename(temp_file, snapshot.filename, ec);
+    }
+
+    if (!ok || ec) {
+        boost::filesystem::remove(temp_file, ec);
+        return false;
+    }
+
+    sync_directory(snapshot.filename);
+    return true;
+}
+
+void read_checkpoint(const std::string& filename, std::string& state,
+                     std::string& progress) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw Error("Cannot open checkpoint file: " + filename);
+    }
+    const std::string data((std::istreambuf_iterator<char>(file)),
+                           std::istreambuf_iterator<char>());
+
+    size_t pos = sizeof(checkpoint_magic);
+    uint64_t progress_size, state_size;
+    if (data.compare(0, pos, checkpoint_magic, pos) != 0 ||
+        !get_size(data, pos, progress_size) ||
+        data.size() - pos < progress_size) {
+        throw Error(filename + " is not a checkpoint");
+    }
+    progress = data.substr(pos, progress_size);
+    pos += progress_size;
+
+    if (!get_size(data, pos, state_size) || data.size() - pos != state_size) {
+        throw Error(filename + " is not a checkpoint");
+    }
+    state = data.substr(pos);
+}
+
+bool is_legacy_checkpoint(const std::string& filename) {
+    std::ifstream file(filename, std::ios::in | std::ios::binary);
+    if (!file.is_open()) {
+        throw Error("Cannot open checkpoint file: " + filename);
+    }
+    char magic[sizeof(checkpoint_magic)];
+    file.read(magic, sizeof(magic));
+
+    return file.gcount() != sizeof(magic) ||
+           !std::equal(magic, magic + sizeof(magic), checkpoint_magic);
+}
+}
+}
@@ -62,7 +62,8 @@ Modeler::Modeler(const ForceField& ffield, const string& fftype, double scale,
       __step_size_in_ps(step_size_in_fs * OpenMM::PsPerFs),
       __temperature(temperature),
       __friction(friction),
-      __cutoff(cutoff) {}
+      __cutoff(cutoff),
+      __receptor_field(nullptr) {}
 
 void Modeler::mask(const molib::Atom::Vec& atoms) {
     dbgmsg("Masking atoms " << atoms);
@@ -99,6 +100,39 @@ void Modeler::add_random_crds(const molib::Atom::Vec& atoms) {
     }
 }
 
+void Modeler::reserve_ligand(const molib::Atom::Vec& atoms) {
+    Topology topology;
+    topology.add_topology(atoms, *__ffield);
+    __system_topology.set_forcefield(*__ffield);
+    __system_topology.reserve_ligand(topology);
+}
+
+void Modeler::set_ligand(const molib::Atom::Vec& atoms) {
+    if (!__system_topology.has_ligand_slot())
+        throw Error("die : no ligand slot was reserved");
+
+    __topology = __receptor_topology;
+    __topology.add_topology(atoms, *__ffield);
+    __positions.resize(__topology.atoms.size());
+    __system_topology.set_ligand(__topology);
+}
+
+void Modeler::add_batch_ligand(const molib::Atom::Vec& atoms) {
+    if (__batch.size() == SystemTopology::max_batch_size)
+        throw Error("die : batch is full");
+
+    __batch.push_back(Topology(__topology.atoms.size()));
+    __batch.back().add_topology(atoms, *__ffield);
+    add_topology(atoms);
+}
+
+vector<double> Modeler::batch_energies() {
+    vector<double> energies;
+    for (size_t i = 0; i < __batch.size(); ++i)
+        energies.push_back(__system_topology.get_potential_energy(i));
+    return energies;
+}
+
 /**
  * Changes coordinates of atoms
  */
@@ -118,6 +152,16 @@ geometry::Point::Vec Modeler::get_state(const molib::Atom::Vec& atoms) {
     return crds;
 }
 
+geometry::Point::Vec Modeler::get_forces(const molib::Atom::Vec& atoms) {
+    const auto forces = __system_topology.get_forces();
+    geometry::Point::Vec result;
+    result.reserve(atoms.size());
+    for (auto& atom : atoms)
+        result.push_back(forces[__topology.get_index(*atom)]);
+
+    return result;
+}
+
 void Modeler::minimize_state() {
     Benchmark bench;
     __system_topology.minimize(__tolerance, __max_iterations);
@@ -146,22 +190,39 @@ void Modeler::init_openmm(const std::string& platform,
                           SystemTopology::integrator_type type) {
     __system_topology.set_forcefield(*__ffield);
     __system_topology.init_particles(__topology);
-    __system_topology.init_bonded(__topology, __use_constraints);
-
-    if (__fftype == "kb") {
-        __system_topology.init_knowledge_based_force_3d(__topology, __scale,
-                                                     __cutoff);
-    } else if (__fftype == "phy") {
-        __system_topology.init_physics_based_force(__topology);
-    } else if (__fftype == "none") {
-        // Do nothing
+
+    if (!__batch.empty()) {
+        if (__fftype != "kb" || __receptor_field == nullptr)
+            throw Error("die : batches need the knowledge-based forcefield "
+                        "and a receptor field");
+
+        for (size_t i = 0; i < __batch.size(); ++i)
+            __system_topology.init_batch_ligand(__batch[i], *__receptor_field,
+                                                __scale, __cutoff,
+                                                __use_constraints, i);
     } else {
-        throw Error("die : unsupported forcefield");
+        __system_topology.init_bonded(__topology, __use_constraints);
+
+        if (__fftype == "kb") {
+            __system_topology.init_knowledge_based_force_3d(
+                __topology, __scale, __cutoff);
+            if (__receptor_field != nullptr)
+                __system_topology.init_receptor_field_force(
+                    __topology, *__receptor_field, __scale);
+        } else if (__fftype == "phy") {
+            __system_topology.init_physics_based_force(__topology);
+        } else if (__fftype == "none") {
+            // Do nothing
+        } else {
+            throw Error("die : unsupported forcefield");
+        }
     }
 
     __system_topology.init_integrator(type, __step_size_in_ps, __temperature,
                                       __friction);
     __system_topology.init_platform(platform, precision, accelerators);
+
+    if (__system_topology.has_ligand_slot()) __receptor_topology = __topology;
 }
 
 double Modeler::potential_energy() {
@@ -0,0 +1,141 @@
+/* This is receptorfield.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+#include "statchem/modeler/receptorfield.hpp"
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include "statchem/helper/benchmark.hpp"
+#include "statchem/helper/debug.hpp"
+#include "statchem/helper/error.hpp"
+#include "statchem/helper/help.hpp"
+#include "statchem/helper/logger.hpp"
+#include "statchem/modeler/forcefield.hpp"
+#include "statchem/molib/grid.hpp"
+
+#include <openmm/Units.h>
+
+using namespace std;
+
+namespace statchem {
+namespace OMMIface {
+
+// The repulsive walls of the potentials reach 1e30, which would make the
+// splines fitted through the grid ring into neighboring cells
+const double ReceptorField::max_energy = 1000.0;
+
+// Wide enough that leaving the grid does not kick the ligand back into it
+const double ReceptorField::ramp_width = 2.0;
+
+ReceptorField::ReceptorField(const ForceField& ffield,
+                             const molib::Atom::Vec& receptor,
+                             const molib::Atom::Vec& ligand,
+                             const double spacing) {
+    if (ligand.empty()) throw Error("die : receptor field needs ligand atoms");
+    if (spacing <= 0.0) throw Error("die : grid spacing must be positive");
+
+    Benchmark bench;
+
+    const double cutoff = ffield.kb_cutoff * OpenMM::AngstromsPerNm;
+
+    __min = geometry::Point(HUGE_VAL, HUGE_VAL, HUGE_VAL);
+    __max = geometry::Point(-HUGE_VAL, -HUGE_VAL, -HUGE_VAL);
+    set<int> ligand_types;
+    for (auto& patom : ligand) {
+        const geometry::Point& crd = patom->crd();
+        __min.set_x(min(__min.x(), crd.x()));
+        __min.set_y(min(__min.y(), crd.y()));
+        __min.set_z(min(__min.z(), crd.z()));
+        __max.set_x(max(__max.x(), crd.x()));
+        __max.set_y(max(__max.y(), crd.y()));
+        __max.set_z(max(__max.z(), crd.z()));
+        ligand_types.insert(patom->idatm_type());
+    }
+
+    __nx = ceil((__max.x() - __min.x() + 2 * cutoff) / spacing) + 1;
+    __ny = ceil((__max.y() - __min.y() + 2 * cutoff) / spacing) + 1;
+    __nz = ceil((__max.z() - __min.z() + 2 * cutoff) / spacing) + 1;
+    __min = geometry::Point(__min.x() - cutoff, __min.y() - cutoff,
+                            __min.z() - cutoff);
+    __max = geometry::Point(__min.x() + (__nx - 1) * spacing,
+                            __min.y() + (__ny - 1) * spacing,
+                            __min.z() + (__nz - 1) * spacing);
+
+    // Potentials of every ligand type with every receptor type, looked up
+    // by idatm type in the inner loop
+    int max_idatm = 0;
+    for (auto& patom : receptor)
+        max_idatm = max(max_idatm, patom->idatm_type());
+
+    const vector<int> types(ligand_types.begin(), ligand_types.end());
+    vector<const vector<double>*> potentials(types.size() * (max_idatm + 1),
+                                             nullptr);
+    for (size_t t = 0; t < types.size(); ++t) {
+        for (auto& patom : receptor) {
+            const int idatm = patom->idatm_type();
+            auto& pot = potentials[t * (max_idatm + 1) + idatm];
+            if (pot != nullptr) continue;
+            try {
+                pot = &ffield.get_kb_force_type(types[t], idatm).potential;
+            } catch (ParameterError& e) {
+                dbgmsg(e.what() << " (treated as zero)");
+            }
+        }
+    }
+
+    for (auto type : types) __maps[type].resize(__nx * __ny * __nz);
+
+    molib::Atom::Grid grid(receptor);
+    vector<double> energies(types.size());
+
+    for (int k = 0; k < __nz; ++k) {
+        for (int j = 0; j < __ny; ++j) {
+            for (int i = 0; i < __nx; ++i) {
+                const geometry::Point point(__min.x() + i * spacing,
+                                            __min.y() + j * spacing,
+                                            __min.z() + k * spacing);
+                fill(energies.begin(), energies.end(), 0.0);
+
+                grid.for_each_neighbor_including_self(
+                    point, cutoff, [&](const molib::Atom* patom, double d_sq) {
+                        // linear interpolation of the tabulated potentials
+                        const double x = sqrt(d_sq) * OpenMM::NmPerAngstrom /
+                                         ffield.step;
+                        const size_t bin = x;
+                        const double frac = x - bin;
+                        const int idatm = patom->idatm_type();
+
+                        for (size_t t = 0; t < types.size(); ++t) {
+                            const auto pot =
+                                potentials[t * (max_idatm + 1) + idatm];
+                            if (pot == nullptr || bin + 1 >= pot->size())
+                                continue;
+                            energies[t] += (*pot)[bin] * (1 - frac) +
+                                           (*pot)[bin + 1] * frac;
+                        }
+                    });
+
+                const int idx = i + __nx * (j + __ny * k);
+                for (size_t t = 0; t < types.size(); ++t)
+                    __maps[types[t]][idx] = min(energies[t], max_energy);
+            }
+        }
+    }
+
+    log_benchmark << "Receptor field of " << __nx << "x" << __ny << "x" << __nz
+                  << " points for " << types.size() << " atom types took "
+                  << bench.seconds_from_start() << " wallclock seconds\n";
+}
+}  // namespace OMMIface
+}  // namespace statchem
@@ -18,6 +18,8 @@
 
 #include <openmm/AndersenThermostat.h>
 #include <openmm/BrownianIntegrator.h>
+#include <openmm/CustomBondForce.h>
+#include <openmm/CustomExternalForce.h>
 #include <openmm/CustomNonbondedForce.h>
 #include <openmm/HarmonicAngleForce.h>
 #include <openmm/HarmonicBondForce.h>
@@ -42,6 +44,7 @@
 #include "statchem/helper/help.hpp"
 #include "statchem/helper/logger.hpp"
 #include "statchem/modeler/forcefield.hpp"
+#include "statchem/modeler/receptorfield.hpp"
 #include "statchem/modeler/topology.hpp"
 
 #include <chrono>
@@ -49,6 +52,7 @@
 #include <utility>  // std::pair, std::make_pair
 #include <iostream>
 #include <fstream>
+#include <sstream>
 
 
 using namespace std;
@@ -82,118 +86,113 @@ void SystemTopology::loadPlugins(const std::string& extra_dir) {
     }
 }
 
-void SystemTopology::mask(Topology& topology, const molib::Atom::Vec& atoms) {
-    set<int> substruct;
+void SystemTopology::begin_mask_batch() { ++__mask_batch_depth; }
 
-    for (auto& patom : atoms) {
-        int idx = topology.get_index(*patom);
-        dbgmsg("masking particle idx = " << idx);
-        substruct.insert(idx);
+void SystemTopology::commit_mask_batch() {
+    if (__mask_batch_depth == 0)
+        throw Error("die : no mask batch to commit");
+
+    if (--__mask_batch_depth > 0) return;
+
+    // Each force is sent to the context at most once, and only if one of its
+    // terms was changed since the last commit
+    if (__stretch_changed) bondStretch->updateParametersInContext(*context);
+    if (__bend_changed) bondBend->updateParametersInContext(*context);
+    if (__torsion_changed) bondTorsion->updateParametersInContext(*context);
+
+    __stretch_changed = __bend_changed = __torsion_changed = false;
+}
+
+ScopedMaskBatch::~ScopedMaskBatch() {
+    // a destructor must not throw, the batch is closed in any case
+    try {
+        __system_topology.commit_mask_batch();
+    } catch (const std::exception& e) {
+        log_error << "Mask batch failed to commit " << e.what() << endl;
     }
+}
+
+void SystemTopology::mask(Topology& topology, const molib::Atom::Vec& atoms) {
+    if (__num_batch_ligands > 0)
+        throw Error("die : ligands of a batch cannot be masked");
+
+    ScopedMaskBatch batch(*this);
+    set_substruct(topology, atoms);
 
-    for (auto& idx : substruct) {
+    for (auto& idx : __substruct_idx) {
+        dbgmsg("masking particle idx = " << idx);
         system->setParticleMass(idx, 0);
         masked[idx] = true;
 
-        mask_forces(idx, substruct);
+        mask_forces(idx, __substruct);
     }
-
-    bondStretch->updateParametersInContext(*context);
-    bondBend->updateParametersInContext(*context);
-    bondTorsion->updateParametersInContext(*context);
 }
 
 void SystemTopology::unmask(Topology& topology, const molib::Atom::Vec& atoms) {
-    set<int> substruct;
+    if (__num_batch_ligands > 0)
+        throw Error("die : ligands of a batch cannot be unmasked");
 
-    for (auto& patom : atoms) {
-        int idx = topology.get_index(*patom);
-        substruct.insert(idx);
-    }
+    ScopedMaskBatch batch(*this);
+    set_substruct(topology, atoms);
 
-    for (auto& idx : substruct) {
+    for (auto& idx : __substruct_idx) {
         dbgmsg("unmasking particle idx = " << idx << " mass = " << masses[idx]);
         system->setParticleMass(idx, masses[idx]);
         masked[idx] = false;
 
-        unmask_forces(idx, substruct);
+        unmask_forces(idx, __substruct);
     }
-
-    bondStretch->updateParametersInContext(*context);
-    bondBend->updateParametersInContext(*context);
-    bondTorsion->updateParametersInContext(*context);
 }
 
-void SystemTopology::mask_forces(const int atom_idx,
-                                 const set<int>& substruct) {
-    for (auto& data : bondStretchData[atom_idx]) {  // get all forces involving
-                                                    // this atom's idx
-        if (substruct.count(data.idx1) && substruct.count(data.idx2))
-            bondStretch->setBondParameters(data.force_idx, data.idx1, data.idx2,
-                                           data.length, 0.0);
-    }
+void SystemTopology::set_substruct(const Topology& topology,
+                                   const molib::Atom::Vec& atoms) {
+    __substruct.resize(system->getNumParticles(), false);
+    for (auto& idx : __substruct_idx) __substruct[idx] = false;
+    __substruct_idx.clear();
 
-    for (auto& data :
-         bondBendData[atom_idx]) {  // get all forces involving this atom's idx
-        if (substruct.count(data.idx1) && substruct.count(data.idx2) &&
-            substruct.count(data.idx3))
-            bondBend->setAngleParameters(data.force_idx, data.idx1, data.idx2,
-                                         data.idx3, data.angle, 0.0);
+    for (auto& idx : topology.get_indices(atoms)) {
+        if (!__substruct[idx]) __substruct_idx.push_back(idx);
+        __substruct[idx] = true;
     }
+}
 
-    for (auto& data : bondTorsionData[atom_idx]) {  // get all forces involving
-                                                    // this atom's idx
-        if (substruct.count(data.idx1) && substruct.count(data.idx2) &&
-            substruct.count(data.idx3) && substruct.count(data.idx4)) {
-            int idx1, idx2, idx3, idx4;
-            int periodicity;
-            double phase, k;
-
-            bondTorsion->getTorsionParameters(data.force_idx, idx1, idx2, idx3,
-                                              idx4, periodicity, phase, k);
-            dbgmsg("particles of force " << data.force_idx);
-            dbgmsg(idx1 << " " << data.idx1);
-            dbgmsg(idx2 << " " << data.idx2);
-            dbgmsg(idx3 << " " << data.idx3);
-            dbgmsg(idx4 << " " << data.idx4);
-            dbgmsg(periodicity << " " << data.periodicity);
-
-            if (idx1 != data.idx1) throw Error("die : particles changed");
-
-            if (idx2 != data.idx2) throw Error("die : particles changed");
-
-            if (idx3 != data.idx3) throw Error("die : particles changed");
-
-            if (idx4 != data.idx4) throw Error("die : particles changed");
-
-            bondTorsion->setTorsionParameters(
-                data.force_idx, data.idx1, data.idx2, data.idx3, data.idx4,
-                data.periodicity, data.phase, 0.0);
-        }
-    }
+void SystemTopology::mask_forces(const int atom_idx,
+                                 const vector<bool>& substruct) {
+    set_forces(atom_idx, substruct, false);
 }
 
 void SystemTopology::unmask_forces(const int atom_idx,
-                                   const set<int>& substruct) {
+                                   const vector<bool>& substruct) {
+    set_forces(atom_idx, substruct, true);
+}
+
+void SystemTopology::set_forces(const int atom_idx,
+                                const vector<bool>& substruct,
+                                const bool enable) {
     for (auto& data : bondStretchData[atom_idx]) {  // get all forces involving
                                                     // this atom's idx
-        if (substruct.count(data.idx1) && substruct.count(data.idx2))
+        if (substruct[data.idx1] && substruct[data.idx2]) {
             bondStretch->setBondParameters(data.force_idx, data.idx1, data.idx2,
-                                           data.length, data.k);
+                                           data.length, enable ? data.k : 0.0);
+            __stretch_changed = true;
+        }
     }
 
     for (auto& data :
          bondBendData[atom_idx]) {  // get all forces involving this atom's idx
-        if (substruct.count(data.idx1) && substruct.count(data.idx2) &&
-            substruct.count(data.idx3))
+        if (substruct[data.idx1] && substruct[data.idx2] &&
+            substruct[data.idx3]) {
             bondBend->setAngleParameters(data.force_idx, data.idx1, data.idx2,
-                                         data.idx3, data.angle, data.k);
+                                         data.idx3, data.angle,
+                                         enable ? data.k : 0.0);
+            __bend_changed = true;
+        }
     }
 
     for (auto& data : bondTorsionData[atom_idx]) {  // get all forces involving
                                                     // this atom's idx
-        if (substruct.count(data.idx1) && substruct.count(data.idx2) &&
-            substruct.count(data.idx3) && substruct.count(data.idx4)) {
+        if (substruct[data.idx1] && substruct[data.idx2] &&
+            substruct[data.idx3] && substruct[data.idx4]) {
             int idx1, idx2, idx3, idx4;
             int periodicity;
             double phase, k;
@@ -217,7 +216,8 @@ void SystemTopology::unmask_forces(const int atom_idx,
 
             bondTorsion->setTorsionParameters(
                 data.force_idx, data.idx1, data.idx2, data.idx3, data.idx4,
-                data.periodicity, data.phase, data.k);
+                data.periodicity, data.phase, enable ? data.k : 0.0);
+            __torsion_changed = true;
         }
     }
 }
@@ -307,6 +307,18 @@ void SystemTopology::init_particles(Topology& topology) {
         }
     }
 
+    // The ligand slot starts out empty, so all of its particles are masked.
+    // Ligand particles get a placeholder mass as the context keeps the
+    // masses it was created with, while the anchors never move
+    __slot_begin = topology.atoms.size();
+    if (has_ligand_slot()) {
+        for (int i = 0; i < __slot_size + __num_anchors; ++i) {
+            system->addParticle(i < __slot_size ? 1.0 : 0.0);
+            masses.push_back(0.0);
+            masked.push_back(true);
+        }
+    }
+
     if (warn > 0) {
         throw Error("die : missing parameters detected");
     }
@@ -345,7 +357,7 @@ void SystemTopology::update_thermostat(const double temperature_in_kelvin,
 void SystemTopology::init_physics_based_force(Topology& topology) {
     int warn = 0;
 
-    OpenMM::NonbondedForce* nonbond = new OpenMM::NonbondedForce();
+    nonbond = new OpenMM::NonbondedForce();
     nonbond->setNonbondedMethod(OpenMM::NonbondedForce::NonbondedMethod::PME);
     nonbond->setCutoffDistance(2.99);
     system->addForce(nonbond);
@@ -393,6 +405,24 @@ void SystemTopology::init_physics_based_force(Topology& topology) {
     nonbond->createExceptionsFromBonds(bondPairs, __ffield->coulomb14scale,
                                        __ffield->lj14scale);
 
+    if (has_ligand_slot()) {
+        // Nonbonded interactions within the ligand are computed pairwise by
+        // slot_pairs, as the exceptions cannot be changed in a context. The
+        // bare 1/r Coulomb term is what PME needs here: for the excluded
+        // slot pairs it removes the reciprocal space part, so excluded pair
+        // plus 1/r gives the same energy as a pair that is not excluded
+        for (int i = __slot_begin; i < system->getNumParticles(); ++i)
+            nonbond->addParticle(0.0, 1.0, 0.0);
+
+        slot_pairs = new OpenMM::CustomBondForce(
+            "138.935456 * qq / r + 4 * eps * ((sig / r)^12 - (sig / r)^6)");
+        slot_pairs->addPerBondParameter("qq");
+        slot_pairs->addPerBondParameter("sig");
+        slot_pairs->addPerBondParameter("eps");
+        init_slot_pairs({0.0, 1.0, 0.0});
+        system->addForce(slot_pairs);
+    }
+
     if (warn > 0) {
         throw Error("die : missing parameters detected");
     }
@@ -494,9 +524,15 @@ void SystemTopology::init_knowledge_based_force_3d(Topology& topology,
     forcefield->addGlobalParameter("scale", scale);
     forcefield->addPerParticleParameter("idatm");
 
-    std::map<int, int> __idatm_to_internal;
+    // A topology covering only part of the system, like one ligand of a
+    // batch, only interacts with itself
+    const int first =
+        topology.atoms.empty() ? 0 : topology.get_index(*topology.atoms[0]);
+    for (int i = 0; i < first; ++i) forcefield->addParticle({0.0});
+
     std::map<int, int> __internal_to_idatm;
     int num_types = 0;
+    __idatm_to_internal.clear();
     for (const auto& atom : topology.atoms) {
         if (!__idatm_to_internal.count(atom->idatm_type())) {
             __idatm_to_internal[atom->idatm_type()] = num_types;
@@ -508,11 +544,45 @@ void SystemTopology::init_knowledge_based_force_3d(Topology& topology,
             {static_cast<double>(__idatm_to_internal[atom->idatm_type()])});
     }
 
+    // Every type a ligand swapped into the slot may have needs a row in the
+    // table, and the empty slot particles get a dummy type which does not
+    // interact with anything
+    if (has_ligand_slot()) {
+        for (auto idatm_type : __slot_idatm_types) {
+            if (!__idatm_to_internal.count(idatm_type)) {
+                __idatm_to_internal[idatm_type] = num_types;
+                __internal_to_idatm[num_types] = idatm_type;
+                num_types++;
+            }
+        }
+        __dummy_type = num_types++;
+
+        for (int i = __slot_begin; i < system->getNumParticles(); ++i)
+            forcefield->addParticle({static_cast<double>(__dummy_type)});
+    }
+
+    if (forcefield->getNumParticles() < system->getNumParticles() ||
+        first > 0) {
+        set<int> group;
+        for (size_t i = 0; i < topology.atoms.size(); ++i)
+            group.insert(first + i);
+        forcefield->addInteractionGroup(group, group);
+
+        while (forcefield->getNumParticles() < system->getNumParticles())
+            forcefield->addParticle({0.0});
+    }
+
     vector<double> table;
     size_t xsize = 0, ysize = 0;
 
-    for (size_t i = 0; i < __idatm_to_internal.size(); i++) {
-        for (size_t j = 0; j < __idatm_to_internal.size(); j++) {
+    for (int i = 0; i < num_types; i++) {
+        for (int j = 0; j < num_types; j++) {
+            if (i == __dummy_type || j == __dummy_type) {
+                ysize++;
+                for (size_t k = 0; k < xsize; k++) table.push_back(0.0);
+                continue;
+            }
+
             try {
                 const ForceField::KBType kb = __ffield->get_kb_force_type(
                     __internal_to_idatm[i], __internal_to_idatm[j]);
@@ -545,11 +615,11 @@ void SystemTopology::init_knowledge_based_force_3d(Topology& topology,
         forcefield->addTabulatedFunction(
             "kbpot",
             new OpenMM::Continuous3DFunction(xsize,
-                                             __idatm_to_internal.size(),
-                                             __idatm_to_internal.size(), table,
+                                             num_types,
+                                             num_types, table,
                                              0.0, (xsize - 1) * __ffield->step,
-                                             0.0, __idatm_to_internal.size() - 1.0,
-                                             0.0, __idatm_to_internal.size() - 1.0
+                                             0.0, num_types - 1.0,
+                                             0.0, num_types - 1.0
                                             ));
 
         vector<pair<int, int>> bondPairs;
@@ -563,6 +633,25 @@ void SystemTopology::init_knowledge_based_force_3d(Topology& topology,
         }
 
         forcefield->createExclusionsFromBonds(bondPairs, 4);
+
+        if (has_ligand_slot()) {
+            // Interactions within the ligand are computed pairwise by
+            // slot_pairs, as the exclusions cannot be changed in a context
+            slot_pairs = new OpenMM::CustomBondForce(
+                "scale * kbpot(r, idatm1, idatm2) * step(kbcutoff - r)");
+            slot_pairs->addGlobalParameter("scale", scale);
+            slot_pairs->addGlobalParameter("kbcutoff", __ffield->kb_cutoff);
+            slot_pairs->addPerBondParameter("idatm1");
+            slot_pairs->addPerBondParameter("idatm2");
+            slot_pairs->addTabulatedFunction(
+                "kbpot", new OpenMM::Continuous3DFunction(
+                             xsize, num_types, num_types, table, 0.0,
+                             (xsize - 1) * __ffield->step, 0.0,
+                             num_types - 1.0, 0.0, num_types - 1.0));
+            init_slot_pairs({static_cast<double>(__dummy_type),
+                             static_cast<double>(__dummy_type)});
+            system->addForce(slot_pairs);
+        }
     } catch (ParameterError& e) {
         cerr << e.what() << endl;
         cerr << "Exiting" << endl;
@@ -571,6 +660,100 @@ void SystemTopology::init_knowledge_based_force_3d(Topology& topology,
     system->addForce(forcefield);
 }
 
+void SystemTopology::init_receptor_field_force(Topology& topology,
+                                               const ReceptorField& field,
+                                               double scale) {
+    const geometry::Point& min = field.get_min();
+    const geometry::Point& max = field.get_max();
+
+    // One force per atom type, each with the map of that type
+    map<int, OpenMM::CustomExternalForce*> forces;
+
+    for (auto& patom : topology.atoms) {
+        const int idatm_type = patom->idatm_type();
+
+        if (!field.has_map(idatm_type))
+            throw Error("die : receptor field has no map for atom type " +
+                        string(help::idatm_unmask[idatm_type]));
+
+        auto& force = forces[idatm_type];
+        if (force == nullptr) {
+            // Continuous3DFunction is zero outside of the grid, where the
+            // receptor is not tabulated, so atoms there get the value at the
+            // nearest point of the grid, rising smoothly to the capped value
+            // within ramp of the grid
+            force = new OpenMM::CustomExternalForce(
+                "scale * ((1 - s) * field(xc, yc, zc) + s * cap);"
+                "s = w * w * (3 - 2 * w);"
+                "w = min(1, ((x - xc)^2 + (y - yc)^2 + (z - zc)^2) / ramp^2);"
+                "xc = min(max(x, xmin), xmax);"
+                "yc = min(max(y, ymin), ymax);"
+                "zc = min(max(z, zmin), zmax)");
+            force->addGlobalParameter("scale", scale);
+            force->addGlobalParameter("cap", ReceptorField::max_energy);
+            force->addGlobalParameter(
+                "ramp", ReceptorField::ramp_width * OpenMM::NmPerAngstrom);
+            force->addGlobalParameter("xmin", min.x() * OpenMM::NmPerAngstrom);
+            force->addGlobalParameter("xmax", max.x() * OpenMM::NmPerAngstrom);
+            force->addGlobalParameter("ymin", min.y() * OpenMM::NmPerAngstrom);
+            force->addGlobalParameter("ymax", max.y() * OpenMM::NmPerAngstrom);
+            force->addGlobalParameter("zmin", min.z() * OpenMM::NmPerAngstrom);
+            force->addGlobalParameter("zmax", max.z() * OpenMM::NmPerAngstrom);
+            force->addTabulatedFunction(
+                "field",
+                new OpenMM::Continuous3DFunction(
+                    field.size_x(), field.size_y(), field.size_z(),
+                    field.get_map(idatm_type), min.x() * OpenMM::NmPerAngstrom,
+                    max.x() * OpenMM::NmPerAngstrom,
+                    min.y() * OpenMM::NmPerAngstrom,
+                    max.y() * OpenMM::NmPerAngstrom,
+                    min.z() * OpenMM::NmPerAngstrom,
+                    max.z() * OpenMM::NmPerAngstrom));
+            system->addForce(force);
+        }
+
+        force->addParticle(topology.get_index(*patom), vector<double>());
+    }
+}
+
+void SystemTopology::init_batch_ligand(Topology& topology,
+                                       const ReceptorField& field,
+                                       double scale, double cutoff,
+                                       const bool use_constraints,
+                                       const int group) {
+    if (group < 0 || group >= max_batch_size)
+        throw Error("die : at most " + std::to_string(max_batch_size) +
+                    " ligands fit into a batch");
+
+    const int first_force = system->getNumForces();
+
+    ++__num_batch_ligands;
+    init_bonded(topology, use_constraints);
+    init_knowledge_based_force_3d(topology, scale, cutoff);
+    init_receptor_field_force(topology, field, scale);
+
+    for (int i = first_force; i < system->getNumForces(); ++i)
+        system->getForce(i).setForceGroup(group);
+}
+
+void SystemTopology::init_slot_pairs(const vector<double>& off) {
+    const int end = system->getNumParticles();
+
+    for (int i = __slot_begin; i < end; ++i) {
+        for (int j = i + 1; j < end; ++j) {
+            if (forcefield != nullptr) forcefield->addExclusion(i, j);
+            if (nonbond != nullptr) nonbond->addException(i, j, 0.0, 1.0, 0.0);
+        }
+    }
+
+    // One pair term for every pair of ligand atoms, set by set_ligand
+    for (int i = __slot_begin; i < __slot_begin + __slot_size; ++i) {
+        for (int j = i + 1; j < __slot_begin + __slot_size; ++j) {
+            slot_pairs->addBond(i, j, off);
+        }
+    }
+}
+
 void SystemTopology::retype_amber_protein_atom_to_gaff(const molib::Atom& atom,
                                                        int& type) {
     // Only retype protein atoms to gaff atoms
@@ -600,13 +783,102 @@ void SystemTopology::retype_amber_protein_atom_to_gaff(const molib::Atom& atom,
     }
 }
 
+std::vector<int> SystemTopology::get_term_types(
+    const Topology& topology, const molib::Atom::ConstVec& atoms) {
+    vector<int> types;
+    int number_protein = 0, number_not_set = 0;
+
+    for (auto& patom : atoms) {
+        types.push_back(topology.get_type(*patom));
+        number_protein += patom->br().rest() == molib::Residue::protein;
+        number_not_set += patom->gaff_type() != "???";
+    }
+
+    // Check for modified residues: the atoms should all be protein or
+    // non-protein, otherwise we fix it
+    const int n = atoms.size();
+    if (number_protein > 0 && number_protein < n && number_not_set > 0 &&
+        number_not_set < n) {
+        for (int i = 0; i < n; ++i)
+            retype_amber_protein_atom_to_gaff(*atoms[i], types[i]);
+    }
+
+    return types;
+}
+
+ForceField::BondType SystemTopology::get_bond_type(const Topology& topology,
+                                                   const molib::Atom& atom1,
+                                                   const molib::Atom& atom2) {
+    const auto types = get_term_types(topology, {&atom1, &atom2});
+
+    try {
+        return __ffield->get_bond_type(types[0], types[1]);
+    } catch (ParameterError& e) {
+        log_warning << e.what()
+                    << " (WARNINGS ARE NOT INCREASED) (using "
+                       "default parameters for this bond)"
+                    << endl;
+        // if everything else fails just constrain at something reasonable
+        return ForceField::BondType{atom1.get_bond(atom2).length(), 250000,
+                                    false};
+    }
+}
+
+ForceField::AngleType SystemTopology::get_angle_type(
+    const Topology& topology, const molib::Atom& atom1,
+    const molib::Atom& atom2, const molib::Atom& atom3) {
+    const auto types = get_term_types(topology, {&atom1, &atom2, &atom3});
+
+    try {
+        dbgmsg("determining angle type between atoms : " << endl
+                                                         << atom1 << endl
+                                                         << atom2 << endl
+                                                         << atom3);
+        return __ffield->get_angle_type(types[0], types[1], types[2]);
+    } catch (ParameterError& e) {
+        log_warning << e.what()
+                    << " (WARNINGS ARE NOT INCREASED) (using "
+                       "default parameters for this angle)"
+                    << endl;
+        // if everything else fails just constrain at something reasonable
+        return ForceField::AngleType{
+            geometry::angle(atom1.crd(), atom2.crd(), atom3.crd()), 500};
+    }
+}
+
+ForceField::TorsionTypeVec SystemTopology::get_torsion_types(
+    const Topology& topology, const molib::Atom& atom1,
+    const molib::Atom& atom2, const molib::Atom& atom3,
+    const molib::Atom& atom4, const bool improper) {
+    const auto types =
+        get_term_types(topology, {&atom1, &atom2, &atom3, &atom4});
+
+    try {
+        if (improper)
+            return __ffield->get_improper_type(types[0], types[1], types[2],
+                                               types[3]);
+        return __ffield->get_dihedral_type(types[0], types[1], types[2],
+                                           types[3]);
+    } catch (ParameterError& e) {
+        if (improper) {
+            dbgmsg(e.what() << " (WARNINGS ARE NOT INCREASED)");
+        } else {
+            log_warning << e.what()
+                        << " (WARNINGS ARE NOT INCREASED) (using "
+                           "default parameters for this dihedral)"
+                        << endl;
+        }
+        return ForceField::TorsionTypeVec();
+    }
+}
+
 void SystemTopology::init_bonded(Topology& topology,
                                  const bool use_constraints) {
     int warn = 0;
 
-    bondStretchData.resize(topology.atoms.size());
-    bondBendData.resize(topology.atoms.size());
-    bondTorsionData.resize(topology.atoms.size());
+    bondStretchData.resize(system->getNumParticles());
+    bondBendData.resize(system->getNumParticles());
+    bondTorsionData.resize(system->getNumParticles());
 
     bondStretch = new OpenMM::HarmonicBondForce();
     bondBend = new OpenMM::HarmonicAngleForce();
@@ -627,47 +899,13 @@ void SystemTopology::init_bonded(Topology& topology,
     int force_idx = 0;
 
     for (auto& bond : topology.bonds) {
-        dbgmsg("checkpoint0");
-
         const molib::Atom& atom1 = *bond.first;
-        dbgmsg(atom1);
         const molib::Atom& atom2 = *bond.second;
-        dbgmsg(atom2);
         const int idx1 = topology.get_index(atom1);
-        dbgmsg(idx1);
         const int idx2 = topology.get_index(atom2);
-        dbgmsg(idx2);
-        int type1 = topology.get_type(atom1);
-        dbgmsg(type1);
-        int type2 = topology.get_type(atom2);
-        dbgmsg(type2);
-
-        // Check for modified residues
-        int number_protein = (atom1.br().rest() == molib::Residue::protein) +
-                             (atom2.br().rest() == molib::Residue::protein);
-
-        int number_not_set =
-            (atom1.gaff_type() != "???") + (atom2.gaff_type() != "???");
-
-        // It should both protein or non-protein, otherwise we fix it
-        if (number_protein == 1 && number_not_set == 1) {
-            retype_amber_protein_atom_to_gaff(atom1, type1);
-            retype_amber_protein_atom_to_gaff(atom2, type2);
-        }
-
-        ForceField::BondType btype;
 
-        try {
-            btype = __ffield->get_bond_type(type1, type2);
-        } catch (ParameterError& e) {
-            log_warning << e.what()
-                        << " (WARNINGS ARE NOT INCREASED) (using "
-                           "default parameters for this bond)"
-                        << endl;
-            // if everything else fails just constrain at something reasonable
-            btype = ForceField::BondType{atom1.get_bond(atom2).length(), 250000,
-                                         false};
-        }
+        const ForceField::BondType btype =
+            get_bond_type(topology, atom1, atom2);
 
         if (use_constraints &&
             btype.can_constrain) {  // Should we constrain C-H bonds?
@@ -690,59 +928,19 @@ void SystemTopology::init_bonded(Topology& topology,
         }
     }
 
-    dbgmsg("checkpoint3");
-
     force_idx = 0;
 
     // Create the 1-2-3 bond angle harmonic terms.
     for (auto& angle : topology.angles) {
-        dbgmsg("checkpoint4");
         const molib::Atom& atom1 = *get<0>(angle);
         const molib::Atom& atom2 = *get<1>(angle);
         const molib::Atom& atom3 = *get<2>(angle);
         const int idx1 = topology.get_index(atom1);
         const int idx2 = topology.get_index(atom2);
-        dbgmsg("checkpoint5");
         const int idx3 = topology.get_index(atom3);
-        int type1 = topology.get_type(atom1);
-        int type2 = topology.get_type(atom2);
-        int type3 = topology.get_type(atom3);
-        dbgmsg("checkpoint6");
-
-        // Check for modified residues
-        int number_protein = (atom1.br().rest() == molib::Residue::protein) +
-                             (atom2.br().rest() == molib::Residue::protein) +
-                             (atom3.br().rest() == molib::Residue::protein);
-
-        int number_not_set = (atom1.gaff_type() != "???") +
-                             (atom2.gaff_type() != "???") +
-                             (atom3.gaff_type() != "???");
-
-        // It should all be protein or non-protein, otherwise we fix it
-        if ((number_protein == 1 || number_protein == 2) &&
-            (number_not_set == 1 || number_not_set == 2)) {
-            retype_amber_protein_atom_to_gaff(atom1, type1);
-            retype_amber_protein_atom_to_gaff(atom2, type2);
-            retype_amber_protein_atom_to_gaff(atom3, type3);
-        }
 
-        ForceField::AngleType atype;
-
-        try {
-            dbgmsg("determining angle type between atoms : " << endl
-                                                             << atom1 << endl
-                                                             << atom2 << endl
-                                                             << atom3);
-            atype = __ffield->get_angle_type(type1, type2, type3);
-        } catch (ParameterError& e) {
-            log_warning << e.what()
-                        << " (WARNINGS ARE NOT INCREASED) (using "
-                           "default parameters for this angle)"
-                        << endl;
-            // if everything else fails just constrain at something reasonable
-            atype = ForceField::AngleType{
-                geometry::angle(atom1.crd(), atom2.crd(), atom3.crd()), 500};
-        }
+        const ForceField::AngleType atype =
+            get_angle_type(topology, atom1, atom2, atom3);
 
         dbgmsg("force_idx = " << force_idx << " idx1 = " << idx1
                               << " idx2 = " << idx2 << " idx3 = " << idx3
@@ -757,54 +955,27 @@ void SystemTopology::init_bonded(Topology& topology,
                                                0, atype.angle, 0, 0, atype.k});
 
         ++force_idx;
-
-        dbgmsg("checkpoint8");
     }
 
     force_idx = 0;
 
-    // Create the 1-2-3-4 bond torsion (dihedral) terms.
-    for (auto& dihedral : topology.dihedrals) {
-        dbgmsg("checkpoint9");
-        const molib::Atom& atom1 = *get<0>(dihedral);
-        const molib::Atom& atom2 = *get<1>(dihedral);
-        const molib::Atom& atom3 = *get<2>(dihedral);
-        const molib::Atom& atom4 = *get<3>(dihedral);
-        const int idx1 = topology.get_index(atom1);
-        const int idx2 = topology.get_index(atom2);
-        const int idx3 = topology.get_index(atom3);
-        const int idx4 = topology.get_index(atom4);
-        int type1 = topology.get_type(atom1);
-        int type2 = topology.get_type(atom2);
-        int type3 = topology.get_type(atom3);
-        int type4 = topology.get_type(atom4);
-
-        // Check for modified residues
-        int number_protein = (atom1.br().rest() == molib::Residue::protein) +
-                             (atom2.br().rest() == molib::Residue::protein) +
-                             (atom3.br().rest() == molib::Residue::protein) +
-                             (atom4.br().rest() == molib::Residue::protein);
-
-        int number_not_set =
-            (atom1.gaff_type() != "???") + (atom2.gaff_type() != "???") +
-            (atom3.gaff_type() != "???") + (atom4.gaff_type() != "???");
-
-        // It should all be protein or non-protein, otherwise we fix it
-        if ((number_protein == 1 || number_protein == 2 ||
-             number_protein == 3) &&
-            (number_not_set == 1 || number_not_set == 2 ||
-             number_not_set == 3)) {
-            retype_amber_protein_atom_to_gaff(atom1, type1);
-            retype_amber_protein_atom_to_gaff(atom2, type2);
-            retype_amber_protein_atom_to_gaff(atom3, type3);
-            retype_amber_protein_atom_to_gaff(atom4, type4);
-        }
+    // Create the 1-2-3-4 bond torsion (dihedral) terms and the 1-2-3-4
+    // improper terms where 3 is the central atom
+    for (auto dihedrals : {&topology.dihedrals, &topology.impropers}) {
+        const bool improper = dihedrals == &topology.impropers;
 
-        try {
-            const ForceField::TorsionTypeVec& v_ttype =
-                __ffield->get_dihedral_type(type1, type2, type3,
-                                            type4);  // cannot make it const ??
-            for (auto& ttype : v_ttype) {
+        for (auto& dihedral : *dihedrals) {
+            const molib::Atom& atom1 = *get<0>(dihedral);
+            const molib::Atom& atom2 = *get<1>(dihedral);
+            const molib::Atom& atom3 = *get<2>(dihedral);
+            const molib::Atom& atom4 = *get<3>(dihedral);
+            const int idx1 = topology.get_index(atom1);
+            const int idx2 = topology.get_index(atom2);
+            const int idx3 = topology.get_index(atom3);
+            const int idx4 = topology.get_index(atom4);
+
+            for (auto& ttype : get_torsion_types(topology, atom1, atom2,
+                                                 atom3, atom4, improper)) {
                 dbgmsg("force_idx = "
                        << force_idx << " idx1 = " << idx1 << " idx2 = " << idx2
                        << " idx3 = " << idx3 << " idx4 = " << idx4
@@ -813,118 +984,33 @@ void SystemTopology::init_bonded(Topology& topology,
                 bondTorsion->addTorsion(idx1, idx2, idx3, idx4,
                                         ttype.periodicity, ttype.phase,
                                         ttype.k);
-                bondTorsionData[idx1].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
-                bondTorsionData[idx2].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
-                bondTorsionData[idx3].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
-                bondTorsionData[idx4].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
+                for (auto idx : {idx1, idx2, idx3, idx4})
+                    bondTorsionData[idx].push_back(
+                        ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
+                                  ttype.periodicity, ttype.phase, ttype.k});
 
                 ++force_idx;
             }
-        } catch (ParameterError& e) {
-            log_warning << e.what()
-                        << " (WARNINGS ARE NOT INCREASED) (using "
-                           "default parameters for this dihedral)"
-                        << endl;
-            // if everything else fails just constrain at something reasonable
-            // cout <<  geometry::dihedral(atom1.crd(), atom2.crd(),
-            // atom3.crd(), atom4.crd()) << endl;
-            // ForceField::TorsionType vtype = ForceField::TorsionType {1,
-            // geometry::dihedral(atom1.crd(), atom2.crd(), atom3.crd(),
-            // atom4.crd()), 0};
-            // bondTorsion->addTorsion (idx1, idx2, idx3, idx4,
-            // vtype.periodicity, vtype.phase, vtype.k);
-            // bondTorsionData[idx1].push_back (ForceData {force_idx, idx1,
-            // idx2, idx3, idx4, 0, 0, vtype.periodicity, vtype.phase,
-            // vtype.k});
-            // bondTorsionData[idx2].push_back (ForceData {force_idx, idx1,
-            // idx2, idx3, idx4, 0, 0, vtype.periodicity, vtype.phase,
-            // vtype.k});
-            // bondTorsionData[idx3].push_back (ForceData {force_idx, idx1,
-            // idx2, idx3, idx4, 0, 0, vtype.periodicity, vtype.phase,
-            // vtype.k});
-            // bondTorsionData[idx4].push_back (ForceData {force_idx, idx1,
-            // idx2, idx3, idx4, 0, 0, vtype.periodicity, vtype.phase,
-            // vtype.k});
-
-            //++force_idx;
         }
     }
 
-    // Create the 1-2-3-4 improper terms where 3 is the central atom
-    for (auto& dihedral : topology.impropers) {
-        dbgmsg("checkpoint10");
-        const molib::Atom& atom1 = *get<0>(dihedral);
-        const molib::Atom& atom2 = *get<1>(dihedral);
-        const molib::Atom& atom3 = *get<2>(dihedral);
-        const molib::Atom& atom4 = *get<3>(dihedral);
-        const int idx1 = topology.get_index(atom1);
-        const int idx2 = topology.get_index(atom2);
-        const int idx3 = topology.get_index(atom3);
-        const int idx4 = topology.get_index(atom4);
-        int type1 = topology.get_type(atom1);
-        int type2 = topology.get_type(atom2);
-        int type3 = topology.get_type(atom3);
-        int type4 = topology.get_type(atom4);
-
-        // Check for modified residues
-        int number_protein = (atom1.br().rest() == molib::Residue::protein) +
-                             (atom2.br().rest() == molib::Residue::protein) +
-                             (atom3.br().rest() == molib::Residue::protein) +
-                             (atom4.br().rest() == molib::Residue::protein);
-
-        int number_not_set =
-            (atom1.gaff_type() != "???") + (atom2.gaff_type() != "???") +
-            (atom3.gaff_type() != "???") + (atom4.gaff_type() != "???");
-
-        // It should all be protein or non-protein, otherwise we fix it
-        if ((number_protein == 1 || number_protein == 2 ||
-             number_protein == 3) &&
-            (number_not_set == 1 || number_not_set == 2 ||
-             number_not_set == 3)) {
-            retype_amber_protein_atom_to_gaff(atom1, type1);
-            retype_amber_protein_atom_to_gaff(atom2, type2);
-            retype_amber_protein_atom_to_gaff(atom3, type3);
-            retype_amber_protein_atom_to_gaff(atom4, type4);
-        }
+    // Unused terms of the ligand slot are switched off and parked on the
+    // anchor particles, which never move
+    if (has_ligand_slot()) {
+        const int anchor = __slot_begin + __slot_size;
 
-        try {
-            const ForceField::TorsionTypeVec& v_ttype =
-                __ffield->get_improper_type(type1, type2, type3,
-                                            type4);  // cannot make it const ??
-
-            for (auto& ttype : v_ttype) {
-                dbgmsg("force_idx = " << force_idx << " idx1 = " << idx1
-                                      << " idx2 = " << idx2 << " idx3 = "
-                                      << idx3 << " idx4 = " << idx4);
-                bondTorsion->addTorsion(idx1, idx2, idx3, idx4,
-                                        ttype.periodicity, ttype.phase,
-                                        ttype.k);
-                bondTorsionData[idx1].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
-                bondTorsionData[idx2].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
-                bondTorsionData[idx3].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
-                bondTorsionData[idx4].push_back(
-                    ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
-                              ttype.periodicity, ttype.phase, ttype.k});
+        __slot_bond_idx = bondStretch->getNumBonds();
+        for (int i = 0; i < __slot_bonds; ++i)
+            bondStretch->addBond(anchor, anchor + 1, 0.1, 0.0);
 
-                ++force_idx;
-            }
-        } catch (ParameterError& e) {
-            dbgmsg(e.what() << " (WARNINGS ARE NOT INCREASED)");
-        }
+        __slot_angle_idx = bondBend->getNumAngles();
+        for (int i = 0; i < __slot_angles; ++i)
+            bondBend->addAngle(anchor, anchor + 1, anchor + 2, M_PI / 2, 0.0);
+
+        __slot_torsion_idx = bondTorsion->getNumTorsions();
+        for (int i = 0; i < __slot_torsions; ++i)
+            bondTorsion->addTorsion(anchor, anchor + 1, anchor + 2, anchor + 3,
+                                    1, 0.0, 0.0);
     }
 
     if (warn > 0) {
@@ -942,11 +1028,323 @@ void SystemTopology::init_positions(const geometry::Point::Vec& crds) {
             crd.z() * OpenMM::NmPerAngstrom));
     }
 
+    // Particles of the ligand slot not used by the current ligand
+    for (int i = positions_in_nm.size(); i < system->getNumParticles(); ++i)
+        positions_in_nm.push_back(parked_position(i));
+
     context->setPositions(positions_in_nm);
 
     dbgmsg("exiting init_positions");
 }
 
+OpenMM::Vec3 SystemTopology::parked_position(const int idx) const {
+    // Far away from the system and never on top of each other; the anchors
+    // are not coplanar so that the unused torsions are well defined
+    const OpenMM::Vec3 origin(-10.0, -10.0, -10.0);
+    const int anchor = idx - __slot_begin - __slot_size;
+
+    switch (anchor) {
+        case 0:
+            return origin;
+        case 1:
+            return origin + OpenMM::Vec3(0.15, 0.0, 0.0);
+        case 2:
+            return origin + OpenMM::Vec3(0.15, 0.15, 0.0);
+        case 3:
+            return origin + OpenMM::Vec3(0.15, 0.15, 0.15);
+        default:
+            return origin +
+                   OpenMM::Vec3(0.0, 0.0, 0.5 * (idx - __slot_begin + 1));
+    }
+}
+
+vector<int> SystemTopology::slot_bonded_particles() const {
+    vector<int> result;
+    int p[4];
+    double d[3];
+
+    for (int i = __slot_bond_idx; i < __slot_bond_idx + __slot_bonds; ++i) {
+        bondStretch->getBondParameters(i, p[0], p[1], d[0], d[1]);
+        result.insert(result.end(), p, p + 2);
+    }
+    for (int i = __slot_angle_idx; i < __slot_angle_idx + __slot_angles;
+         ++i) {
+        bondBend->getAngleParameters(i, p[0], p[1], p[2], d[0], d[1]);
+        result.insert(result.end(), p, p + 3);
+    }
+    for (int i = __slot_torsion_idx;
+         i < __slot_torsion_idx + __slot_torsions; ++i) {
+        int periodicity;
+        bondTorsion->getTorsionParameters(i, p[0], p[1], p[2], p[3],
+                                          periodicity, d[0], d[1]);
+        result.insert(result.end(), p, p + 4);
+    }
+
+    return result;
+}
+
+void SystemTopology::reserve_ligand(const Topology& topology) {
+    if (system != nullptr)
+        throw Error("die : ligand slot must be reserved before the system "
+                    "is initialized");
+
+    int torsions = 0;
+    for (auto dihedrals : {&topology.dihedrals, &topology.impropers}) {
+        const bool improper = dihedrals == &topology.impropers;
+        for (auto& dihedral : *dihedrals) {
+            const auto types = get_term_types(
+                topology, {get<0>(dihedral), get<1>(dihedral),
+                           get<2>(dihedral), get<3>(dihedral)});
+            try {
+                torsions += improper ? __ffield->get_improper_type(
+                                           types[0], types[1], types[2],
+                                           types[3]).size()
+                                     : __ffield->get_dihedral_type(
+                                           types[0], types[1], types[2],
+                                           types[3]).size();
+            } catch (ParameterError& e) {
+                // skipped by set_ligand as well
+            }
+        }
+    }
+
+    __slot_size = max(__slot_size, static_cast<int>(topology.atoms.size()));
+    __slot_bonds = max(__slot_bonds, static_cast<int>(topology.bonds.size()));
+    __slot_angles =
+        max(__slot_angles, static_cast<int>(topology.angles.size()));
+    __slot_torsions = max(__slot_torsions, torsions);
+
+    for (auto& patom : topology.atoms)
+        __slot_idatm_types.insert(patom->idatm_type());
+
+    dbgmsg("ligand slot has " << __slot_size << " atoms " << __slot_bonds
+                              << " bonds " << __slot_angles << " angles "
+                              << __slot_torsions << " torsions");
+}
+
+void SystemTopology::set_ligand(const Topology& topology) {
+    const int size = topology.atoms.size() - __slot_begin;
+    const int anchor = __slot_begin + __slot_size;
+
+    if (size > __slot_size)
+        throw Error("die : ligand does not fit into the reserved slot");
+
+    // Particles
+    for (int i = __slot_begin; i < anchor; ++i) {
+        const bool used = i - __slot_begin < size;
+        double mass = 0.0;
+
+        if (used) {
+            const molib::Atom& atom = *topology.atoms[i];
+            const ForceField::AtomType& atype =
+                __ffield->get_atom_type(topology.get_type(atom));
+            mass = atype.mass;
+
+            if (forcefield != nullptr) {
+                if (!__idatm_to_internal.count(atom.idatm_type()))
+                    throw Error("die : atom type of ligand atom " +
+                                std::to_string(atom.atom_number()) +
+                                " was not reserved in the slot");
+                forcefield->setParticleParameters(
+                    i, {static_cast<double>(
+                           __idatm_to_internal.at(atom.idatm_type()))});
+            }
+            if (nonbond != nullptr)
+                nonbond->setParticleParameters(i, atype.charge, atype.sigma,
+                                               atype.epsilon);
+        } else {
+            if (forcefield != nullptr)
+                forcefield->setParticleParameters(
+                    i, {static_cast<double>(__dummy_type)});
+            if (nonbond != nullptr)
+                nonbond->setParticleParameters(i, 0.0, 1.0, 0.0);
+        }
+
+        system->setParticleMass(i, mass);
+        masses[i] = mass;
+        masked[i] = !used;
+
+        bondStretchData[i].clear();
+        bondBendData[i].clear();
+        bondTorsionData[i].clear();
+    }
+
+    // Bond separation of ligand atoms, -1 if further apart than four bonds
+    vector<vector<int>> neighbors(size);
+    for (auto& bond : topology.bonds) {
+        const int idx1 = topology.get_index(*bond.first) - __slot_begin;
+        const int idx2 = topology.get_index(*bond.second) - __slot_begin;
+        if (idx1 < 0 || idx2 < 0) continue;
+        neighbors[idx1].push_back(idx2);
+        neighbors[idx2].push_back(idx1);
+    }
+
+    vector<vector<int>> separation(size, vector<int>(size, -1));
+    for (int i = 0; i < size; ++i) {
+        separation[i][i] = 0;
+        vector<int> shell{i};
+        for (int depth = 1; depth <= 4 && !shell.empty(); ++depth) {
+            vector<int> next;
+            for (auto j : shell) {
+                for (auto k : neighbors[j]) {
+                    if (separation[i][k] == -1) {
+                        separation[i][k] = depth;
+                        next.push_back(k);
+                    }
+                }
+            }
+            shell.swap(next);
+        }
+    }
+
+    // Nonbonded interactions within the ligand, mirroring the exclusions
+    // and 1-4 scaling that init_*_force derive from the bonds
+    int pair_idx = 0;
+    for (int i = 0; i < __slot_size; ++i) {
+        for (int j = i + 1; j < __slot_size; ++j, ++pair_idx) {
+            const int sep = i < size && j < size ? separation[i][j] : 0;
+            const int idx1 = __slot_begin + i, idx2 = __slot_begin + j;
+
+            if (forcefield != nullptr) {
+                vector<double> types(2, __dummy_type);
+                if (sep == -1) {
+                    types[0] = __idatm_to_internal.at(
+                        topology.atoms[idx1]->idatm_type());
+                    types[1] = __idatm_to_internal.at(
+                        topology.atoms[idx2]->idatm_type());
+                }
+                slot_pairs->setBondParameters(pair_idx, idx1, idx2, types);
+            } else if (nonbond != nullptr) {
+                // as in createExceptionsFromBonds, 1-2 and 1-3 pairs are
+                // excluded, 1-4 pairs scaled and all others kept in full
+                vector<double> params{0.0, 1.0, 0.0};
+                if (sep == -1 || sep == 3 || sep == 4) {
+                    double charge1, sigma1, epsilon1, charge2, sigma2, epsilon2;
+                    nonbond->getParticleParameters(idx1, charge1, sigma1,
+                                                   epsilon1);
+                    nonbond->getParticleParameters(idx2, charge2, sigma2,
+                                                   epsilon2);
+                    params = {charge1 * charge2, (sigma1 + sigma2) / 2,
+                              sqrt(epsilon1 * epsilon2)};
+                    if (sep == 3) {
+                        params[0] *= __ffield->coulomb14scale;
+                        params[2] *= __ffield->lj14scale;
+                    }
+                }
+                slot_pairs->setBondParameters(pair_idx, idx1, idx2, params);
+            }
+        }
+    }
+
+    // Bonded terms of the ligand, the remaining ones are parked on the
+    // anchors
+    const vector<int> bonded_particles = slot_bonded_particles();
+    int force_idx = __slot_bond_idx;
+    for (auto& bond : topology.bonds) {
+        const molib::Atom& atom1 = *bond.first;
+        const molib::Atom& atom2 = *bond.second;
+        const int idx1 = topology.get_index(atom1);
+        const int idx2 = topology.get_index(atom2);
+        if (idx1 < __slot_begin) continue;
+
+        if (force_idx == __slot_bond_idx + __slot_bonds)
+            throw Error("die : ligand bonds do not fit into the reserved slot");
+
+        const ForceField::BondType btype =
+            get_bond_type(topology, atom1, atom2);
+        bondStretch->setBondParameters(force_idx, idx1, idx2, btype.length,
+                                       btype.k);
+        for (auto idx : {idx1, idx2})
+            bondStretchData[idx].push_back(ForceData{
+                force_idx, idx1, idx2, 0, 0, btype.length, 0, 0, 0, btype.k});
+        ++force_idx;
+    }
+    for (; force_idx < __slot_bond_idx + __slot_bonds; ++force_idx)
+        bondStretch->setBondParameters(force_idx, anchor, anchor + 1, 0.1,
+                                       0.0);
+
+    force_idx = __slot_angle_idx;
+    for (auto& angle : topology.angles) {
+        const molib::Atom& atom1 = *get<0>(angle);
+        const molib::Atom& atom2 = *get<1>(angle);
+        const molib::Atom& atom3 = *get<2>(angle);
+        const int idx1 = topology.get_index(atom1);
+        const int idx2 = topology.get_index(atom2);
+        const int idx3 = topology.get_index(atom3);
+        if (idx1 < __slot_begin) continue;
+
+        if (force_idx == __slot_angle_idx + __slot_angles)
+            throw Error(
+                "die : ligand angles do not fit into the reserved slot");
+
+        const ForceField::AngleType atype =
+            get_angle_type(topology, atom1, atom2, atom3);
+        bondBend->setAngleParameters(force_idx, idx1, idx2, idx3, atype.angle,
+                                     atype.k);
+        for (auto idx : {idx1, idx2, idx3})
+            bondBendData[idx].push_back(ForceData{
+                force_idx, idx1, idx2, idx3, 0, 0, atype.angle, 0, 0, atype.k});
+        ++force_idx;
+    }
+    for (; force_idx < __slot_angle_idx + __slot_angles; ++force_idx)
+        bondBend->setAngleParameters(force_idx, anchor, anchor + 1, anchor + 2,
+                                     M_PI / 2, 0.0);
+
+    force_idx = __slot_torsion_idx;
+    for (auto dihedrals : {&topology.dihedrals, &topology.impropers}) {
+        const bool improper = dihedrals == &topology.impropers;
+
+        for (auto& dihedral : *dihedrals) {
+            const molib::Atom& atom1 = *get<0>(dihedral);
+            const molib::Atom& atom2 = *get<1>(dihedral);
+            const molib::Atom& atom3 = *get<2>(dihedral);
+            const molib::Atom& atom4 = *get<3>(dihedral);
+            const int idx1 = topology.get_index(atom1);
+            const int idx2 = topology.get_index(atom2);
+            const int idx3 = topology.get_index(atom3);
+            const int idx4 = topology.get_index(atom4);
+            if (idx1 < __slot_begin) continue;
+
+            for (auto& ttype : get_torsion_types(topology, atom1, atom2,
+                                                 atom3, atom4, improper)) {
+                if (force_idx == __slot_torsion_idx + __slot_torsions)
+                    throw Error(
+                        "die : ligand torsions do not fit into the reserved "
+                        "slot");
+
+                bondTorsion->setTorsionParameters(
+                    force_idx, idx1, idx2, idx3, idx4, ttype.periodicity,
+                    ttype.phase, ttype.k);
+                for (auto idx : {idx1, idx2, idx3, idx4})
+                    bondTorsionData[idx].push_back(
+                        ForceData{force_idx, idx1, idx2, idx3, idx4, 0, 0,
+                                  ttype.periodicity, ttype.phase, ttype.k});
+                ++force_idx;
+            }
+        }
+    }
+    for (; force_idx < __slot_torsion_idx + __slot_torsions; ++force_idx)
+        bondTorsion->setTorsionParameters(force_idx, anchor, anchor + 1,
+                                          anchor + 2, anchor + 3, 1, 0.0, 0.0);
+
+    // updateParametersInContext cannot move bonded terms onto other
+    // particles, so a ligand with other bonds, angles or torsions than the
+    // previous one needs the context to be rebuilt from the system. Its
+    // positions and velocities are kept.
+    if (slot_bonded_particles() != bonded_particles) {
+        dbgmsg("bonded terms of the ligand slot moved, reinitializing context");
+        context->reinitialize(true);
+        return;
+    }
+
+    if (forcefield != nullptr) forcefield->updateParametersInContext(*context);
+    if (nonbond != nullptr) nonbond->updateParametersInContext(*context);
+    if (slot_pairs != nullptr) slot_pairs->updateParametersInContext(*context);
+    bondStretch->updateParametersInContext(*context);
+    bondBend->updateParametersInContext(*context);
+    bondTorsion->updateParametersInContext(*context);
+}
+
 geometry::Point::Vec SystemTopology::get_positions_in_nm() {
     // The true parameter is to enforce Periodic Boundary Conditions
     auto positions_in_nm =
@@ -979,6 +1377,11 @@ double SystemTopology::get_potential_energy() {
     return context->getState(OpenMM::State::Energy, true).getPotentialEnergy();
 }
 
+double SystemTopology::get_potential_energy(const int group) {
+    return context->getState(OpenMM::State::Energy, true, 1u << group)
+        .getPotentialEnergy();
+}
+
 double SystemTopology::get_kinetic_energy() {
     return context->getState(OpenMM::State::Energy, true).getKineticEnergy();
 }
@@ -1029,45 +1432,74 @@ void SystemTopology::dynamics(const int steps) {
     cerr << "Time taken by function: " << length.count() << " seconds\n";
 
     print_energies();
-    save_checkpoint();
+
+    __steps_since_checkpoint += steps;
+}
+
+bool SystemTopology::checkpoint_due() const {
+    const double seconds_since_checkpoint =
+        duration_cast<duration<double>>(steady_clock::now() -
+                                        __last_checkpoint)
+            .count();
+
+    return __checkpoint_policy.is_due(__steps_since_checkpoint,
+                                      seconds_since_checkpoint);
+}
+
+void SystemTopology::checkpoint_if_due() {
+    if (checkpoint_due()) save_checkpoint();
 }
 
 void SystemTopology::load_checkpoint(const std :: string & checkpoint) {
     try {
-        ifstream file(checkpoint, ios::in | ios::binary);
-        if(file.is_open()){
+        if (is_legacy_checkpoint(checkpoint)) {
+            ifstream file(checkpoint, ios::in | ios::binary);
             context->loadCheckpoint(file);
-            file.close();
-        }
-        else {
-            cerr << "Error could not open file: " << checkpoint << endl;
-            exit(1);
+            return;
         }
+        string state, progress;
+        read_checkpoint(checkpoint, state, progress);
+        istringstream file(state, ios::in | ios::binary);
+        context->loadCheckpoint(file);
     } catch (const std::exception& e) {
         log_error << "Checkpoint failed to load " << e.what() << endl;
         exit(1);
     }
 }
 
+void SystemTopology::set_checkpoint_policy(const CheckpointPolicy& policy) {
+    if (policy.step_interval < 0 || policy.time_interval < 0)
+        throw Error("die : checkpoint intervals cannot be negative");
+
+    __checkpoint_policy = policy;
+}
+
 void SystemTopology::save_checkpoint() {
-    string checkpoint = "checkpoint" + to_string(checkpoint_num % num_checkpoints) + ".chk";
+    string checkpoint =
+        "checkpoint" + to_string(checkpoint_num % num_checkpoints) + ".chk";
     cerr << "Writing checkpoint to file " << checkpoint << endl;
-    ofstream file(checkpoint, ios::out | ios::binary | ios::trunc);
-    context->createCheckpoint(file);
-    file.close();
-}
 
-void SystemTopology::save_checkpoint_candock(int x, int y)
-{
-    string checkpoint = "checkpoint" + to_string(checkpoint_num % num_checkpoints) + ".chk_candock";
-    ofstream file(checkpoint, ios::out | ios::trunc);
-    file << x;
-    file << "\n";
-    file << y;
+    // serializing to memory is cheap, the disk is left to the writer thread
+    ostringstream snapshot(ios::out | ios::binary);
+    context->createCheckpoint(snapshot);
+
+    if (!__checkpoint_writer)
+        __checkpoint_writer.reset(new CheckpointWriter());
+    __checkpoint_writer->write(checkpoint, snapshot.str(),
+                               __checkpoint_progress);
+
     checkpoint_num++;
-    file.close();
+    __steps_since_checkpoint = 0;
+    __last_checkpoint = steady_clock::now();
+}
+
+void SystemTopology::set_checkpoint_progress(const string& progress) {
+    __checkpoint_progress = progress;
 }
 
+void SystemTopology::flush_checkpoints() {
+    if (__checkpoint_writer) __checkpoint_writer->flush();
+}
 
 }  // namespace OMMIface
 }  // namespace statchem
@@ -81,6 +81,23 @@ int Topology::get_index(const molib::Atom& atom) const {
     return atom_to_index.at(&atom);
 }
 
+std::vector<int> Topology::get_indices(const molib::Atom::Vec& atoms) const {
+    std::vector<int> indices;
+    indices.reserve(atoms.size());
+
+    // Atoms are mostly given as they were added, a molecule at a time, and
+    // are then found one after the other without looking up each of them
+    size_t pos = 0;
+    for (auto& patom : atoms) {
+        if (pos >= this->atoms.size() || this->atoms[pos] != patom)
+            pos = get_index(*patom) - first_index;
+        indices.push_back(first_index + pos);
+        ++pos;
+    }
+
+    return indices;
+}
+
 int Topology::get_type(const molib::Atom& atom) const {
     if (!atom_to_type.count(&atom)) {
         log_error << "Problem with atom type: " << atom << endl;
@@ -91,7 +108,7 @@ int Topology::get_type(const molib::Atom& atom) const {
 
 Topology& Topology::add_topology(const molib::Atom::Vec& atoms,
                                  const ForceField& ffield) {
-    int sz = this->atoms.size();
+    int sz = first_index + this->atoms.size();
     this->atoms.insert(this->atoms.end(), atoms.begin(), atoms.end());
 
     // residue topology
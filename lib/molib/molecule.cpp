@@ -80,20 +80,17 @@ void Molecule::change_residue_name(std::mutex& mtx, int& ligand_cnt) {
     }
 }
 
-Atom* get_closest_atom_of(const Atom& atom1, const Atom::Vec& neighbors,
-                          const string& atom_name) {
-    double min_dist = HUGE_VAL;
+Atom* get_closest_atom_of(const Atom& atom1, const Atom::Grid& grid,
+                          const double dist, const string& atom_name) {
+    double min_dist_sq = HUGE_VAL;
     Atom* patom2 = nullptr;
-    for (auto& pa : neighbors) {
+    grid.for_each_neighbor(atom1.crd(), dist, [&](Atom* pa, double d_sq) {
         //~ if (!atom1.is_adjacent(*pa) && pa->atom_name() == atom_name) {
-        if (pa->atom_name() == atom_name) {
-            double d = atom1.crd().distance(pa->crd());
-            if (d < min_dist) {
-                min_dist = d;
-                patom2 = pa;
-            }
+        if (pa->atom_name() == atom_name && d_sq < min_dist_sq) {
+            min_dist_sq = d_sq;
+            patom2 = pa;
         }
-    }
+    });
     return patom2;
 }
 
@@ -320,23 +317,20 @@ void Molecule::prepare_for_mm(const OMMIface::ForceField& ffield,
             dbgmsg("neighbors of atom " << atom1.atom_name() << " "
                                         << atom1.atom_number() << " "
                                         << atom1.crd() << " are : ");
-            for (auto& patom2 : grid.get_neighbors(atom1.crd(), 1.6)) {
+            grid.for_each_neighbor(atom1.crd(), 1.6, [](Atom* patom2, double) {
                 auto& atom2 = *patom2;
                 dbgmsg("    neighbor : " << atom2.atom_name() << " "
                                          << atom2.atom_number() << " "
                                          << atom2.crd());
-            }
+            });
         }
 #endif
         if (atom1.atom_name() == "SG") {
-            patom2 = get_closest_atom_of(
-                atom1, grid.get_neighbors(atom1.crd(), 2.5), "SG");
+            patom2 = get_closest_atom_of(atom1, grid, 2.5, "SG");
         } else if (atom1.atom_name() == "N") {
-            patom2 = get_closest_atom_of(
-                atom1, grid.get_neighbors(atom1.crd(), 1.4), "C");
+            patom2 = get_closest_atom_of(atom1, grid, 1.4, "C");
         } else if (atom1.atom_name() == "O3'") {
-            patom2 = get_closest_atom_of(
-                atom1, grid.get_neighbors(atom1.crd(), 1.7), "P");
+            patom2 = get_closest_atom_of(atom1, grid, 1.7, "P");
         }
         if (patom2) {
             auto& atom2 = *patom2;
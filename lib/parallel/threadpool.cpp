@@ -0,0 +1,212 @@
+/* This is threadpool.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/parallel/threadpool.hpp"
+#include <algorithm>
+#include <exception>
+#include "statchem/helper/logger.hpp"
+
+namespace statchem {
+namespace parallel {
+
+struct ThreadPool::Job {
+    const std::function<void(size_t)>* fn;
+    size_t remaining;  // chunks not finished yet, guarded by mtx
+    std::mutex mtx;
+    std::condition_variable done;
+    std::exception_ptr error;
+};
+
+namespace {
+// Pool and worker id of the current thread, to let nested parallel_for
+// calls help instead of blocking a worker
+thread_local const ThreadPool* current_pool = nullptr;
+thread_local size_t current_worker = 0;
+}
+
+ThreadPool::ThreadPool(const size_t num_threads) : __pending(0), __stop(false) {
+    const size_t nthreads =
+        num_threads > 0
+            ? num_threads
+            : std::max<size_t>(1, std::thread::hardware_concurrency());
+
+    for (size_t id = 0; id < nthreads; ++id) {
+        __workers.emplace_back(new Worker);
+    }
+    for (size_t id = 0; id < nthreads; ++id) {
+        __workers[id]->thread = std::thread([this, id] { __work(id); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(__sleep_mtx);
+        __stop = true;
+    }
+    __wake.notify_all();
+    for (auto& worker : __workers) {
+        worker->thread.join();
+    }
+}
+
+bool ThreadPool::__pop(const size_t id, Task& task) {
+    Worker& worker = *__workers[id];
+    std::lock_guard<std::mutex> lock(worker.mtx);
+    if (worker.tasks.empty()) return false;
+    task = worker.tasks.back();
+    worker.tasks.pop_back();
+    --__pending;
+    return true;
+}
+
+bool ThreadPool::__steal(const size_t id, Task& task) {
+    for (size_t offset = 1; offset < __workers.size(); ++offset) {
+        Worker& victim = *__workers[(id + offset) % __workers.size()];
+        std::lock_guard<std::mutex> lock(victim.mtx);
+        if (victim.tasks.empty()) continue;
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        --__pending;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::__run(const size_t id, const Task& task, const bool stolen) {
+    Job& job = *task.job;
+    ThreadStats& stats = __workers[id]->stats;
+    Benchmark bench;
+
+    try {
+        for (size_t i = task.begin; i < task.end; ++i) {
+            (*job.fn)(i);
+        }
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(job.mtx);
+        if (!job.error) job.error = std::current_exception();
+    }
+
+    stats.busy_seconds += bench.seconds_from_start();
+    stats.items += task.end - task.begin;
+    stats.chunks += 1;
+    stats.stolen += stolen ? 1 : 0;
+
+    std::lock_guard<std::mutex> lock(job.mtx);
+    if (--job.remaining == 0) job.done.notify_all();
+}
+
+void ThreadPool::__work(const size_t id) {
+    current_pool = this;
+    current_worker = id;
+
+    while (true) {
+        Task task;
+        if (__pop(id, task)) {
+            __run(id, task, false);
+            continue;
+        }
+        if (__steal(id, task)) {
+            __run(id, task, true);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(__sleep_mtx);
+        __wake.wait(lock, [this] { return __stop || __pending > 0; });
+        if (__stop && __pending == 0) return;
+    }
+}
+
+void ThreadPool::parallel_for(const size_t begin, const size_t end,
+                              const std::function<void(size_t)>& fn,
+                              const size_t chunk_size) {
+    if (begin >= end) return;
+
+    const size_t n = end - begin;
+    const size_t chunk =
+        chunk_size > 0 ? chunk_size : std::max<size_t>(1, n / (8 * size()));
+
+    Job job;
+    job.fn = &fn;
+    job.remaining = (n + chunk - 1) / chunk;
+
+    // count the chunks before they become visible, so a concurrent pop never
+    // takes __pending below zero
+    {
+        std::lock_guard<std::mutex> lock(__sleep_mtx);
+        __pending += job.remaining;
+    }
+
+    // deal consecutive chunks round-robin, so each deque starts with work
+    // spread over the whole range
+    size_t k = 0;
+    for (size_t first = begin; first < end; first += chunk, ++k) {
+        Worker& worker = *__workers[k % size()];
+        std::lock_guard<std::mutex> lock(worker.mtx);
+        worker.tasks.push_front(
+            Task{&job, first, std::min(end, first + chunk)});
+    }
+    __wake.notify_all();
+
+    if (current_pool == this) {
+        // a worker waiting for a nested loop keeps working meanwhile
+        const size_t id = current_worker;
+        while (true) {
+            {
+                std::lock_guard<std::mutex> lock(job.mtx);
+                if (job.remaining == 0) break;
+            }
+            Task task;
+            if (__pop(id, task)) {
+                __run(id, task, false);
+            } else if (__steal(id, task)) {
+                __run(id, task, true);
+            } else {
+                std::this_thread::yield();
+            }
+        }
+    } else {
+        std::unique_lock<std::mutex> lock(job.mtx);
+        job.done.wait(lock, [&job] { return job.remaining == 0; });
+    }
+
+    if (job.error) std::rethrow_exception(job.error);
+}
+
+std::vector<ThreadPool::ThreadStats> ThreadPool::get_stats() const {
+    std::vector<ThreadStats> stats;
+    for (auto& worker : __workers) stats.push_back(worker->stats);
+    return stats;
+}
+
+void ThreadPool::reset_stats() {
+    for (auto& worker : __workers) worker->stats = ThreadStats();
+    __since.reset();
+}
+
+void ThreadPool::log_stats(const std::string& what) const {
+    const double wall = __since.seconds_from_start();
+    for (size_t id = 0; id < __workers.size(); ++id) {
+        const ThreadStats& stats = __workers[id]->stats;
+        log_benchmark << what << " : thread " << id << " ran " << stats.items
+                      << " items in " << stats.chunks << " chunks ("
+                      << stats.stolen << " stolen), busy "
+                      << stats.busy_seconds << " of " << wall
+                      << " wallclock seconds ("
+                      << (wall > 0 ? 100.0 * stats.busy_seconds / wall : 0.0)
+                      << "%)\n";
+    }
+}
+}
+}
@@ -26,6 +26,7 @@
 #include "statchem/helper/debug.hpp"
 #include "statchem/helper/help.hpp"
 #include "statchem/fileio/inout.hpp"
+#include "statchem/fileio/xzfile.hpp"
 #include "statchem/molib/bond.hpp"
 #include "statchem/molib/nrset.hpp"
 
@@ -41,6 +42,16 @@ bool FileParser::parse_molecule(Molecules& mols) {
     return !mols.empty();
 }
 
+bool FileParser::parse_next_molecule(Molecules& mols) {
+    return p->parse_next_molecule(mols);
+}
+
+bool FileParser::parse_molecule(Molecules& mols, parallel::ThreadPool& pool) {
+    p->parse_molecule(mols, pool);
+    dbgmsg("PARSED MOLECULES : " << endl << mols);
+    return !mols.empty();
+}
+
 Molecules FileParser::parse_molecule() {
     Molecules mols;
     p->parse_molecule(mols);
@@ -75,10 +86,41 @@ void FileParser::prepare_parser(const string& molecule_file, unsigned int hm,
     string extension = molecule_file.substr(ret + 1);
     transform(extension.begin(), extension.end(), extension.begin(), ::toupper);
 
-    std::shared_ptr<istream> temp_molecule_stream =
-        std::make_shared<ifstream>(molecule_file, std::ios::in);
+    // compressed files, e.g. ligands.mol2.xz, are decompressed on the fly
+    const bool compressed = extension == "XZ";
+
+    if (compressed) {
+        const auto ret2 =
+            ret == 0 ? string::npos : molecule_file.find_last_of(".", ret - 1);
+
+        if (ret2 == string::npos) {
+            throw Error(
+                "die : could not determine the file type of the input "
+                "molecule");
+        }
+
+        extension = molecule_file.substr(ret2 + 1, ret - ret2 - 1);
+        transform(extension.begin(), extension.end(), extension.begin(),
+                  ::toupper);
+    }
+
+    std::shared_ptr<istream> temp_molecule_stream;
+    if (compressed) {
+        temp_molecule_stream =
+            std::make_shared<fileio::XzIfstream>(molecule_file);
+    } else if (extension == "STCH") {
+        temp_molecule_stream = std::make_shared<ifstream>(
+            molecule_file, std::ios::in | std::ios::binary);
+    } else {
+        temp_molecule_stream =
+            std::make_shared<ifstream>(molecule_file, std::ios::in);
+    }
 
     prepare_parser(temp_molecule_stream, extension, hm, num_occur);
+
+    if (!compressed) {
+        p->map_file(molecule_file);
+    }
 }
 
 void FileParser::prepare_parser(std::shared_ptr<std::istream>& stream,
@@ -99,6 +141,9 @@ void FileParser::prepare_parser(std::shared_ptr<std::istream>& stream,
     } else if (extension == "MOL2") {
         p = std::unique_ptr<Parser>(
             new Mol2Parser(*molecule_stream, hm, num_occur));
+    } else if (extension == "STCH") {
+        p = std::unique_ptr<Parser>(
+            new StchParser(*molecule_stream, hm, num_occur));
     } else {
         throw Error(
             "die : could not determine the file type of the input molecule");
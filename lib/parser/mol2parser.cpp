@@ -16,6 +16,10 @@
 #include "statchem/helper/help.hpp"
 #include "statchem/parser/fileparser.hpp"
 #include "statchem/fileio/inout.hpp"
+#include "statchem/fileio/mappedfile.hpp"
+
+#include <cstring>
+#include <memory>
 
 using namespace std;
 using namespace statchem::molib;
@@ -29,6 +33,82 @@ void FileParser::Mol2Parser::parse_molecule(Molecules& mols) {
         fileio::read_stream(__stream, mol2_raw, __num_occur,
                            "@<TRIPOS>MOLECULE");
     }
+    __parse_lines(mols, mol2_raw);
+}
+
+void FileParser::Mol2Parser::parse_molecule(Molecules& mols,
+                                            parallel::ThreadPool& pool) {
+    if (__mapped_file.empty() || __num_occur != -1) {
+        parse_molecule(mols);
+        return;
+    }
+
+    std::lock_guard<std::mutex> gaurd(__concurrent_read_mtx);
+    const fileio::MappedFile file(__mapped_file);
+    size_t offset;
+    if (!__mapped_offset(file.size(), offset)) {
+        return;
+    }
+    __stream.seekg(0, std::ios::end);
+    const char* const data = file.data() + offset;
+    const char* const end = data + file.size();
+
+    // a single scan for the lines opening a molecule; anything before the
+    // second one belongs to the first block, as in parse_next_molecule
+    static const char tag[] = "@<TRIPOS>MOLECULE";
+    const size_t tag_size = sizeof(tag) - 1;
+    vector<const char*> block_start{data};
+    bool first_tag = true;
+    for (const char* pos = data;
+         (pos = static_cast<const char*>(
+              memchr(pos, '@', static_cast<size_t>(end - pos)))) != nullptr;
+         ++pos) {
+        if (static_cast<size_t>(end - pos) < tag_size ||
+            memcmp(pos, tag, tag_size) != 0) {
+            continue;
+        }
+        if (first_tag) {
+            first_tag = false;
+            continue;
+        }
+        const char* line_start = pos;
+        while (line_start != data && line_start[-1] != '\n') --line_start;
+        block_start.push_back(line_start);
+    }
+    block_start.push_back(end);
+
+    const size_t num_blocks = block_start.size() - 1;
+    vector<unique_ptr<Molecules>> parsed(num_blocks);
+
+    pool.parallel_for(0, num_blocks, [&](size_t b) {
+        // split the block like std::getline would
+        vector<string> lines;
+        for (const char* pos = block_start[b]; pos != block_start[b + 1];) {
+            const char* eol = static_cast<const char*>(memchr(
+                pos, '\n', static_cast<size_t>(block_start[b + 1] - pos)));
+            if (eol == nullptr) eol = block_start[b + 1];
+            lines.emplace_back(pos, eol);
+            pos = eol == block_start[b + 1] ? eol : eol + 1;
+        }
+
+        parsed[b].reset(new Molecules);
+        __parse_lines(*parsed[b], lines);
+    });
+
+    for (auto& block : parsed) {
+        const int num_molecules = static_cast<int>(block->size());
+        for (int i = 0; i < num_molecules; ++i) {
+            mols.add(block->release(i).release());
+        }
+    }
+}
+
+bool FileParser::Mol2Parser::__starts_molecule(const string& line) const {
+    return line.find("@<TRIPOS>MOLECULE") != string::npos;
+}
+
+bool FileParser::Mol2Parser::__parse_lines(Molecules& mols,
+                                           const vector<string>& mol2_raw) {
     bool found_molecule = false, found_assembly = false, found_model = false;
     map<const Model*, map<const int, Atom*>> atom_number_to_atom;
 
@@ -166,6 +246,8 @@ void FileParser::Mol2Parser::parse_molecule(Molecules& mols) {
             --i;
         }
     }
+
+    return false;
 }
 }
 }
@@ -59,6 +59,62 @@ void Parser::__generate_model(Molecules& mols, bool& found_model,
     }
 }
 
+bool Parser::__read_block() {
+    __block.clear();
+    bool in_molecule = false;
+
+    if (__has_lookahead) {
+        __block.push_back(std::move(__lookahead));
+        __has_lookahead = false;
+        in_molecule = true;
+    }
+
+    std::string line;
+    while (std::getline(__stream, line)) {
+        if (__starts_molecule(line)) {
+            if (in_molecule) {
+                __lookahead = std::move(line);
+                __has_lookahead = true;
+                break;
+            }
+            in_molecule = true;
+        }
+        __block.push_back(std::move(line));
+    }
+
+    return !__block.empty();
+}
+
+void Parser::parse_molecule(Molecules& mols, parallel::ThreadPool&) {
+    parse_molecule(mols);
+}
+
+bool Parser::parse_next_molecule(Molecules& mols) {
+    std::lock_guard<std::mutex> guard(__concurrent_read_mtx);
+    const size_t num_molecules = mols.size();
+
+    // blocks holding only header records add no molecule, keep reading
+    while (!__exhausted && mols.size() == num_molecules) {
+        if (!__read_block()) {
+            __exhausted = true;
+            break;
+        }
+        __exhausted = __parse_lines(mols, __block);
+    }
+
+    return mols.size() != num_molecules;
+}
+
+bool Parser::__mapped_offset(const size_t file_size, size_t& offset) {
+    const std::streampos pos = __stream.tellg();
+    if (pos == std::streampos(-1) ||
+        static_cast<size_t>(pos) >= file_size) {
+        return false;
+    }
+    offset = static_cast<size_t>(pos);
+    return true;
+}
+
 void Parser::set_pos(std::streampos pos) { __stream.seekg(pos); }
 
 void Parser::set_hm(unsigned int hm) { __hm = hm; }
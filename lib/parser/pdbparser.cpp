@@ -16,13 +16,20 @@
 #include "statchem/helper/help.hpp"
 #include "statchem/parser/fileparser.hpp"
 #include "statchem/fileio/inout.hpp"
+#include "statchem/fileio/mappedfile.hpp"
 
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <boost/filesystem.hpp>
+#include <boost/utility/string_view.hpp>
 #include <regex>
 #include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
 
 using namespace std;
 using namespace statchem::molib;
@@ -30,15 +37,132 @@ using namespace statchem::molib;
 namespace statchem {
 namespace parser {
 
+namespace {
+typedef boost::string_view Line;
+
+// Splits a buffer into lines the way std::getline does
+class LineViews {
+    const char* __begin;
+    const char* __end;
+
+   public:
+    class iterator {
+        const char* __pos;
+        const char* __eol;
+        const char* __end;
+        void __find_eol() {
+            __eol = static_cast<const char*>(
+                memchr(__pos, '\n', static_cast<size_t>(__end - __pos)));
+            if (__eol == nullptr) __eol = __end;
+        }
+
+       public:
+        iterator(const char* pos, const char* end) : __pos(pos), __end(end) {
+            __find_eol();
+        }
+        Line operator*() const {
+            return Line(__pos, static_cast<size_t>(__eol - __pos));
+        }
+        iterator& operator++() {
+            __pos = __eol == __end ? __end : __eol + 1;
+            __find_eol();
+            return *this;
+        }
+        bool operator!=(const iterator& rhs) const {
+            return __pos != rhs.__pos;
+        }
+    };
+
+    LineViews(const char* data, const size_t size)
+        : __begin(data), __end(data + size) {}
+    iterator begin() const { return iterator(__begin, __end); }
+    iterator end() const { return iterator(__end, __end); }
+};
+
+Line trim(Line s) {
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.front())))
+        s.remove_prefix(1);
+    while (!s.empty() && std::isspace(static_cast<unsigned char>(s.back())))
+        s.remove_suffix(1);
+    return s;
+}
+
+// The fixed columns of a record are converted in place, with the same
+// results and exceptions as std::stoi and std::stof on a copy of them
+int to_int(const Line s) {
+    char buf[32];
+    const size_t n = std::min(s.size(), sizeof(buf) - 1);
+    memcpy(buf, s.data(), n);
+    buf[n] = '\0';
+
+    char* end;
+    errno = 0;
+    const long value = strtol(buf, &end, 10);
+    if (end == buf) throw std::invalid_argument("stoi");
+    if (errno == ERANGE || value < INT_MIN || value > INT_MAX)
+        throw std::out_of_range("stoi");
+    return static_cast<int>(value);
+}
+
+float to_float(const Line s) {
+    char buf[32];
+    const size_t n = std::min(s.size(), sizeof(buf) - 1);
+    memcpy(buf, s.data(), n);
+    buf[n] = '\0';
+
+    char* end;
+    errno = 0;
+    const float value = strtof(buf, &end);
+    if (end == buf) throw std::invalid_argument("stof");
+    if (errno == ERANGE) throw std::out_of_range("stof");
+    return value;
+}
+}
+
 void FileParser::PdbParser::parse_molecule(Molecules& mols) {
     dbgmsg("num_occur = " << __num_occur);
+
+    if (!__mapped_file.empty() && __num_occur == -1) {
+        std::lock_guard<std::mutex> gaurd(__concurrent_read_mtx);
+        const fileio::MappedFile file(__mapped_file);
+        size_t offset;
+        if (!__mapped_offset(file.size(), offset)) {
+            return;
+        }
+        __parse_records(mols, LineViews(file.data() + offset,
+                                        file.size() - offset));
+        __stream.seekg(0, std::ios::end);
+        return;
+    }
+
     vector<string> pdb_raw;
     {
         std::lock_guard<std::mutex> gaurd(__concurrent_read_mtx);
         fileio::read_stream(__stream, pdb_raw, __num_occur,
                            "REMARK   5 MOLECULE");
     }
-    std::smatch m;
+    __parse_lines(mols, pdb_raw);
+}
+
+bool FileParser::PdbParser::__starts_molecule(const string& line) const {
+    if (line.compare(0, 19, "REMARK   5 MOLECULE") == 0) {
+        return true;
+    }
+
+    // with these options every MODEL is read as a separate molecule
+    return (__hm & (skip_atom | protein_poses_only)) &&
+           line.compare(0, 5, "MODEL") == 0;
+}
+
+bool FileParser::PdbParser::__parse_lines(Molecules& mols,
+                                          const vector<string>& pdb_raw) {
+    return __parse_records(mols, pdb_raw);
+}
+
+template <class Lines>
+bool FileParser::PdbParser::__parse_records(Molecules& mols,
+                                            const Lines& lines) {
+    std::cmatch m;
     set<char> bio_chain;
     int biomolecule_number = -1;
     bool found_molecule = false, found_assembly = false, found_model = false;
@@ -49,7 +173,9 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
 
     char chain_id_replacement = 'z';
 
-    for (string& line : pdb_raw) {
+    for (const auto& raw_line : lines) {
+        const Line line(raw_line);
+
         if (line.compare(0, 4, "ATOM") == 0) {
             ter_found = false;
         }
@@ -75,45 +201,41 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             __generate_molecule(mols, found_molecule, "");
             __generate_assembly(mols, found_assembly, 0, "ASYMMETRIC UNIT");
             __generate_model(mols, found_model, 1);
-            string record_name = boost::algorithm::trim_copy(line.substr(0, 6));
-            int atom_number = stoi(line.substr(6, 5));
+            int atom_number = to_int(line.substr(6, 5));
             dbgmsg("atom_number = " << atom_number);
-            string atom_name = boost::algorithm::trim_copy(line.substr(12, 4));
+            string atom_name = trim(line.substr(12, 4)).to_string();
             char alt_loc = line.at(16);
-            string resn = boost::algorithm::trim_copy(line.substr(17, 3));
+            string resn = trim(line.substr(17, 3)).to_string();
             char chain_id = line.at(21);
 
-            int resi = stoi(line.substr(22, 4));
+            int resi = to_int(line.substr(22, 4));
             char ins_code = line.at(26);
-            double x_coord = stof(line.substr(30, 8));
-            double y_coord = stof(line.substr(38, 8));
-            double z_coord = stof(line.substr(46, 8));
+            double x_coord = to_float(line.substr(30, 8));
+            double y_coord = to_float(line.substr(38, 8));
+            double z_coord = to_float(line.substr(46, 8));
             geometry::Coordinate crd(x_coord, y_coord, z_coord);
             string element =
-                line.size() > 77
-                    ? boost::algorithm::trim_copy(line.substr(76, 2))
+                line.size() > 77 ? trim(line.substr(76, 2)).to_string()
                     : "";
 
             if (element.empty()) {
                 if (std::isdigit(line.at(12))) {
                     element = line.at(13);
                 } else {
-                    element = boost::algorithm::trim_copy(line.substr(12, 2));
+                    element = trim(line.substr(12, 2)).to_string();
                 }
             }
 
             string idatm_type =
-                line.size() > 80
-                    ? boost::algorithm::trim_copy(line.substr(80, 5))
+                line.size() > 80 ? trim(line.substr(80, 5)).to_string()
                     : "???";
             idatm_type =
                 help::idatm_mask.count(idatm_type) ? idatm_type : "???";
             string gaff_type =
-                line.size() > 85
-                    ? boost::algorithm::trim_copy(line.substr(85, 5))
+                line.size() > 85 ? trim(line.substr(85, 5)).to_string()
                     : "???";
             string rest_of_line =
-                line.size() > 90 ? boost::algorithm::trim_copy(line.substr(90))
+                line.size() > 90 ? trim(line.substr(90)).to_string()
                                  : "";
             const bool hydrogen =
                 (element == "H" ||
@@ -200,7 +322,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
         } else if (line.compare(0, 14, "REMARK   4 NRP") == 0) {
             string name = "";
 
-            if (std::regex_search(line, m,
+            if (std::regex_search(line.begin(), line.end(), m,
                                   std::regex("REMARK   4 NRPDB\\s+(.*)"))) {
                 if (m[1].matched) {
                     name = m[1].str();
@@ -212,7 +334,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
         } else if (line.compare(0, 14, "REMARK   5 MOL") == 0) {
             string name = "";
 
-            if (std::regex_search(line, m,
+            if (std::regex_search(line.begin(), line.end(), m,
                                   std::regex("REMARK   5 MOLECULE\\s+(.*)"))) {
                 if (m[1].matched) {
                     name = m[1].str();
@@ -228,7 +350,8 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             string name = "";
 
             if (std::regex_search(
-                    line, m, std::regex("REMARK   6 (\\S+ \\S+)\\s+(\\d+)"))) {
+                    line.begin(), line.end(), m,
+                    std::regex("REMARK   6 (\\S+ \\S+)\\s+(\\d+)"))) {
                 if (m[1].matched && m[2].matched) {
                     name = m[1].str();
                     number = stoi(m[2].str());
@@ -238,7 +361,8 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             found_assembly = false;
             __generate_assembly(mols, found_assembly, number, name);
         } else if (line.compare(0, 5, "MODEL") == 0) {
-            if (std::regex_search(line, m, std::regex("MODEL\\s+(\\d+)"))) {
+            if (std::regex_search(line.begin(), line.end(), m,
+                                  std::regex("MODEL\\s+(\\d+)"))) {
                 if (m[1].matched) {
                     if (__hm & skip_atom || __hm & protein_poses_only) {
                         found_molecule = false;
@@ -261,13 +385,14 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             }
         } else if (line.compare(0, 6, "ENDMDL") == 0) {
             if (__hm & first_model) {
-                return;
+                return true;
             }
         } else if (line.compare(0, 3, "TER") == 0) {
             ter_found = true;
         } else if (line.compare(0, 10, "REMARK 350") == 0) {
             if (std::regex_search(
-                    line, m, std::regex("REMARK 350 BIOMOLECULE:\\s*(\\d+)"))) {
+                    line.begin(), line.end(), m,
+                    std::regex("REMARK 350 BIOMOLECULE:\\s*(\\d+)"))) {
                 if (m[1].matched) {
                     biomolecule_number = stoi(m[1].str());
 
@@ -279,14 +404,14 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
 
                 bio_chain.clear();
             } else if (std::regex_search(
-                           line, m,
+                           line.begin(), line.end(), m,
                            std::regex("REMARK 350 APPLY THE FOLLOWING TO "
                                       "CHAINS:\\s?(\\S{1})?,?\\s?(\\S{1})?,?"
                                       "\\s?(\\S{1})?,?\\s?(\\S{1})?,?\\s?(\\S{"
                                       "1})?,?\\s?(\\S{1})?,?\\s?(\\S{1})?,?\\s?"
                                       "(\\S{1})?,?\\s?(\\S{1})?,?")) ||
                        std::regex_search(
-                           line, m,
+                           line.begin(), line.end(), m,
                            std::regex("REMARK 350                    AND "
                                       "CHAINS:\\s?(\\S{1})?,?\\s?(\\S{1})?,?"
                                       "\\s?(\\S{1})?,?\\s?(\\S{1})?,?\\s?(\\S{"
@@ -302,7 +427,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
                     }
                 }
             } else if (std::regex_search(
-                           line, m,
+                           line.begin(), line.end(), m,
                            std::regex("REMARK 350   "
                                       "BIOMT(\\d+)\\s+(\\d+)\\s+(\\S+)\\s+(\\S+"
                                       ")\\s+(\\S+)\\s+(\\S+)"))) {
@@ -339,12 +464,12 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
                 }
             }
         } else if (line.compare(0, 6, "MODRES") == 0) {
-            string resn = line.substr(24, 3);
+            string resn = line.substr(24, 3).to_string();
 
             if (help::amino_acids.find(resn) != help::amino_acids.end()) {
-                string resn_mod = line.substr(12, 3);
+                string resn_mod = line.substr(12, 3).to_string();
                 char chain_id = line.at(16);
-                int resi = stoi(line.substr(18, 4));
+                int resi = to_int(line.substr(18, 4));
                 char ins_code = line.at(22);
                 __generate_molecule(mols, found_molecule, "");
 
@@ -355,7 +480,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             }
         } else if (line.compare(0, 4, "SITE") == 0 &&
                    std::regex_search(
-                       line, m,
+                       line.begin(), line.end(), m,
                        std::regex("SITE\\s+\\d+\\s+(\\S+)\\s+\\S+(\\s+\\S+\\s?"
                                   "\\S{1}\\s{0,3}\\d{1,4}\\S?)?(\\s+\\S+\\s?"
                                   "\\S{1}\\s{0,3}\\d{1,4}\\S?)?(\\s+\\S+\\s?"
@@ -389,7 +514,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             }
         } else if (line.compare(0, 16, "REMARK   7 ALRES") == 0) {
             // added ALRES since some PDB's (e.g. 1abw) have remark 7
-            string text(line.substr(17));
+            string text(line.substr(17).to_string());
             vector<string> vs = help::ssplit(text, ",");
 
             if (vs.empty()) {
@@ -427,7 +552,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             }
         } else if (line.compare(0, 16, "REMARK   8 RIGID") == 0) {
             Model& model = mols.last().last().last();
-            vector<string> vs = help::ssplit(line.substr(17), " ");
+            vector<string> vs = help::ssplit(line.substr(17).to_string(), " ");
             Atom::Set core, join;
 
             for (size_t i = 1; i < vs.size(); ++i) {
@@ -462,7 +587,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
 #endif
         } else if (line.compare(0, 15, "REMARK   8 ROTA") == 0) {
             Model& model = mols.last().last().last();
-            vector<string> vs = help::ssplit(line.substr(16), " ");
+            vector<string> vs = help::ssplit(line.substr(16).to_string(), " ");
             Atom& a1 = *atom_number_to_atom[&model][stoi(vs[1])];
             Atom& a2 = *atom_number_to_atom[&model][stoi(vs[2])];
             auto b = a1.connect(a2);
@@ -480,7 +605,7 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
                 continue;
             }
 
-            vector<string> vs = help::ssplit(line.substr(20), " ");
+            vector<string> vs = help::ssplit(line.substr(20).to_string(), " ");
 
             // to avoid when bond_gaff_type is undefined
             if (vs.size() == 4) {
@@ -498,7 +623,8 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
                 bond.set_bo(1);
             }
         } else if (line.compare(0, 6, "CONECT") == 0) {
-            const string ln = boost::algorithm::trim_right_copy(line.substr(6));
+            const string ln =
+                boost::algorithm::trim_right_copy(line.substr(6).to_string());
             dbgmsg("--" << ln << "--");
             vector<int> anum;
 
@@ -576,9 +702,11 @@ void FileParser::PdbParser::parse_molecule(Molecules& mols) {
             connect_bonds(get_bonds_in(molecule.get_atoms()));
         } else if (line.compare(0, 21, "REMARK  20 non-binder") == 0 &&
                    (__hm & docked_poses_only)) {
-            return;
+            return true;
         }
     }
+
+    return false;
 }
 }
 }
@@ -0,0 +1,59 @@
+/* This is stchparser.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/fileio/moleculestore.hpp"
+#include "statchem/parser/fileparser.hpp"
+
+using namespace std;
+using namespace statchem::molib;
+
+namespace statchem {
+namespace parser {
+
+// The molecules of the store are typed already, the read options (e.g.
+// hydrogens) were applied when the store was made and are ignored here
+void FileParser::StchParser::__read_header() {
+    if (!__header_read) {
+        fileio::read_molecule_store_header(__stream);
+        __header_read = true;
+    }
+}
+
+void FileParser::StchParser::parse_molecule(Molecules& mols) {
+    std::lock_guard<std::mutex> guard(__concurrent_read_mtx);
+    __read_header();
+    for (int i = 0; __num_occur == -1 || i < __num_occur; ++i) {
+        if (!fileio::read_molecule(__stream, mols)) break;
+    }
+}
+
+bool FileParser::StchParser::parse_next_molecule(Molecules& mols) {
+    std::lock_guard<std::mutex> guard(__concurrent_read_mtx);
+    __read_header();
+    return fileio::read_molecule(__stream, mols);
+}
+
+// the store is not line based, it is read by parse_molecule and
+// parse_next_molecule only
+bool FileParser::StchParser::__starts_molecule(const string&) const {
+    return false;
+}
+
+bool FileParser::StchParser::__parse_lines(Molecules&,
+                                           const vector<string>&) {
+    return true;
+}
+}
+}
@@ -0,0 +1,211 @@
+/* This is distcache.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "statchem/fileio/mappedfile.hpp"
+#include "statchem/helper/checksum.hpp"
+#include "statchem/helper/debug.hpp"
+#include "statchem/helper/logger.hpp"
+#include "statchem/score/score.hpp"
+using namespace std;
+
+namespace statchem {
+namespace score {
+
+/* The cache is a native endian binary file :
+ *
+ *   header   magic, version, byte order mark, source file size and
+ *            modification time, step_in_file, max_distance, number of
+ *            pairs and the checksum of everything after the header
+ *   index    for each pair : both idatm types and the histogram length
+ *   data     the histograms, one after the other
+ */
+namespace {
+const char distributions_magic[8] = {'S', 'T', 'C', 'H', 'D', 'I', 'S', 'T'};
+const uint32_t distributions_version = 1;
+const uint32_t byte_order_mark = 0x01020304;
+
+struct CacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t source_size;
+    int64_t source_time;
+    double step_in_file;
+    uint64_t max_distance;
+    uint64_t num_pairs;
+    uint64_t checksum;
+};
+
+struct CachePair {
+    int32_t first;
+    int32_t second;
+    uint64_t length;
+};
+}
+
+bool AtomicDistributions::__load_cache(const string& cache_file,
+                                       const uint64_t source_size,
+                                       const int64_t source_time) {
+    if (!boost::filesystem::is_regular_file(cache_file)) {
+        return false;
+    }
+
+    const fileio::MappedFile file(cache_file);
+    const char* const data = file.data();
+    const size_t size = file.size();
+
+    CacheHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, distributions_magic, sizeof(header.magic)) != 0 ||
+        header.version != distributions_version ||
+        header.byte_order != byte_order_mark ||
+        header.source_size != source_size ||
+        header.source_time != source_time ||
+        header.num_pairs > (size - sizeof(header)) / sizeof(CachePair) ||
+        checksum(data + sizeof(header), size - sizeof(header)) !=
+            header.checksum) {
+        dbgmsg("distributions cache " << cache_file << " is stale");
+        return false;
+    }
+
+    const char* index = data + sizeof(header);
+    const char* histograms = index + header.num_pairs * sizeof(CachePair);
+    const char* const end = data + size;
+
+    AtomPairValues loaded;
+    for (uint64_t i = 0; i < header.num_pairs; ++i) {
+        CachePair pair;
+        memcpy(&pair, index + i * sizeof(CachePair), sizeof(pair));
+
+        const size_t available = static_cast<size_t>(end - histograms);
+        if (pair.length > available / sizeof(double)) {
+            return false;
+        }
+        const size_t bytes = pair.length * sizeof(double);
+
+        vector<double>& histogram = loaded[{pair.first, pair.second}];
+        histogram.resize(pair.length);
+        memcpy(histogram.data(), histograms, bytes);
+        histograms += bytes;
+    }
+
+    values.swap(loaded);
+    step_in_file = header.step_in_file;
+    max_distance = header.max_distance;
+
+    return true;
+}
+
+bool AtomicDistributions::__save_cache(const string& cache_file,
+                                       const uint64_t source_size,
+                                       const int64_t source_time) const {
+    vector<CachePair> index;
+    size_t num_values = 0;
+    for (const auto& kv : values) {
+        index.push_back({kv.first.first, kv.first.second, kv.second.size()});
+        num_values += kv.second.size();
+    }
+
+    vector<double> histograms;
+    histograms.reserve(num_values);
+    for (const auto& kv : values) {
+        histograms.insert(histograms.end(), kv.second.begin(), kv.second.end());
+    }
+
+    CacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, distributions_magic, sizeof(header.magic));
+    header.version = distributions_version;
+    header.byte_order = byte_order_mark;
+    header.source_size = source_size;
+    header.source_time = source_time;
+    header.step_in_file = step_in_file;
+    header.max_distance = max_distance;
+    header.num_pairs = index.size();
+    header.checksum =
+        checksum(histograms.data(), histograms.size() * sizeof(double),
+                 checksum(index.data(), index.size() * sizeof(CachePair)));
+
+    // written under a temporary name and renamed, so concurrent readers
+    // never see a partial cache
+    const string temp_file =
+        cache_file + "." + boost::filesystem::unique_path().string();
+
+    boost::system::error_code ec;
+    const boost::filesystem::path dir =
+        boost::filesystem::path(cache_file).parent_path();
+    if (!dir.empty()) {
+        boost::filesystem::create_directories(dir, ec);
+    }
+
+    ofstream out(temp_file, ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(index.data()),
+              index.size() * sizeof(CachePair));
+    out.write(reinterpret_cast<const char*>(histograms.data()),
+              histograms.size() * sizeof(double));
+    out.close();
+
+    if (out) {
+        boost::filesystem::rename(temp_file, cache_file, ec);
+    }
+
+    if (!out || ec) {
+        boost::filesystem::remove(temp_file, ec);
+        dbgmsg("could not write distributions cache " << cache_file);
+        return false;
+    }
+    return true;
+}
+
+string AtomicDistributions::__user_cache_file(const string& filename) {
+    boost::filesystem::path dir;
+#ifdef _MSC_VER
+    if (const char* local_app_data = getenv("LOCALAPPDATA")) {
+        dir = boost::filesystem::path(local_app_data) / "statchem";
+    }
+#else
+    if (const char* xdg_cache_home = getenv("XDG_CACHE_HOME")) {
+        dir = boost::filesystem::path(xdg_cache_home) / "statchem";
+    } else if (const char* home = getenv("HOME")) {
+        dir = boost::filesystem::path(home) / ".cache" / "statchem";
+    }
+#endif
+    if (dir.empty()) {
+        return "";
+    }
+
+    // distributions files of the same name in different directories must
+    // not share a cache
+    const string source =
+        boost::filesystem::absolute(filename).lexically_normal().string();
+    stringstream name;
+    name << hex << setw(16) << setfill('0')
+         << checksum(source.data(), source.size()) << "-"
+         << boost::filesystem::path(filename).filename().string() << ".bin";
+    return (dir / name.str()).string();
+}
+}
+}
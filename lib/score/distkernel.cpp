@@ -0,0 +1,229 @@
+/* This is distkernel.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/score/distkernel.hpp"
+#include <cmath>
+
+#if defined(__x86_64__) && defined(__linux__) && \
+    (defined(__GNUC__) || defined(__clang__))
+#define STATCHEM_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace statchem {
+namespace score {
+
+namespace {
+
+typedef size_t (*DistanceKernel)(const double*, const double*, const double*,
+                                 const size_t, const double, const double,
+                                 const double, const double, const double,
+                                 uint32_t*, double*, int*);
+
+inline size_t distances_within_tail(const double* x, const double* y,
+                                    const double* z, size_t i, const size_t n,
+                                    const double px, const double py,
+                                    const double pz, const double cutoff_sq,
+                                    const double step, uint32_t* which,
+                                    double* dist, int* bins, size_t found) {
+    for (; i < n; ++i) {
+        const double dx = px - x[i];
+        const double dy = py - y[i];
+        const double dz = pz - z[i];
+        const double d_sq = dx * dx + dy * dy + dz * dz;
+
+        if (d_sq < cutoff_sq && d_sq > 0) {
+            const double d = std::sqrt(d_sq);
+            which[found] = i;
+            dist[found] = d;
+            if (bins) bins[found] = (int)std::floor((d + 0.0000000001) / step);
+            ++found;
+        }
+    }
+    return found;
+}
+
+#ifdef STATCHEM_X86_KERNELS
+
+// Distances are never negative, so truncating conversions below give the
+// same bins as floor() in the scalar code. Multiplies and adds are kept as
+// separate instructions (no FMA) so that d_sq is rounded exactly as in the
+// scalar code.
+
+size_t distances_within_sse2(const double* x, const double* y,
+                             const double* z, const size_t n, const double px,
+                             const double py, const double pz,
+                             const double cutoff_sq, const double step,
+                             uint32_t* which, double* dist, int* bins) {
+    const __m128d vpx = _mm_set1_pd(px);
+    const __m128d vpy = _mm_set1_pd(py);
+    const __m128d vpz = _mm_set1_pd(pz);
+    const __m128d vcutoff_sq = _mm_set1_pd(cutoff_sq);
+    const __m128d vzero = _mm_setzero_pd();
+    const __m128d veps = _mm_set1_pd(0.0000000001);
+    const __m128d vstep = _mm_set1_pd(step);
+
+    size_t found = 0, i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const __m128d dx = _mm_sub_pd(vpx, _mm_loadu_pd(x + i));
+        const __m128d dy = _mm_sub_pd(vpy, _mm_loadu_pd(y + i));
+        const __m128d dz = _mm_sub_pd(vpz, _mm_loadu_pd(z + i));
+        const __m128d d_sq =
+            _mm_add_pd(_mm_add_pd(_mm_mul_pd(dx, dx), _mm_mul_pd(dy, dy)),
+                       _mm_mul_pd(dz, dz));
+        const int mask = _mm_movemask_pd(_mm_and_pd(
+            _mm_cmplt_pd(d_sq, vcutoff_sq), _mm_cmpgt_pd(d_sq, vzero)));
+        if (!mask) continue;
+
+        double d[2];
+        int b[4];
+        const __m128d vd = _mm_sqrt_pd(d_sq);
+        _mm_storeu_pd(d, vd);
+        if (bins) {
+            _mm_storeu_si128(
+                reinterpret_cast<__m128i*>(b),
+                _mm_cvttpd_epi32(_mm_div_pd(_mm_add_pd(vd, veps), vstep)));
+        }
+        for (int lane = 0; lane < 2; ++lane) {
+            if (mask & (1 << lane)) {
+                which[found] = i + lane;
+                dist[found] = d[lane];
+                if (bins) bins[found] = b[lane];
+                ++found;
+            }
+        }
+    }
+    return distances_within_tail(x, y, z, i, n, px, py, pz, cutoff_sq, step,
+                                 which, dist, bins, found);
+}
+
+__attribute__((target("avx2"))) size_t distances_within_avx2(
+    const double* x, const double* y, const double* z, const size_t n,
+    const double px, const double py, const double pz, const double cutoff_sq,
+    const double step, uint32_t* which, double* dist, int* bins) {
+    const __m256d vpx = _mm256_set1_pd(px);
+    const __m256d vpy = _mm256_set1_pd(py);
+    const __m256d vpz = _mm256_set1_pd(pz);
+    const __m256d vcutoff_sq = _mm256_set1_pd(cutoff_sq);
+    const __m256d vzero = _mm256_setzero_pd();
+    const __m256d veps = _mm256_set1_pd(0.0000000001);
+    const __m256d vstep = _mm256_set1_pd(step);
+
+    size_t found = 0, i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256d dx = _mm256_sub_pd(vpx, _mm256_loadu_pd(x + i));
+        const __m256d dy = _mm256_sub_pd(vpy, _mm256_loadu_pd(y + i));
+        const __m256d dz = _mm256_sub_pd(vpz, _mm256_loadu_pd(z + i));
+        const __m256d d_sq = _mm256_add_pd(
+            _mm256_add_pd(_mm256_mul_pd(dx, dx), _mm256_mul_pd(dy, dy)),
+            _mm256_mul_pd(dz, dz));
+        const int mask = _mm256_movemask_pd(
+            _mm256_and_pd(_mm256_cmp_pd(d_sq, vcutoff_sq, _CMP_LT_OQ),
+                          _mm256_cmp_pd(d_sq, vzero, _CMP_GT_OQ)));
+        if (!mask) continue;
+
+        double d[4];
+        int b[4];
+        const __m256d vd = _mm256_sqrt_pd(d_sq);
+        _mm256_storeu_pd(d, vd);
+        if (bins) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(b),
+                             _mm256_cvttpd_epi32(_mm256_div_pd(
+                                 _mm256_add_pd(vd, veps), vstep)));
+        }
+        for (int lane = 0; lane < 4; ++lane) {
+            if (mask & (1 << lane)) {
+                which[found] = i + lane;
+                dist[found] = d[lane];
+                if (bins) bins[found] = b[lane];
+                ++found;
+            }
+        }
+    }
+    return distances_within_tail(x, y, z, i, n, px, py, pz, cutoff_sq, step,
+                                 which, dist, bins, found);
+}
+
+#endif
+
+size_t distances_within_scalar(const double* x, const double* y,
+                               const double* z, const size_t n,
+                               const double px, const double py,
+                               const double pz, const double cutoff_sq,
+                               const double step, uint32_t* which,
+                               double* dist, int* bins) {
+    return distances_within_tail(x, y, z, 0, n, px, py, pz, cutoff_sq, step,
+                                 which, dist, bins, 0);
+}
+
+struct KernelChoice {
+    DistanceKernel kernel;
+    const char* name;
+
+    KernelChoice() {
+        kernel = distances_within_scalar;
+        name = "scalar";
+#ifdef STATCHEM_X86_KERNELS
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) {
+            kernel = distances_within_avx2;
+            name = "avx2";
+            return;
+        }
+        kernel = distances_within_sse2;
+        name = "sse2";
+#endif
+    }
+};
+
+KernelChoice& kernel_choice() {
+    static KernelChoice choice;
+    return choice;
+}
+}  // namespace
+
+size_t distances_within(const double* x, const double* y, const double* z,
+                        const size_t n, const geometry::Coordinate& crd,
+                        const double cutoff_sq, const double step,
+                        uint32_t* which, double* dist, int* bins) {
+    return kernel_choice().kernel(x, y, z, n, crd.x(), crd.y(), crd.z(),
+                                  cutoff_sq, step, which, dist, bins);
+}
+
+const char* distance_kernel_name() { return kernel_choice().name; }
+
+bool set_distance_kernel(const std::string& name) {
+    KernelChoice& choice = kernel_choice();
+    if (name == "scalar") {
+        choice.kernel = distances_within_scalar;
+        choice.name = "scalar";
+        return true;
+    }
+#ifdef STATCHEM_X86_KERNELS
+    if (name == "sse2") {
+        choice.kernel = distances_within_sse2;
+        choice.name = "sse2";
+        return true;
+    }
+    if (name == "avx2" && __builtin_cpu_supports("avx2")) {
+        choice.kernel = distances_within_avx2;
+        choice.name = "avx2";
+        return true;
+    }
+#endif
+    return false;
+}
+}
+}
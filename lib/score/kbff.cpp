@@ -23,6 +23,7 @@
 #include "statchem/helper/path.hpp"
 #include "statchem/score/interpolation.hpp"
 #include "statchem/score/powerfit.hpp"
+#include "statchem/score/tablecache.hpp"
 using namespace std;
 
 namespace statchem {
@@ -85,44 +86,62 @@ KBFF& KBFF::parse_objective_function(const string& obj_dir,
 
     // Some systems add trailing zeros to doubles, let's remove them
     while (!boost::filesystem::exists(path_to_objective_function / subdir) &&
+           !boost::filesystem::exists(path_to_objective_function /
+                                      (subdir + ".bin")) &&
            subdir.back() == '0') {
         subdir.erase(subdir.end() - 1);
     }
 
-    path_to_objective_function /= subdir;
+    const boost::filesystem::path archive =
+        path_to_objective_function / (subdir + ".bin");
 
-    if (!boost::filesystem::exists(path_to_objective_function)) {
-        throw Error("Objective function not found! check 'obj_dir' and 'step'");
-    }
+    if (boost::filesystem::exists(archive)) {
+        __parse_objective_archive(archive.string());
+    } else {
+        path_to_objective_function /= subdir;
 
-    for (const auto& atom_pair : __avail_prot_lig) {
-        const string idatm_type1 = help::idatm_unmask[atom_pair.first];
-        const string idatm_type2 = help::idatm_unmask[atom_pair.second];
+        if (!boost::filesystem::exists(path_to_objective_function)) {
+            throw Error(
+                "Objective function not found! check 'obj_dir' and 'step'");
+        }
 
-        dbgmsg("parsing objective function for " << idatm_type1 << " and "
-                                                 << idatm_type2);
+        for (const auto& atom_pair : __avail_prot_lig) {
+            const string idatm_type1 = help::idatm_unmask[atom_pair.first];
+            const string idatm_type2 = help::idatm_unmask[atom_pair.second];
 
-        const string& filename = idatm_type1 + "_" + idatm_type2 + ".txt";
+            dbgmsg("parsing objective function for " << idatm_type1 << " and "
+                                                     << idatm_type2);
 
-        // Check if the file exists on disk. Since we know that the directory
-        // exists on disk,
-        // we can skip this pair as it is not part of the scoring function (ie
-        // not in the CSD).
-        if (!fileio::file_size(
-                (path_to_objective_function / filename).string())) {
-            continue;
-        }
+            const string& filename = idatm_type1 + "_" + idatm_type2 + ".txt";
+
+            // Check if the file exists on disk. Since we know that the
+            // directory exists on disk, we can skip this pair as it is not
+            // part of the scoring function (ie not in the CSD).
+            if (!fileio::file_size(
+                    (path_to_objective_function / filename).string())) {
+                continue;
+            }
 
-        vector<string> contents;
-        fileio::read_file((path_to_objective_function / filename).string(),
-                          contents);
+            vector<string> contents;
+            fileio::read_file((path_to_objective_function / filename).string(),
+                              contents);
 
-        for (auto& line : contents) {
-            stringstream ss(line);
-            string str1;
-            ss >> str1;
-            __energies[atom_pair].push_back(stod(str1));
+            for (auto& line : contents) {
+                stringstream ss(line);
+                string str1;
+                ss >> str1;
+                __energies[atom_pair].push_back(stod(str1));
+            }
         }
+    }
+
+    for (const auto& atom_pair : __avail_prot_lig) {
+        if (!__energies.count(atom_pair)) {
+            continue;
+        }
+
+        const string idatm_type1 = help::idatm_unmask[atom_pair.first];
+        const string idatm_type2 = help::idatm_unmask[atom_pair.second];
 
         if (__energies[atom_pair].size() < max_step) {
             int energies_diff = max_step - __energies[atom_pair].size();
@@ -143,288 +162,360 @@ KBFF& KBFF::parse_objective_function(const string& obj_dir,
     return *this;
 }
 
-KBFF& KBFF::compile_objective_function() {
-    log_step << "Compiling objective function for minimization...\n";
-    Benchmark bench;
+vector<double> KBFF::__compile_pair(const pair_of_ints& atom_pair,
+                                    string& note) const {
     auto energy_function = __ref_state == "mean"
                                ? mem_fn(&KBFF::__energy_mean)
                                : mem_fn(&KBFF::__energy_cumulative);
-    for (auto& el1 : __gij_of_r_numerator) {
-        const pair_of_ints& atom_pair = el1.first;
-
-        // Don't bother making an objective function
-        // unless we're going to use it
-        if (!__avail_prot_lig.count(atom_pair)) continue;
 
-        const vector<double>& gij_of_r_vals = el1.second;
-        dbgmsg(atom_pair.first << " " << atom_pair.second);
-        const double w1 = help::vdw_radius[atom_pair.first];
-        const double w2 = help::vdw_radius[atom_pair.second];
-        const double vdW_sum = ((w1 > 0 && w2 > 0) ? w1 + w2 : 4.500);
-
-        const string idatm_type1 = help::idatm_unmask[atom_pair.first];
-        const string idatm_type2 = help::idatm_unmask[atom_pair.second];
-
-        vector<double> energy(gij_of_r_vals.size(), -HUGE_VAL);
-
-        const size_t start_idx = __get_index(vdW_sum - 0.6);
-        const size_t end_idx = __get_index(vdW_sum + 1.0);
-
-        dbgmsg(start_idx << " " << end_idx);
-
-        for (size_t i = 0; i < gij_of_r_vals.size(); ++i) {
-            const double lower_bound = __get_lower_bound(i);
-            dbgmsg(lower_bound);
-            const double& gij_of_r_numerator = gij_of_r_vals[i];
-            dbgmsg("lower bound for atom_pair "
-                   << idatm_type1 << " " << idatm_type2 << " " << lower_bound
-                   << " gij_of_r_numerator = " << gij_of_r_numerator
-                   << " __sum_gij_of_r_numerator[atom_pair] = "
-                   << __sum_gij_of_r_numerator[atom_pair]);
-
-            if (__sum_gij_of_r_numerator[atom_pair] < __eps) {
-                energy[i] = 0;
-            } else if (gij_of_r_numerator < __eps && (i + 1 < start_idx)) {
-                energy[i] = 5.0;
-            } else if (gij_of_r_numerator < __eps && (i + 1 >= start_idx)) {
-                energy[i] = 0;
-            } else {
-                energy[i] = energy_function(*this, atom_pair, lower_bound);
-            }
+    const vector<double>& gij_of_r_vals = __gij_of_r_numerator.at(atom_pair);
+    const double sum_gij_of_r_numerator =
+        __sum_gij_of_r_numerator.at(atom_pair);
+    dbgmsg(atom_pair.first << " " << atom_pair.second);
+    const double w1 = help::vdw_radius[atom_pair.first];
+    const double w2 = help::vdw_radius[atom_pair.second];
+    const double vdW_sum = ((w1 > 0 && w2 > 0) ? w1 + w2 : 4.500);
+
+    const string idatm_type1 = help::idatm_unmask[atom_pair.first];
+    const string idatm_type2 = help::idatm_unmask[atom_pair.second];
+
+    vector<double> energy(gij_of_r_vals.size(), -HUGE_VAL);
+
+    const size_t start_idx = __get_index(vdW_sum - 0.6);
+    const size_t end_idx = __get_index(vdW_sum + 1.0);
+
+    dbgmsg(start_idx << " " << end_idx);
+
+    for (size_t i = 0; i < gij_of_r_vals.size(); ++i) {
+        const double lower_bound = __get_lower_bound(i);
+        dbgmsg(lower_bound);
+        const double& gij_of_r_numerator = gij_of_r_vals[i];
+        dbgmsg("lower bound for atom_pair "
+               << idatm_type1 << " " << idatm_type2 << " " << lower_bound
+               << " gij_of_r_numerator = " << gij_of_r_numerator
+               << " __sum_gij_of_r_numerator[atom_pair] = "
+               << sum_gij_of_r_numerator);
+
+        if (sum_gij_of_r_numerator < __eps) {
+            energy[i] = 0;
+        } else if (gij_of_r_numerator < __eps && (i + 1 < start_idx)) {
+            energy[i] = 5.0;
+        } else if (gij_of_r_numerator < __eps && (i + 1 >= start_idx)) {
+            energy[i] = 0;
+        } else {
+            energy[i] = energy_function(this, atom_pair, lower_bound);
         }
+    }
 
-        // dbgmsg("raw energies before interpolations : " << std::endl <<
-        // energy);
-
-        // correct for outliers only in the TRUE potential region of the
-        // potential
-        for (size_t i = start_idx; i < energy.size() - 2; ++i) {
-            if (energy[i] != 0 && energy[i] != 5) {
-                size_t j = i + 1;
-                while (j < i + 3 && j < energy.size() &&
-                       (energy[j] == 0 || energy[j] == 5)) {
-                    ++j;
-                }
-                if (j > i + 1 && j < energy.size()) {
-                    const double k0 = (energy[j] - energy[i]) / (j - i);
-                    for (size_t k = 1; k < j - i; ++k) {
-                        energy[i + k] = energy[i] + k0 * k;
-                    }
+    // dbgmsg("raw energies before interpolations : " << std::endl <<
+    // energy);
+
+    // correct for outliers only in the TRUE potential region of the
+    // potential
+    for (size_t i = start_idx; i < energy.size() - 2; ++i) {
+        if (energy[i] != 0 && energy[i] != 5) {
+            size_t j = i + 1;
+            while (j < i + 3 && j < energy.size() &&
+                   (energy[j] == 0 || energy[j] == 5)) {
+                ++j;
+            }
+            if (j > i + 1 && j < energy.size()) {
+                const double k0 = (energy[j] - energy[i]) / (j - i);
+                for (size_t k = 1; k < j - i; ++k) {
+                    energy[i + k] = energy[i] + k0 * k;
                 }
             }
         }
+    }
 
-        // locate global minimum and repulsion index in interval [vdW_sum - 0.6,
-        // vdW_sum + 1.0]
-        double global_min = HUGE_VAL;
-        size_t global_min_idx = start_idx;
-        size_t repulsion_idx = global_min_idx;
+    // locate global minimum and repulsion index in interval [vdW_sum - 0.6,
+    // vdW_sum + 1.0]
+    double global_min = HUGE_VAL;
+    size_t global_min_idx = start_idx;
+    size_t repulsion_idx = global_min_idx;
 
+    try {
+        repulsion_idx = __get_index(
+            help::repulsion_idx.at(make_pair(idatm_type1, idatm_type2)));
+    } catch (out_of_range&) {
         try {
-            repulsion_idx = __get_index(
-                help::repulsion_idx.at(make_pair(idatm_type1, idatm_type2)));
+            repulsion_idx = __get_index(help::repulsion_idx.at(
+                make_pair(idatm_type2, idatm_type1)));
         } catch (out_of_range&) {
-            try {
-                repulsion_idx = __get_index(help::repulsion_idx.at(
-                    make_pair(idatm_type2, idatm_type1)));
-            } catch (out_of_range&) {
-                dbgmsg("de-novo calculation of repulsion idx");
-
-                for (size_t i = start_idx; i < end_idx && i < energy.size();
-                     ++i) {
-                    if (energy[i] != -HUGE_VAL) {
-                        if (energy[i] < global_min) {
-                            global_min = energy[i];
-                            global_min_idx = i;
-
-                            // minimum has to have steep downward slope on the
-                            // left side
-                            // leave the slope intact and unset everything left
-                            // of the slope start point
-                            repulsion_idx = i;
-                            while (repulsion_idx > 0 &&
-                                   energy[repulsion_idx] != -HUGE_VAL &&
-                                   ((energy[repulsion_idx] -
-                                     energy[repulsion_idx - 1]) /
-                                    __step_in_file) < 0.75)
-                                --repulsion_idx;
-                        }
+            dbgmsg("de-novo calculation of repulsion idx");
+
+            for (size_t i = start_idx; i < end_idx && i < energy.size();
+                 ++i) {
+                if (energy[i] != -HUGE_VAL) {
+                    if (energy[i] < global_min) {
+                        global_min = energy[i];
+                        global_min_idx = i;
+
+                        // minimum has to have steep downward slope on the
+                        // left side
+                        // leave the slope intact and unset everything left
+                        // of the slope start point
+                        repulsion_idx = i;
+                        while (repulsion_idx > 0 &&
+                               energy[repulsion_idx] != -HUGE_VAL &&
+                               ((energy[repulsion_idx] -
+                                 energy[repulsion_idx - 1]) /
+                                __step_in_file) < 0.75)
+                            --repulsion_idx;
                     }
                 }
             }
         }
+    }
 
-        dbgmsg("repulsion idx (before correction) = "
-               << repulsion_idx
-               << " repulsion distance (below is forbidden area) = "
-               << __get_lower_bound(repulsion_idx));
-
-        // calculate slope points & minor correction to repulsion index
-        vector<double> deriva;
-        for (size_t i = repulsion_idx;
-             i < repulsion_idx + 5 && i < energy.size() - 1; ++i) {
-            double d = (energy[i + 1] - energy[i]) / __step_in_file;
-            deriva.push_back(d);
-        }
+    dbgmsg("repulsion idx (before correction) = "
+           << repulsion_idx
+           << " repulsion distance (below is forbidden area) = "
+           << __get_lower_bound(repulsion_idx));
+
+    // calculate slope points & minor correction to repulsion index
+    vector<double> deriva;
+    for (size_t i = repulsion_idx;
+         i < repulsion_idx + 5 && i < energy.size() - 1; ++i) {
+        double d = (energy[i + 1] - energy[i]) / __step_in_file;
+        deriva.push_back(d);
+    }
 
-        // find up to 3 most negative derivatives and store index to slope
-        std::set<size_t> slope_idx;
-        for (size_t i = 0; i < 3 && i < deriva.size(); ++i) {
-            auto it = min_element(deriva.begin(), deriva.end(),
-                                  [](double i, double j) { return i < j; });
-            if (*it < 0.0) {  // derivative < 0
-                size_t i0 = repulsion_idx + (it - deriva.begin());
-                deriva.erase(it);
-                slope_idx.insert(i0);
-                slope_idx.insert(i0 + 1);
-            }
+    // find up to 3 most negative derivatives and store index to slope
+    std::set<size_t> slope_idx;
+    for (size_t i = 0; i < 3 && i < deriva.size(); ++i) {
+        auto it = min_element(deriva.begin(), deriva.end(),
+                              [](double i, double j) { return i < j; });
+        if (*it < 0.0) {  // derivative < 0
+            size_t i0 = repulsion_idx + (it - deriva.begin());
+            deriva.erase(it);
+            slope_idx.insert(i0);
+            slope_idx.insert(i0 + 1);
         }
+    }
 
-        try {
-            if (slope_idx.size() <= 1)
-                throw InterpolationError("warning : slope not found in data");
-
-            repulsion_idx = *slope_idx.begin();  // correct repulsion_idx
+    if (slope_idx.size() <= 1)
+        throw InterpolationError("warning : slope not found in data");
+
+    repulsion_idx = *slope_idx.begin();  // correct repulsion_idx
+
+    dbgmsg("atom1 = "
+           << idatm_type1 << " atom2 = " << idatm_type2 << " vdW_sum = "
+           << vdW_sum << " repulsion idx = " << repulsion_idx
+           << " step_non_bond = " << __step_non_bond
+           << " repulsion distance (below is forbidden area) = "
+           << __get_lower_bound(repulsion_idx) << " minimum distance = "
+           << __get_lower_bound(global_min_idx)
+           << " begin slope idx = " << *slope_idx.begin()
+           << " end slope idx = " << *slope_idx.rbegin());
+
+    // dbgmsg("energies before interpolations : " << endl
+    //                                           << energy);
+
+    vector<double> dataX, dataY;
+    for (size_t i = repulsion_idx; i < energy.size();
+         ++i) {  // unset everything below this value
+        dataX.push_back(__get_lower_bound(i));
+        dataY.push_back(energy[i]);
+    }
 
-            dbgmsg("atom1 = "
-                   << idatm_type1 << " atom2 = " << idatm_type2 << " vdW_sum = "
-                   << vdW_sum << " repulsion idx = " << repulsion_idx
-                   << " step_non_bond = " << __step_non_bond
-                   << " repulsion distance (below is forbidden area) = "
-                   << __get_lower_bound(repulsion_idx) << " minimum distance = "
-                   << __get_lower_bound(global_min_idx)
-                   << " begin slope idx = " << *slope_idx.begin()
-                   << " end slope idx = " << *slope_idx.rbegin());
+    Interpolation::BSplineFit BSFited(dataX, dataY);
+    vector<double> potential = BSFited.interpolate_bspline(
+        dataX.front(), dataX.back(), __step_non_bond);
+
+    // Extrapolate extra points to fill the gap between the upperbound
+    // and the cutoff
+    // IE. If the cutoff is 6, the upperbound is 5.9, so 5.91 5.92, etc
+    // need to be added
+    // This is done here to avoid tainting the spline fitting
+    const double potential_deriv_1 =
+        (*(potential.rbegin() + 0) - *(potential.rbegin() + 1)) *
+        __step_non_bond;
+    const double potential_deriv_2 =
+        (*(potential.rbegin() + 1) - *(potential.rbegin() + 2)) *
+        __step_non_bond;
+    const double potential_2_deriv =
+        (potential_deriv_1 - potential_deriv_2) * __step_non_bond;
+
+    for (size_t i = 0; i < (__step_in_file / __step_non_bond); ++i) {
+        potential.push_back(potential.back() + (potential_deriv_1 +
+                                                i * potential_2_deriv));
+    }
 
-            // dbgmsg("energies before interpolations : " << endl
-            //                                           << energy);
+    // add repulsion term by fitting 1/x**12 function to slope points
+    const double x1 = __get_lower_bound(*slope_idx.begin());
+    const double x2 = __get_lower_bound(*slope_idx.rbegin());
+    std::vector<double> r;
+    std::vector<double> pot;
+    size_t i = 0;
+    for (double xi = dataX.front(); xi <= dataX.back();
+         xi += __step_non_bond) {
+        if (xi >= x1 && xi <= x2) {
+            r.push_back(xi);
+            pot.push_back(potential[i]);
+        }
+        ++i;
+    }
 
-            const string idatm_type1 = help::idatm_unmask[atom_pair.first];
-            const string idatm_type2 = help::idatm_unmask[atom_pair.second];
+    dbgmsg("x1 = " << x1);
+    dbgmsg("x2 = " << x2);
 
-            vector<double> dataX, dataY;
-            for (size_t i = repulsion_idx; i < energy.size();
-                 ++i) {  // unset everything below this value
-                dataX.push_back(__get_lower_bound(i));
-                dataY.push_back(energy[i]);
-            }
+    // fit function to slope
+    double coeffA, coeffB, WSSR;
+    std::tie(coeffA, coeffB, WSSR) =
+        fit_range_power_function_fast(r, pot);
 
-            Interpolation::BSplineFit BSFited(dataX, dataY);
-            vector<double> potential = BSFited.interpolate_bspline(
-                dataX.front(), dataX.back(), __step_non_bond);
-
-            // Extrapolate extra points to fill the gap between the upperbound
-            // and the cutoff
-            // IE. If the cutoff is 6, the upperbound is 5.9, so 5.91 5.92, etc
-            // need to be added
-            // This is done here to avoid tainting the spline fitting
-            const double potential_deriv_1 =
-                (*(potential.rbegin() + 0) - *(potential.rbegin() + 1)) *
-                __step_non_bond;
-            const double potential_deriv_2 =
-                (*(potential.rbegin() + 1) - *(potential.rbegin() + 2)) *
-                __step_non_bond;
-            const double potential_2_deriv =
-                (potential_deriv_1 - potential_deriv_2) * __step_non_bond;
-
-            for (size_t i = 0; i < (__step_in_file / __step_non_bond); ++i) {
-                potential.push_back(potential.back() + (potential_deriv_1 +
-                                                        i * potential_2_deriv));
-            }
+    dbgmsg("atom1 = " << idatm_type1 << " atom2 = " << idatm_type2
+                      << " coeffA = " << coeffA
+                      << " coeffB = " << coeffB << " WSSR = " << WSSR);
 
-            // add repulsion term by fitting 1/x**12 function to slope points
-            const double x1 = __get_lower_bound(*slope_idx.begin());
-            const double x2 = __get_lower_bound(*slope_idx.rbegin());
-            std::vector<double> r;
-            std::vector<double> pot;
-            size_t i = 0;
-            for (double xi = dataX.front(); xi <= dataX.back();
-                 xi += __step_non_bond) {
-                if (xi >= x1 && xi <= x2) {
-                    r.push_back(xi);
-                    pot.push_back(potential[i]);
-                }
-                ++i;
-            }
+    if (coeffA < 0) {
+        stringstream ss;
+        ss << "Atom types: " << idatm_type1 << " and " << idatm_type2
+           << " are still attractive at the repulsive index.\n";
+        note = ss.str();
+        coeffA *= -1;
+    }
 
-            dbgmsg("x1 = " << x1);
-            dbgmsg("x2 = " << x2);
+    vector<double> repulsion;
+    // Add starting point for x=0 (so it's its not NaN).
+    repulsion.push_back(10 * coeffA / pow(__step_non_bond, 12) +
+                        coeffB);
+
+    // No longer loop over a double as this caused an extra point to be
+    // calculated
+    for (size_t i = 1; i < std::floor(__dist_cutoff / __step_non_bond) -
+                               potential.size() + 1;
+         ++i) {
+        const double yi =
+            coeffA / pow(i * __step_non_bond, 12) + coeffB;
+        repulsion.push_back(
+            std::isinf(yi)
+                ? 10 * coeffA / pow(i * (__step_non_bond + 1), 12) +
+                      coeffB
+                : yi);
+    }
+#ifndef NDEBUG
+    for (size_t i = 0; i < repulsion.size(); ++i)
+        dbgmsg("i = " << i << " repulsion = " << repulsion[i]);
+#endif
+    // if the repulsion term comes under the potential do a linear
+    // interpolation to get smooth joint
+    int w = 0;
+    while (!repulsion.empty() && repulsion.back() < potential.front()) {
+        repulsion.pop_back();
+        ++w;
+    }
 
-            // fit function to slope
-            double coeffA, coeffB, WSSR;
-            std::tie(coeffA, coeffB, WSSR) =
-                fit_range_power_function_fast(r, pot);
+    dbgmsg("repulsion.size() = " << repulsion.size());
 
-            dbgmsg("atom1 = " << idatm_type1 << " atom2 = " << idatm_type2
-                              << " coeffA = " << coeffA
-                              << " coeffB = " << coeffB << " WSSR = " << WSSR);
+    const double rep_good = repulsion.back();
+    const double k0 = (potential.front() - rep_good) / w;
+    for (int k = 1; k <= w; ++k) {
+        repulsion.push_back(rep_good + k0 * k);
+    }
 
-            if (coeffA < 0) {
-                log_note << "Atom types: " << idatm_type1 << " and "
-                         << idatm_type2
-                         << " are still attractive at the repulsive index.\n";
-                coeffA *= -1;
-            }
+    // add repulsion term before bsplined potential
+    potential.insert(potential.begin(), repulsion.begin(),
+                     repulsion.end());
 
-            vector<double> repulsion;
-            // Add starting point for x=0 (so it's its not NaN).
-            repulsion.push_back(10 * coeffA / pow(__step_non_bond, 12) +
-                                coeffB);
 
-            // No longer loop over a double as this caused an extra point to be
-            // calculated
-            for (size_t i = 1; i < std::floor(__dist_cutoff / __step_non_bond) -
-                                       potential.size() + 1;
-                 ++i) {
-                const double yi =
-                    coeffA / pow(i * __step_non_bond, 12) + coeffB;
-                repulsion.push_back(
-                    std::isinf(yi)
-                        ? 10 * coeffA / pow(i * (__step_non_bond + 1), 12) +
-                              coeffB
-                        : yi);
-            }
 #ifndef NDEBUG
-            for (size_t i = 0; i < repulsion.size(); ++i)
-                dbgmsg("i = " << i << " repulsion = " << repulsion[i]);
+    for (size_t i = 0; i < potential.size(); ++i) {
+        dbgmsg("interpolated "
+               << help::idatm_unmask[atom_pair.first] << " "
+               << help::idatm_unmask[atom_pair.second] << " "
+               << i * __step_non_bond << " pot = " << potential[i]);
+    }
 #endif
-            // if the repulsion term comes under the potential do a linear
-            // interpolation to get smooth joint
-            int w = 0;
-            while (!repulsion.empty() && repulsion.back() < potential.front()) {
-                repulsion.pop_back();
-                ++w;
-            }
+    return potential;
+}
 
-            dbgmsg("repulsion.size() = " << repulsion.size());
+KBFF& KBFF::compile_objective_function(const size_t nthreads) {
+    parallel::ThreadPool pool(std::max<size_t>(1, nthreads));
+    return compile_objective_function(pool);
+}
 
-            const double rep_good = repulsion.back();
-            const double k0 = (potential.front() - rep_good) / w;
-            for (int k = 1; k <= w; ++k) {
-                repulsion.push_back(rep_good + k0 * k);
-            }
+KBFF& KBFF::compile_objective_function(const string& distributions_file,
+                                       const string& cache_dir,
+                                       const size_t nthreads) {
+    if (cache_dir.empty()) {
+        process_distributions(distributions_file).compile_scoring_function();
+        return compile_objective_function(nthreads);
+    }
 
-            // add repulsion term before bsplined potential
-            potential.insert(potential.begin(), repulsion.begin(),
-                             repulsion.end());
+    const TableCache cache(cache_dir);
+    stringstream ss;
+    ss << __cache_settings() << setprecision(17) << " step_non_bond "
+       << __step_non_bond;
+    const string settings = ss.str();
+    const string key = cache.key(distributions_file, settings);
+
+    CompiledTables tables;
+    if (cache.load(key, settings, tables)) {
+        log_step << "Loaded compiled objective function " << key << "\n";
+        __step_in_file = tables.step_in_file;
+        __energies_scoring.swap(tables.scoring);
+        __compile_energies_table();
+        __energies.swap(tables.objective);
+        __unavailible.swap(tables.unavailable);
+        return *this;
+    }
 
-            __energies[atom_pair].assign(potential.begin(), potential.end());
+    process_distributions(distributions_file).compile_scoring_function();
+    compile_objective_function(nthreads);
 
-#ifndef NDEBUG
-            for (size_t i = 0; i < potential.size(); ++i) {
-                dbgmsg("interpolated "
-                       << help::idatm_unmask[atom_pair.first] << " "
-                       << help::idatm_unmask[atom_pair.second] << " "
-                       << i * __step_non_bond << " pot = " << potential[i]);
-            }
-#endif
-        }  // END of try
-        catch (InterpolationError& e) {
-            log_warning << e.what() << "\n";
+    tables.step_in_file = __step_in_file;
+    tables.scoring = __energies_scoring;
+    tables.objective = __energies;
+    tables.unavailable = __unavailible;
+    cache.save(key, settings, tables);
+    return *this;
+}
+
+KBFF& KBFF::compile_objective_function(parallel::ThreadPool& pool) {
+    log_step << "Compiling objective function for minimization...\n";
+    Benchmark bench;
+
+    // Don't bother making an objective function
+    // unless we're going to use it
+    vector<pair_of_ints> atom_pairs;
+    for (auto& el1 : __gij_of_r_numerator) {
+        if (__avail_prot_lig.count(el1.first)) {
+            atom_pairs.push_back(el1.first);
+        }
+    }
+
+    // pairs are fitted independently, then merged (and their messages
+    // logged) in the same order as a serial compilation
+    vector<vector<double>> potentials(atom_pairs.size());
+    vector<string> notes(atom_pairs.size());
+    vector<string> warnings(atom_pairs.size());
+
+    pool.parallel_for(0, atom_pairs.size(),
+                      [&](size_t i) {
+                          try {
+                              potentials[i] =
+                                  __compile_pair(atom_pairs[i], notes[i]);
+                          } catch (InterpolationError& e) {
+                              warnings[i] = e.what();
+                          }
+                      },
+                      1);
+
+    for (size_t i = 0; i < atom_pairs.size(); ++i) {
+        const pair_of_ints& atom_pair = atom_pairs[i];
+        if (!notes[i].empty()) {
+            log_note << notes[i];
+        }
+        if (!warnings[i].empty()) {
+            log_warning << warnings[i] << "\n";
             __unavailible.insert({atom_pair.first, atom_pair.second});
+            continue;
         }
+        __energies[atom_pair].swap(potentials[i]);
     }
-    dbgmsg("out of loop");
+    pool.log_stats("objective function compilation");
     log_benchmark << "Time to compile the objective function: "
                   << bench.seconds_from_start() << "\n";
     return *this;
@@ -0,0 +1,190 @@
+/* This is kbffarchive.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include <algorithm>
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include "statchem/fileio/mappedfile.hpp"
+#include "statchem/helper/checksum.hpp"
+#include "statchem/helper/debug.hpp"
+#include "statchem/helper/error.hpp"
+#include "statchem/helper/help.hpp"
+#include "statchem/helper/logger.hpp"
+#include "statchem/helper/path.hpp"
+#include "statchem/score/kbff.hpp"
+using namespace std;
+
+namespace statchem {
+namespace score {
+
+/* The archive is a native endian binary file :
+ *
+ *   header   magic, version, byte order mark, step_non_bond and the
+ *            number of pairs
+ *   index    for each pair, sorted : both idatm types, the offset and
+ *            length of its energies and their checksum
+ *   data     the energies of all pairs, one after the other
+ *
+ * Only the pairs that are needed are looked up in the index, so reading
+ * a few atom types out of a large archive touches just those pages.
+ */
+namespace {
+const char objective_magic[8] = {'S', 'T', 'C', 'H', 'K', 'B', 'F', 'F'};
+const uint32_t objective_version = 1;
+const uint32_t byte_order_mark = 0x01020304;
+
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    double step_non_bond;
+    uint64_t num_pairs;
+};
+
+struct ArchivePair {
+    int32_t first;
+    int32_t second;
+    uint64_t offset;  // in doubles, from the start of the data
+    uint64_t length;
+    uint64_t checksum;
+};
+
+bool operator<(const ArchivePair& pair, const pair_of_ints& atom_pair) {
+    return make_pair(pair.first, pair.second) < atom_pair;
+}
+}
+
+void KBFF::__parse_objective_archive(const string& archive_file) {
+    dbgmsg("parsing objective function archive " << archive_file);
+
+    const fileio::MappedFile file(archive_file);
+    const char* const data = file.data();
+    const size_t size = file.size();
+
+    ArchiveHeader header;
+    if (size < sizeof(header)) {
+        throw Error("Objective function archive " + archive_file +
+                    " is truncated");
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, objective_magic, sizeof(header.magic)) != 0 ||
+        header.version != objective_version ||
+        header.byte_order != byte_order_mark) {
+        throw Error("File " + archive_file +
+                    " is not an objective function archive of this version");
+    }
+
+    if (header.num_pairs > (size - sizeof(header)) / sizeof(ArchivePair)) {
+        throw Error("Objective function archive " + archive_file +
+                    " is truncated");
+    }
+
+    vector<ArchivePair> index(header.num_pairs);
+    memcpy(index.data(), data + sizeof(header),
+           index.size() * sizeof(ArchivePair));
+
+    const char* const energies =
+        data + sizeof(header) + index.size() * sizeof(ArchivePair);
+    const size_t num_values =
+        static_cast<size_t>(data + size - energies) / sizeof(double);
+
+    for (const auto& atom_pair : __avail_prot_lig) {
+        auto it = lower_bound(index.begin(), index.end(), atom_pair);
+
+        // as with the text files, pairs absent from the archive are not
+        // part of the scoring function
+        if (it == index.end() || it->first != atom_pair.first ||
+            it->second != atom_pair.second) {
+            continue;
+        }
+
+        if (it->offset > num_values || it->length > num_values - it->offset) {
+            throw Error("Objective function archive " + archive_file +
+                        " is truncated");
+        }
+
+        const char* values = energies + it->offset * sizeof(double);
+        const size_t bytes = it->length * sizeof(double);
+
+        if (checksum(values, bytes) != it->checksum) {
+            throw Error("Objective function archive " + archive_file +
+                        " is corrupt for pair " +
+                        help::idatm_unmask[atom_pair.first] + " " +
+                        help::idatm_unmask[atom_pair.second]);
+        }
+
+        vector<double>& energy = __energies[atom_pair];
+        const size_t start = energy.size();
+        energy.resize(start + it->length);
+        memcpy(energy.data() + start, values, bytes);
+    }
+}
+
+KBFF& KBFF::output_objective_archive(const string& obj_dir) {
+    vector<ArchivePair> index;
+    size_t num_values = 0;
+    for (const auto& kv : __energies) {
+        const vector<double>& energy = kv.second;
+        index.push_back({kv.first.first, kv.first.second, num_values,
+                         energy.size(),
+                         checksum(energy.data(),
+                                  energy.size() * sizeof(double))});
+        num_values += energy.size();
+    }
+
+    ArchiveHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, objective_magic, sizeof(header.magic));
+    header.version = objective_version;
+    header.byte_order = byte_order_mark;
+    header.step_non_bond = __step_non_bond;
+    header.num_pairs = index.size();
+
+    boost::filesystem::create_directories(obj_dir);
+    const string archive_file =
+        Path::join(obj_dir, std::to_string(__step_non_bond) + ".bin");
+
+    // written under a temporary name and renamed, so readers never see a
+    // partial archive
+    const string temp_file =
+        archive_file + "." + boost::filesystem::unique_path().string();
+
+    ofstream out(temp_file, ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(index.data()),
+              index.size() * sizeof(ArchivePair));
+    for (const auto& kv : __energies) {
+        out.write(reinterpret_cast<const char*>(kv.second.data()),
+                  kv.second.size() * sizeof(double));
+    }
+    out.close();
+
+    boost::system::error_code ec;
+    if (out) {
+        boost::filesystem::rename(temp_file, archive_file, ec);
+    }
+
+    if (!out || ec) {
+        boost::filesystem::remove(temp_file, ec);
+        throw Error("Could not write objective function archive " +
+                    archive_file);
+    }
+
+    return *this;
+}
+}
+}
@@ -0,0 +1,199 @@
+/* This is multiscore.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/score/multiscore.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include "statchem/helper/debug.hpp"
+#include "statchem/helper/error.hpp"
+#include "statchem/helper/help.hpp"
+#include "statchem/molib/molecule.hpp"
+#include "statchem/score/distkernel.hpp"
+using namespace std;
+
+namespace statchem {
+namespace score {
+
+MultiScore::MultiScore(const vector<const Score*>& scores)
+    : __num_types(0),
+      __num_bins(0),
+      __step_in_file(-1),
+      __dist_cutoff(0),
+      __pair_size(0) {
+    if (scores.empty()) {
+        throw Error("die : MultiScore needs at least one scoring function");
+    }
+
+    __step_in_file = scores.front()->__step_in_file;
+
+    set<int> idatm_types;
+    for (const Score* score : scores) {
+        if (score->__step_in_file != __step_in_file) {
+            throw Error(
+                "die : MultiScore needs scoring functions compiled from the "
+                "same distributions");
+        }
+        for (auto& atom_pair : score->__avail_prot_lig) {
+            idatm_types.insert(atom_pair.first);
+            idatm_types.insert(atom_pair.second);
+        }
+        __num_bins = std::max(__num_bins, score->__num_bins);
+        __dist_cutoff = std::max(__dist_cutoff, score->__dist_cutoff);
+    }
+
+    __order.resize(scores.size());
+    iota(__order.begin(), __order.end(), 0);
+    stable_sort(__order.begin(), __order.end(), [&](size_t i, size_t j) {
+        return scores[i]->__num_bins > scores[j]->__num_bins;
+    });
+
+    __num_active.assign(__num_bins, 0);
+    __bin_offset.assign(__num_bins, 0);
+    for (size_t b = 0; b < __num_bins; ++b) {
+        while (__num_active[b] < __order.size() &&
+               scores[__order[__num_active[b]]]->__num_bins > b) {
+            ++__num_active[b];
+        }
+        __bin_offset[b] = __pair_size;
+        __pair_size += __num_active[b];
+    }
+
+    __type_index.assign(help::idatm_mask.size(), -1);
+    for (auto& idatm_type : idatm_types) {
+        __type_index[idatm_type] = __num_types++;
+    }
+
+    const size_t num_pairs = __num_types * (__num_types + 1) / 2;
+    __energies_table.assign(num_pairs * __pair_size, 0.0);
+    __pair_defined.assign(num_pairs, true);
+
+    for (auto it1 = idatm_types.begin(); it1 != idatm_types.end(); ++it1) {
+        for (auto it2 = it1; it2 != idatm_types.end(); ++it2) {
+            const pair_of_ints atom_pair(*it1, *it2);
+            const size_t i = __type_index[atom_pair.first];
+            const size_t j = __type_index[atom_pair.second];
+            const size_t pair_idx = i * (2 * __num_types - i + 1) / 2 + j - i;
+            double* const table = &__energies_table[pair_idx * __pair_size];
+
+            for (size_t rank = 0; rank < __order.size(); ++rank) {
+                const Score& score = *scores[__order[rank]];
+
+                if (score.__type_index.size() <= size_t(atom_pair.second) ||
+                    score.__type_index[atom_pair.first] < 0 ||
+                    score.__type_index[atom_pair.second] < 0 ||
+                    !score.__pair_defined[score.__get_pair_index_unchecked(
+                        atom_pair)]) {
+                    __pair_defined[pair_idx] = false;
+                    break;
+                }
+
+                const double* energies = score.__get_energies(
+                    score.__get_pair_index_unchecked(atom_pair));
+                for (size_t b = 0; b < score.__num_bins; ++b) {
+                    table[__bin_offset[b] + rank] = energies[b];
+                }
+            }
+        }
+    }
+    dbgmsg("compiled stacked energies table of "
+           << scores.size() << " scoring functions with " << __num_types
+           << " atom types and " << __num_bins << " bins");
+}
+
+size_t MultiScore::__get_pair_index(const int atom_1, const int atom_2) const {
+    const pair_of_ints atom_pair = std::minmax(atom_1, atom_2);
+    if (__type_index.at(atom_pair.first) < 0 ||
+        __type_index.at(atom_pair.second) < 0) {
+        throw Error("undefined atom_pair in MultiScore");
+    }
+    const size_t i = __type_index[atom_pair.first];
+    const size_t j = __type_index[atom_pair.second];
+    const size_t pair_idx = i * (2 * __num_types - i + 1) / 2 + j - i;
+    if (!__pair_defined[pair_idx]) {
+        throw Error("undefined atom_pair in MultiScore");
+    }
+    return pair_idx;
+}
+
+vector<double> MultiScore::non_bonded_energy(
+    const molib::Atom::Grid& gridrec, const molib::Molecule& ligand) const {
+    const molib::Atom::Vec atoms = ligand.get_atoms();
+    const geometry::Point::Vec crds = ligand.get_crds();
+
+    const double cutoff_sq = pow(__dist_cutoff, 2);
+    uint32_t which[distance_kernel_block];
+    double dists[distance_kernel_block];
+    int bins[distance_kernel_block];
+
+    // sums are kept by rank; every function sees its neighbors in the same
+    // order as Score::non_bonded_energy, so the sums are identical
+    vector<double> energy_sum(__order.size(), 0.0);
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        const geometry::Coordinate& atom2_crd = crds[i];
+        const auto& atom_2 = atoms[i]->idatm_type();
+        gridrec.for_each_candidate_run(atom2_crd, __dist_cutoff, [&](
+            molib::Atom* const* points, const double* x, const double* y,
+            const double* z, const size_t n) {
+            for (size_t first = 0; first < n; first += distance_kernel_block) {
+                const size_t found = distances_within(
+                    x + first, y + first, z + first,
+                    std::min(n - first, distance_kernel_block), atom2_crd,
+                    cutoff_sq, __step_in_file, which, dists, bins);
+                for (size_t f = 0; f < found; ++f) {
+                    const molib::Atom* atom1 = points[first + which[f]];
+                    const size_t pair_idx =
+                        __get_pair_index(atom1->idatm_type(), atom_2);
+                    const size_t idx = bins[f];
+
+                    // beyond the cutoff of every function (see the close
+                    // calls of Score::non_bonded_energy)
+                    if (idx >= __num_bins) {
+                        continue;
+                    }
+
+                    const double* energies =
+                        &__energies_table[pair_idx * __pair_size +
+                                          __bin_offset[idx]];
+                    const size_t num_active = __num_active[idx];
+                    for (size_t rank = 0; rank < num_active; ++rank) {
+                        energy_sum[rank] += energies[rank];
+                    }
+                }
+            }
+        });
+    }
+
+    vector<double> result(__order.size());
+    for (size_t rank = 0; rank < __order.size(); ++rank) {
+        result[__order[rank]] = energy_sum[rank];
+    }
+    return result;
+}
+
+void MultiScore::score_batch(const molib::Atom::Grid& gridrec,
+                             const vector<const molib::Molecule*>& ligands,
+                             vector<vector<double>>& out,
+                             parallel::ThreadPool& pool) const {
+    out.assign(ligands.size(), vector<double>());
+    // ligands differ a lot in size, so hand them out one at a time
+    pool.parallel_for(0, ligands.size(),
+                      [&](size_t i) {
+                          out[i] = non_bonded_energy(gridrec, *ligands[i]);
+                      },
+                      1);
+}
+}
+}
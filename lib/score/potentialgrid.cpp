@@ -0,0 +1,337 @@
+/* This is potentialgrid.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/score/potentialgrid.hpp"
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <thread>
+#include "statchem/helper/benchmark.hpp"
+#include "statchem/helper/checksum.hpp"
+#include "statchem/helper/error.hpp"
+#include "statchem/helper/help.hpp"
+#include "statchem/helper/logger.hpp"
+#include "statchem/molib/molecule.hpp"
+#include "statchem/score/score.hpp"
+using namespace std;
+
+namespace statchem {
+namespace score {
+
+namespace {
+const char potential_grid_magic[8] = {'S', 'T', 'C', 'H', 'P', 'O', 'T', 'G'};
+const uint32_t potential_grid_version = 1;
+
+// Identifies the receptor by the types and positions of its atoms
+uint64_t receptor_checksum(const molib::Atom::Grid& gridrec) {
+    const uint64_t num_atoms = gridrec.get_points().size();
+    uint64_t hash = checksum(&num_atoms, sizeof(num_atoms));
+    for (auto& patom : gridrec.get_points()) {
+        const int32_t idatm_type = patom->idatm_type();
+        const double crd[3] = {patom->crd().x(), patom->crd().y(),
+                               patom->crd().z()};
+        hash = checksum(&idatm_type, sizeof(idatm_type), hash);
+        hash = checksum(crd, sizeof(crd), hash);
+    }
+    return hash;
+}
+}
+
+ReceptorPotentialGrid::ReceptorPotentialGrid(
+    const Score& score, const molib::Atom::Grid& gridrec,
+    const geometry::Coordinate& min_crd, const geometry::Coordinate& max_crd,
+    const set<int>& ligand_atom_types, const double spacing,
+    const size_t num_threads)
+    : __origin(min_crd), __spacing(spacing) {
+    if (spacing <= 0) {
+        throw Error("die : potential grid spacing must be positive");
+    }
+    const geometry::Coordinate size = max_crd - min_crd;
+    if (size.x() < 0 || size.y() < 0 || size.z() < 0) {
+        throw Error("die : potential grid box has negative size");
+    }
+    // two extra points so that max_crd is inside the last cell
+    __ni = static_cast<size_t>(std::floor(size.x() / spacing)) + 2;
+    __nj = static_cast<size_t>(std::floor(size.y() / spacing)) + 2;
+    __nk = static_cast<size_t>(std::floor(size.z() / spacing)) + 2;
+
+    __init_types(ligand_atom_types);
+    __compute(score, gridrec, num_threads);
+}
+
+ReceptorPotentialGrid::ReceptorPotentialGrid(
+    const Score& score, const molib::Atom::Vec& receptor_atoms,
+    const set<int>& ligand_atom_types, const double spacing,
+    const size_t num_threads)
+    : __spacing(spacing) {
+    if (spacing <= 0) {
+        throw Error("die : potential grid spacing must be positive");
+    }
+    if (receptor_atoms.empty()) {
+        throw Error("die : cannot build a potential grid without receptor");
+    }
+    geometry::Coordinate min_crd(HUGE_VAL, HUGE_VAL, HUGE_VAL),
+        max_crd(-HUGE_VAL, -HUGE_VAL, -HUGE_VAL);
+    for (auto& patom : receptor_atoms) {
+        const geometry::Coordinate& crd = patom->crd();
+        min_crd = geometry::Coordinate(std::min(min_crd.x(), crd.x()),
+                                       std::min(min_crd.y(), crd.y()),
+                                       std::min(min_crd.z(), crd.z()));
+        max_crd = geometry::Coordinate(std::max(max_crd.x(), crd.x()),
+                                       std::max(max_crd.y(), crd.y()),
+                                       std::max(max_crd.z(), crd.z()));
+    }
+    // beyond the cutoff from every receptor atom the energy is zero
+    __origin = min_crd - score.get_dist_cutoff();
+    const geometry::Coordinate size =
+        max_crd + score.get_dist_cutoff() - __origin;
+    __ni = static_cast<size_t>(std::floor(size.x() / spacing)) + 2;
+    __nj = static_cast<size_t>(std::floor(size.y() / spacing)) + 2;
+    __nk = static_cast<size_t>(std::floor(size.z() / spacing)) + 2;
+
+    __init_types(ligand_atom_types);
+    const molib::Atom::Grid gridrec(receptor_atoms);
+    __compute(score, gridrec, num_threads);
+}
+
+void ReceptorPotentialGrid::__init_types(const set<int>& ligand_atom_types) {
+    if (ligand_atom_types.empty()) {
+        throw Error("die : potential grid needs at least one ligand atom type");
+    }
+    __types.assign(ligand_atom_types.begin(), ligand_atom_types.end());
+    __type_index.assign(
+        std::max<size_t>(help::idatm_mask.size(), __types.back() + 1), -1);
+    for (size_t m = 0; m < __types.size(); ++m) {
+        __type_index.at(__types[m]) = m;
+    }
+}
+
+void ReceptorPotentialGrid::__compute(const Score& score,
+                                      const molib::Atom::Grid& gridrec,
+                                      const size_t num_threads) {
+    __score_settings = score.get_settings();
+    __receptor_checksum = receptor_checksum(gridrec);
+
+    Benchmark bench;
+    log_step << "Computing receptor potential grid of " << __ni << "x" << __nj
+             << "x" << __nk << " points for " << __types.size()
+             << " ligand atom types...\n";
+
+    const size_t num_points = __num_points();
+    __values.assign(__types.size() * num_points, 0.0);
+    const set<int> ligand_atom_types(__types.begin(), __types.end());
+    const size_t nthreads = std::max<size_t>(1, num_threads);
+
+    std::vector<std::thread> threads;
+    for (size_t thread_id = 0; thread_id < nthreads; ++thread_id) {
+        threads.push_back(std::thread([&, thread_id] {
+            for (size_t i = thread_id; i < __ni; i += nthreads) {
+                for (size_t j = 0; j < __nj; ++j) {
+                    for (size_t k = 0; k < __nk; ++k) {
+                        const geometry::Coordinate crd(
+                            __origin.x() + i * __spacing,
+                            __origin.y() + j * __spacing,
+                            __origin.z() + k * __spacing);
+                        const Array1d<double> energy =
+                            score.compute_energy(gridrec, crd,
+                                                 ligand_atom_types);
+                        for (size_t m = 0; m < __types.size(); ++m) {
+                            __values[m * num_points + __index(i, j, k)] =
+                                energy.data[__types[m]];
+                        }
+                    }
+                }
+            }
+        }));
+    }
+
+    for (auto&& thread : threads) {
+        thread.join();
+    }
+
+    log_benchmark << "time to compute receptor potential grid "
+                  << bench.seconds_from_start() << " wallclock seconds"
+                  << "\n";
+}
+
+double ReceptorPotentialGrid::energy(const int idatm_type,
+                                     const geometry::Coordinate& crd) const {
+    if (!has_type(idatm_type)) {
+        throw Error("die : no potential map for ligand atom type " +
+                    std::to_string(idatm_type));
+    }
+
+    const double fx = (crd.x() - __origin.x()) / __spacing;
+    const double fy = (crd.y() - __origin.y()) / __spacing;
+    const double fz = (crd.z() - __origin.z()) / __spacing;
+
+    if (fx < 0 || fy < 0 || fz < 0) return 0.0;
+
+    const size_t i = static_cast<size_t>(fx);
+    const size_t j = static_cast<size_t>(fy);
+    const size_t k = static_cast<size_t>(fz);
+
+    if (i + 1 >= __ni || j + 1 >= __nj || k + 1 >= __nk) return 0.0;
+
+    const double tx = fx - i, ty = fy - j, tz = fz - k;
+    const double* v = &__values[__type_index[idatm_type] * __num_points()];
+
+    const double c00 =
+        v[__index(i, j, k)] * (1 - tx) + v[__index(i + 1, j, k)] * tx;
+    const double c10 =
+        v[__index(i, j + 1, k)] * (1 - tx) + v[__index(i + 1, j + 1, k)] * tx;
+    const double c01 =
+        v[__index(i, j, k + 1)] * (1 - tx) + v[__index(i + 1, j, k + 1)] * tx;
+    const double c11 = v[__index(i, j + 1, k + 1)] * (1 - tx) +
+                       v[__index(i + 1, j + 1, k + 1)] * tx;
+    const double c0 = c00 * (1 - ty) + c10 * ty;
+    const double c1 = c01 * (1 - ty) + c11 * ty;
+
+    return c0 * (1 - tz) + c1 * tz;
+}
+
+double ReceptorPotentialGrid::non_bonded_energy(
+    const molib::Molecule& ligand) const {
+    return this->non_bonded_energy(ligand.get_atoms(), ligand.get_crds());
+}
+
+double ReceptorPotentialGrid::non_bonded_energy(
+    const molib::Atom::Vec& atoms, const geometry::Point::Vec& crds) const {
+    double energy_sum = 0.0;
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        energy_sum += energy(atoms[i]->idatm_type(), crds[i]);
+    }
+    return energy_sum;
+}
+
+/* The file is a native endian binary dump : magic, version, the length and
+ * text of the score settings, the receptor checksum, origin, spacing, lattice
+ * dimensions, the list of ligand types and then all maps in the same
+ * [map][i][j][k] order as in memory.
+ */
+void ReceptorPotentialGrid::save(const string& filename) const {
+    ofstream out(filename, ios::out | ios::binary | ios::trunc);
+    if (!out.is_open()) {
+        throw Error("Cannot open output file: " + filename);
+    }
+
+    const double origin[3] = {__origin.x(), __origin.y(), __origin.z()};
+    const uint64_t dims[3] = {__ni, __nj, __nk};
+    const uint64_t num_types = __types.size();
+    const vector<int32_t> types(__types.begin(), __types.end());
+
+    out.write(potential_grid_magic, sizeof(potential_grid_magic));
+    out.write(reinterpret_cast<const char*>(&potential_grid_version),
+              sizeof(potential_grid_version));
+    const uint64_t settings_size = __score_settings.size();
+    out.write(reinterpret_cast<const char*>(&settings_size),
+              sizeof(settings_size));
+    out.write(__score_settings.data(), settings_size);
+    out.write(reinterpret_cast<const char*>(&__receptor_checksum),
+              sizeof(__receptor_checksum));
+    out.write(reinterpret_cast<const char*>(origin), sizeof(origin));
+    out.write(reinterpret_cast<const char*>(&__spacing), sizeof(__spacing));
+    out.write(reinterpret_cast<const char*>(dims), sizeof(dims));
+    out.write(reinterpret_cast<const char*>(&num_types), sizeof(num_types));
+    out.write(reinterpret_cast<const char*>(types.data()),
+              types.size() * sizeof(int32_t));
+    out.write(reinterpret_cast<const char*>(__values.data()),
+              __values.size() * sizeof(double));
+
+    if (!out) {
+        throw Error("Cannot write potential grid to " + filename);
+    }
+}
+
+ReceptorPotentialGrid::ReceptorPotentialGrid(const string& filename,
+                                             const Score& score,
+                                             const molib::Atom::Grid& gridrec) {
+    ifstream in(filename, ios::in | ios::binary);
+    if (!in.is_open()) {
+        throw Error("Cannot read " + filename);
+    }
+
+    char magic[sizeof(potential_grid_magic)];
+    uint32_t version = 0;
+    double origin[3];
+    uint64_t dims[3];
+    uint64_t num_types = 0;
+
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(&version), sizeof(version));
+    if (!in || memcmp(magic, potential_grid_magic, sizeof(magic)) != 0 ||
+        version != potential_grid_version) {
+        throw Error("die : " + filename + " is not a potential grid file");
+    }
+
+    uint64_t settings_size = 0;
+    in.read(reinterpret_cast<char*>(&settings_size), sizeof(settings_size));
+    if (!in || settings_size > 1 << 20) {
+        throw Error("die : corrupted potential grid file " + filename);
+    }
+    __score_settings.resize(settings_size);
+    in.read(&__score_settings[0], settings_size);
+    in.read(reinterpret_cast<char*>(&__receptor_checksum),
+            sizeof(__receptor_checksum));
+    if (!in) {
+        throw Error("die : corrupted potential grid file " + filename);
+    }
+    if (__score_settings != score.get_settings()) {
+        throw Error("die : " + filename +
+                    " was computed with another scoring function (" +
+                    __score_settings + ")");
+    }
+    if (__receptor_checksum != receptor_checksum(gridrec)) {
+        throw Error("die : " + filename +
+                    " was computed for another receptor");
+    }
+
+    in.read(reinterpret_cast<char*>(origin), sizeof(origin));
+    in.read(reinterpret_cast<char*>(&__spacing), sizeof(__spacing));
+    in.read(reinterpret_cast<char*>(dims), sizeof(dims));
+    in.read(reinterpret_cast<char*>(&num_types), sizeof(num_types));
+    if (!in || __spacing <= 0 || num_types == 0 ||
+        num_types > help::idatm_mask.size()) {
+        throw Error("die : corrupted potential grid file " + filename);
+    }
+
+    __origin = geometry::Coordinate(origin[0], origin[1], origin[2]);
+    __ni = dims[0];
+    __nj = dims[1];
+    __nk = dims[2];
+
+    vector<int32_t> types(num_types);
+    in.read(reinterpret_cast<char*>(types.data()),
+            types.size() * sizeof(int32_t));
+    if (!in) {
+        throw Error("die : corrupted potential grid file " + filename);
+    }
+    for (auto& type : types) {
+        if (type < 0 || static_cast<size_t>(type) >= help::idatm_mask.size()) {
+            throw Error("die : corrupted potential grid file " + filename);
+        }
+    }
+    __init_types(set<int>(types.begin(), types.end()));
+
+    __values.resize(__types.size() * __num_points());
+    in.read(reinterpret_cast<char*>(__values.data()),
+            __values.size() * sizeof(double));
+    if (!in || in.peek() != ifstream::traits_type::eof()) {
+        throw Error("die : corrupted potential grid file " + filename);
+    }
+}
+}
+}
@@ -18,13 +18,17 @@
 #include <boost/filesystem/operations.hpp>
 #include <boost/filesystem/path.hpp>
 #include <functional>
+#include <iomanip>
 #include <string>
 #include "statchem/fileio/inout.hpp"
+#include "statchem/helper/checksum.hpp"
 #include "statchem/helper/help.hpp"
 #include "statchem/helper/path.hpp"
 #include "statchem/helper/benchmark.hpp"
 #include "statchem/helper/logger.hpp"
 #include "statchem/molib/molecule.hpp"
+#include "statchem/score/distkernel.hpp"
+#include "statchem/score/tablecache.hpp"
 using namespace std;
 
 namespace statchem {
@@ -69,29 +73,21 @@ Array1d<double> Score::compute_energy(const molib::Atom::Grid& gridrec,
                                       const set<int>& ligand_atom_types) const {
     dbgmsg("computing energy");
     Array1d<double> energy_sum(*ligand_atom_types.rbegin() + 1);
-    for (auto& patom : gridrec.get_neighbors(crd, __dist_cutoff)) {
-        const double dist = patom->crd().distance(crd);
+    gridrec.for_each_neighbor(crd, __dist_cutoff, [&](const molib::Atom* patom,
+                                                      double d_sq) {
+        const double dist = sqrt(d_sq);
         const auto& atom_1 = patom->idatm_type();
         const int index = __get_index(dist);
         for (auto& l : ligand_atom_types) {
-            auto atom_pair = minmax(atom_1, l);
+            const size_t pair_idx = __get_pair_index(atom_1, l);
 #ifndef NDEBUG
-            if (!__energies_scoring.count(atom_pair))
-                throw Error("undefined atom_pair in __energies_scoring");
-            if (static_cast<size_t>(index) >=
-                __energies_scoring.at(atom_pair).size())
-                throw Error("undefined index in __energies_scoring");
             dbgmsg("atom pairs = "
-                   << help::idatm_unmask[atom_pair.first] << " "
-                   << help::idatm_unmask[atom_pair.second]
+                   << help::idatm_unmask[std::min(atom_1, l)] << " "
+                   << help::idatm_unmask[std::max(atom_1, l)]
                    << " index = " << index << " dist = " << dist
-                   << " __energies_scoring.at(atom_pair).size() = "
-                   << __energies_scoring.at(atom_pair).size()
-                   << " partial energy = "
-                   << __energies_scoring.at(atom_pair).at(index));
+                   << " __num_bins = " << __num_bins);
 #endif
-            if (static_cast<size_t>(index) >=
-                __energies_scoring.at(atom_pair).size()) {
+            if (static_cast<size_t>(index) >= __num_bins) {
                 log_warning << "An index from get_neighbors is greater than "
                                "cutoff by step_in_file ("
                             << index << " and "
@@ -101,13 +97,30 @@ Array1d<double> Score::compute_energy(const molib::Atom::Grid& gridrec,
                             << " -- Setting point's score to zero." << endl;
                 continue;
             }
-            energy_sum.data[l] += __energies_scoring.at(atom_pair).at(index);
+            energy_sum.data[l] += __get_energies(pair_idx)[index];
         }
-    }
+    });
     dbgmsg("out of compute energy energy_sum = " << energy_sum);
     return energy_sum;
 }
 
+string Score::get_settings() const {
+    stringstream ss;
+    ss << setprecision(17) << "ref " << __ref_state << " comp " << __comp
+       << " func " << __rad_or_raw << " cutoff " << __dist_cutoff << " step "
+       << __step_in_file << " types";
+    for (size_t idatm_type = 0; idatm_type < __type_index.size();
+         ++idatm_type) {
+        if (__type_index[idatm_type] >= 0) {
+            ss << " " << help::idatm_unmask[idatm_type];
+        }
+    }
+    ss << " table " << hex << setw(16) << setfill('0')
+       << checksum(__energies_table.data(),
+                   __energies_table.size() * sizeof(double));
+    return ss.str();
+}
+
 Score& Score::define_composition(const set<int>& receptor_idatm_types,
                                  const set<int>& ligand_idatm_types) {
     if (__prot_lig_pairs.size()) {
@@ -147,13 +160,41 @@ Score& Score::define_composition(const set<int>& receptor_idatm_types,
 }
 
 AtomicDistributions::AtomicDistributions(const std::string& filename) {
-    std::vector<std::string> distributions_file_raw;
-    fileio::read_file(filename, distributions_file_raw);
+    if (!boost::filesystem::exists(filename)) {
+        __read_text(filename);  // throws the usual error
+        return;
+    }
+
+    const std::string cache_file = filename + ".bin";
+    const std::string user_cache_file = __user_cache_file(filename);
+    const uint64_t source_size = boost::filesystem::file_size(filename);
+    const int64_t source_time = boost::filesystem::last_write_time(filename);
+
+    if (__load_cache(cache_file, source_size, source_time) ||
+        (!user_cache_file.empty() &&
+         __load_cache(user_cache_file, source_size, source_time))) {
+        return;
+    }
+
+    __read_text(filename);
+    if (!__save_cache(cache_file, source_size, source_time) &&
+        (user_cache_file.empty() ||
+         !__save_cache(user_cache_file, source_size, source_time))) {
+        log_warning << "Warning: could not write distributions cache "
+                    << cache_file << "\n";
+    }
+}
+
+void AtomicDistributions::__read_text(const std::string& filename) {
+    // the file is large, so it is read a line at a time
+    std::unique_ptr<std::istream> distributions_file =
+        fileio::open_input_file(filename);
 
     step_in_file = -1;
     max_distance = 0;
 
-    for (const string& line : distributions_file_raw) {
+    string line;
+    while (getline(*distributions_file, line)) {
         stringstream ss(line);  // dist_file is simply too big to use boost
         string atom_1, atom_2;
         double lower_bound, upper_bound, quantity;
@@ -185,6 +226,10 @@ AtomicDistributions::AtomicDistributions(const std::string& filename) {
 
         map_loc->second[current_index] = quantity;
     }
+
+    if (distributions_file->bad()) {
+        throw Error("die : could not read distributions from " + filename);
+    }
 }
 
 Score& Score::process_distributions(const AtomicDistributions& distributions) {
@@ -231,6 +276,76 @@ Score& Score::process_distributions(const AtomicDistributions& distributions) {
             __total_quantity += quantity / shell_volume;
         }
     }
+    __sum_gij_of_r_bin_ranges();
+    log_benchmark << "time to process distributions file "
+                  << bench.seconds_from_start() << " wallclock seconds"
+                  << "\n";
+    return *this;
+}
+
+Score& Score::process_distributions(const std::string& distributions_file) {
+    AtomicDistributions distributions(distributions_file);
+    return process_distributions(distributions);
+}
+
+Score& Score::process_distributions(const Score& wider) {
+    Benchmark bench;
+    log_step << "processing combined histogram of a wider cutoff ...\n";
+
+    if (__gij_of_r_numerator.size()) {
+        throw std::runtime_error("Attempt to process distribution twice!");
+    }
+
+    if (wider.__step_in_file < 0 || wider.__dist_cutoff < __dist_cutoff ||
+        wider.__rad_or_raw != __rad_or_raw ||
+        wider.__prot_lig_pairs != __prot_lig_pairs) {
+        throw Error(
+            "die : distributions can only be shared with a processed "
+            "scoring function of the same composition and a wider cutoff");
+    }
+
+    // a scoring function loaded from a TableCache has only its energies
+    if (wider.__gij_of_r_numerator.empty()) {
+        throw Error(
+            "die : distributions cannot be shared with a scoring function "
+            "loaded from the compiled table cache");
+    }
+
+    // wider holds quantity / shell_volume of every bin below its cutoff,
+    // so only the sums (in the same order as above) need to be redone
+    __step_in_file = wider.__step_in_file;
+    size_t cuttoff_index = __get_index(__dist_cutoff);
+    __bin_range_sum.resize(cuttoff_index);
+
+    for (const auto& atom_interactions : wider.__gij_of_r_numerator) {
+        const auto& atom_pair = atom_interactions.first;
+
+        vector<double>& gij_of_r_numerator = __gij_of_r_numerator[atom_pair];
+        gij_of_r_numerator.resize(cuttoff_index);
+        double& sum_gij_of_r_numerator = __sum_gij_of_r_numerator[atom_pair];
+        sum_gij_of_r_numerator = 0;
+
+        for (size_t index = 0; index < atom_interactions.second.size();
+             ++index) {
+            if (__get_lower_bound(index + 1) > __dist_cutoff) {
+                break;
+            }
+
+            const double value = atom_interactions.second[index];
+            gij_of_r_numerator[index] = value;
+            sum_gij_of_r_numerator += value;
+            __bin_range_sum[index] += value;
+            __total_quantity += value;
+        }
+    }
+    __sum_gij_of_r_bin_ranges();
+    log_benchmark << "time to process distributions "
+                  << bench.seconds_from_start() << " wallclock seconds"
+                  << "\n";
+    return *this;
+}
+
+void Score::__sum_gij_of_r_bin_ranges() {
     // JANEZ : next part only needed for compile_mean_scoring_function
     __gij_of_r_bin_range_sum.resize(__get_index(__dist_cutoff) + 1, 0);
     for (auto& el1 : __gij_of_r_numerator) {
@@ -247,15 +362,6 @@ Score& Score::process_distributions(const AtomicDistributions& distributions) {
             }
         }
     }
-    log_benchmark << "time to process distributions file "
-                  << bench.seconds_from_start() << " wallclock seconds"
-                  << "\n";
-    return *this;
-}
-
-Score& Score::process_distributions(const std::string& distributions_file) {
-    AtomicDistributions distributions(distributions_file);
-    return process_distributions(distributions);
 }
 
 Score& Score::compile_scoring_function() {
@@ -306,11 +412,84 @@ Score& Score::compile_scoring_function() {
         __energies_scoring[atom_pair] = energy;
     }
     dbgmsg("out of loop");
+    __compile_energies_table();
+    return *this;
+}
+
+Score& Score::compile_scoring_function(const string& distributions_file,
+                                       const string& cache_dir) {
+    if (cache_dir.empty()) {
+        return process_distributions(distributions_file)
+            .compile_scoring_function();
+    }
+
+    const TableCache cache(cache_dir);
+    const string settings = __cache_settings();
+    const string key = cache.key(distributions_file, settings);
+
+    CompiledTables tables;
+    if (cache.load(key, settings, tables)) {
+        log_step << "Loaded compiled scoring function " << key << "\n";
+        __step_in_file = tables.step_in_file;
+        __energies_scoring.swap(tables.scoring);
+        __compile_energies_table();
+        return *this;
+    }
+
+    process_distributions(distributions_file).compile_scoring_function();
+
+    tables.step_in_file = __step_in_file;
+    tables.scoring = __energies_scoring;
+    cache.save(key, settings, tables);
     return *this;
 }
 
+string Score::__cache_settings() const {
+    set<int> idatm_types;
+    for (auto& atom_pair : __avail_prot_lig) {
+        idatm_types.insert(atom_pair.first);
+        idatm_types.insert(atom_pair.second);
+    }
+
+    stringstream ss;
+    ss << setprecision(17) << "ref " << __ref_state << " comp " << __comp
+       << " func " << __rad_or_raw << " cutoff " << __dist_cutoff
+       << " types";
+    for (auto& idatm_type : idatm_types) {
+        ss << " " << help::idatm_unmask[idatm_type];
+    }
+    return ss.str();
+}
+
+void Score::__compile_energies_table() {
+    __type_index.assign(help::idatm_mask.size(), -1);
+    __num_types = 0;
+    __num_bins = 0;
+    for (auto& kv : __energies_scoring) {
+        __type_index[kv.first.first] = 0;
+        __type_index[kv.first.second] = 0;
+        __num_bins = std::max(__num_bins, kv.second.size());
+    }
+    for (auto& local_idx : __type_index) {
+        if (local_idx == 0) local_idx = __num_types++;
+    }
+
+    const size_t num_pairs = __num_types * (__num_types + 1) / 2;
+    __energies_table.assign(num_pairs * __num_bins, 0.0);
+    __pair_defined.assign(num_pairs, false);
+
+    for (auto& kv : __energies_scoring) {
+        const size_t pair_idx = __get_pair_index_unchecked(kv.first);
+        __pair_defined[pair_idx] = true;
+        std::copy(kv.second.begin(), kv.second.end(),
+                  __energies_table.begin() + pair_idx * __num_bins);
+    }
+    dbgmsg("compiled energies table with "
+           << __num_types << " atom types and " << __num_bins << " bins");
+}
+
 double Score::__energy_mean(const pair_of_ints& atom_pair,
-                            const double& lower_bound) {
+                            const double& lower_bound) const {
     const int idx = __get_index(lower_bound);
 #ifndef NDEBUG
     if (!__gij_of_r_numerator.count(atom_pair))
@@ -320,8 +499,8 @@ double Score::__energy_mean(const pair_of_ints& atom_pair,
     if (static_cast<size_t>(idx) >= __gij_of_r_bin_range_sum.size())
         throw Error("die : undefined __gij_of_r_bin_range_sum");
 #endif
-    double gij_of_r = __gij_of_r_numerator[atom_pair][idx] /
-                      __sum_gij_of_r_numerator[atom_pair];
+    double gij_of_r = __gij_of_r_numerator.at(atom_pair)[idx] /
+                      __sum_gij_of_r_numerator.at(atom_pair);
     dbgmsg("gij_of_r = " << gij_of_r);
     double denominator =
         __gij_of_r_bin_range_sum[idx] / __prot_lig_pairs.size();
@@ -331,7 +510,7 @@ double Score::__energy_mean(const pair_of_ints& atom_pair,
 }
 
 double Score::__energy_cumulative(const pair_of_ints& atom_pair,
-                                  const double& lower_bound) {
+                                  const double& lower_bound) const {
     const int idx = __get_index(lower_bound);
 #ifndef NDEBUG
     if (!__gij_of_r_numerator.count(atom_pair))
@@ -341,13 +520,33 @@ double Score::__energy_cumulative(const pair_of_ints& atom_pair,
     if (static_cast<size_t>(idx) >= __bin_range_sum.size())
         throw Error("die : undefined __bin_range_sum");
 #endif
-    double numerator = __gij_of_r_numerator[atom_pair][idx] /
-                       __sum_gij_of_r_numerator[atom_pair];
+    double numerator = __gij_of_r_numerator.at(atom_pair)[idx] /
+                       __sum_gij_of_r_numerator.at(atom_pair);
     double denominator = __bin_range_sum[idx] / __total_quantity;
     double ratio = numerator / denominator;
     return -log(ratio);
 }
 
+void Score::score_batch(const molib::Atom::Grid& gridrec,
+                        const std::vector<const molib::Molecule*>& ligands,
+                        std::vector<double>& out, const size_t nthreads) const {
+    parallel::ThreadPool pool(std::max<size_t>(1, nthreads));
+    score_batch(gridrec, ligands, out, pool);
+}
+
+void Score::score_batch(const molib::Atom::Grid& gridrec,
+                        const std::vector<const molib::Molecule*>& ligands,
+                        std::vector<double>& out,
+                        parallel::ThreadPool& pool) const {
+    out.assign(ligands.size(), 0.0);
+    // ligands differ a lot in size, so hand them out one at a time
+    pool.parallel_for(0, ligands.size(),
+                      [&](size_t i) {
+                          out[i] = non_bonded_energy(gridrec, *ligands[i]);
+                      },
+                      1);
+}
+
 double Score::non_bonded_energy(const molib::Atom::Grid& gridrec,
                                 const molib::Molecule& ligand) const {
     return this->non_bonded_energy(gridrec, ligand.get_atoms(),
@@ -357,6 +556,10 @@ double Score::non_bonded_energy(const molib::Atom::Grid& gridrec,
 double Score::non_bonded_energy(const molib::Atom::Grid& gridrec,
                                 const molib::Atom::Vec& atoms,
                                 const geometry::Point::Vec& crds) const {
+    const double cutoff_sq = pow(__dist_cutoff, 2);
+    uint32_t which[distance_kernel_block];
+    double dists[distance_kernel_block];
+    int bins[distance_kernel_block];
     double energy_sum = 0.0;
     for (size_t i = 0; i < atoms.size(); ++i) {
         const molib::Atom& atom2 = *atoms[i];
@@ -364,39 +567,53 @@ double Score::non_bonded_energy(const molib::Atom::Grid& gridrec,
         const auto& atom_2 = atom2.idatm_type();
         dbgmsg("ligand atom = " << atom2.atom_number()
                                 << " crd= " << atom2_crd.pdb());
-        for (auto& atom1 : gridrec.get_neighbors(atom2_crd, __dist_cutoff)) {
-            const double dist = atom1->crd().distance(atom2_crd);
-            dbgmsg("dist = " << setprecision(12) << dist);
-            dbgmsg("dist_sq = " << setprecision(12)
-                                << atom1->crd().distance_sq(atom2_crd));
-            const auto& atom_1 = atom1->idatm_type();
-            const pair_of_ints atom_pair = minmax(atom_1, atom_2);
-            const size_t idx = __get_index(dist);
-
-            // The index function can produce values that are too large due to
-            // the +0.0000000001
-            // We ignore these values because they are technically > the cutoff,
-            // if only by a little
-            if (idx < __energies_scoring.at(atom_pair).size()) {
-                energy_sum += __energies_scoring.at(atom_pair).at(idx);
-            } else {
-                log_warning
-                    << "Close call: " << setprecision(12) << dist << " "
-                    << atom1->crd() << "\t" << atom2_crd << " "
-                    << "difference: " << __energies_scoring.at(atom_pair).back()
-                    << endl;
-            }
+        gridrec.for_each_candidate_run(atom2_crd, __dist_cutoff, [&](
+            molib::Atom* const* points, const double* x, const double* y,
+            const double* z, const size_t n) {
+            for (size_t first = 0; first < n; first += distance_kernel_block) {
+                const size_t found = distances_within(
+                    x + first, y + first, z + first,
+                    std::min(n - first, distance_kernel_block), atom2_crd,
+                    cutoff_sq, __step_in_file, which, dists, bins);
+                for (size_t f = 0; f < found; ++f) {
+                    const molib::Atom* atom1 = points[first + which[f]];
+                    const double dist = dists[f];
+                    dbgmsg("dist = " << setprecision(12) << dist);
+                    const auto& atom_1 = atom1->idatm_type();
+                    const double* energies =
+                        __get_energies(__get_pair_index(atom_1, atom_2));
+                    const size_t idx = bins[f];
+
+                    // The index function can produce values that are too
+                    // large due to the +0.0000000001
+                    // We ignore these values because they are technically >
+                    // the cutoff, if only by a little
+                    if (idx < __num_bins) {
+                        energy_sum += energies[idx];
+                    } else {
+                        log_warning << "Close call: " << setprecision(12)
+                                    << dist << " " << atom1->crd() << "\t"
+                                    << atom2_crd << " "
+                                    << "difference: "
+                                    << energies[__num_bins - 1] << endl;
+                    }
 #ifndef NDEBUG
-            dbgmsg("ligand atom = "
-                   << atom2.atom_number() << " crd= " << atom2_crd.pdb()
-                   << "protein atom = " << atom1->atom_number()
-                   << " crd= " << atom1->crd().pdb() << " dist= " << dist
-                   << " atom_pair={" << help::idatm_unmask[atom_pair.first]
-                   << "," << help::idatm_unmask[atom_pair.second] << "}"
-                   << " lower_bound= " << __get_lower_bound(idx)
-                   << " energy_sum=" << energy_sum);
+                    dbgmsg("ligand atom = "
+                           << atom2.atom_number() << " crd= "
+                           << atom2_crd.pdb()
+                           << "protein atom = " << atom1->atom_number()
+                           << " crd= " << atom1->crd().pdb()
+                           << " dist= " << dist << " atom_pair={"
+                           << help::idatm_unmask[std::min(atom_1, atom_2)]
+                           << ","
+                           << help::idatm_unmask[std::max(atom_1, atom_2)]
+                           << "}"
+                           << " lower_bound= " << __get_lower_bound(idx)
+                           << " energy_sum=" << energy_sum);
 #endif
-        }
+                }
+            }
+        });
     }
     dbgmsg("exiting non_bonded_energy");
     return energy_sum;
@@ -0,0 +1,234 @@
+/* This is tablecache.cpp and is part of StatChemLIB
+ * Copyright (c) 2016-2019 Chopra Lab at Purdue University, 2013-2016 Janez Konc at National Institute of Chemistry and Samudrala Group at University of Washington
+ *
+ * This program is free for educational and academic use.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation version 3 of the License.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ */
+
+#include "statchem/score/tablecache.hpp"
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "statchem/fileio/mappedfile.hpp"
+#include "statchem/helper/checksum.hpp"
+#include "statchem/helper/debug.hpp"
+#include "statchem/helper/logger.hpp"
+#include "statchem/helper/path.hpp"
+using namespace std;
+
+namespace statchem {
+namespace score {
+
+/* Each entry is a native endian binary file <key>.tables :
+ *
+ *   header   magic, version, byte order mark, payload size and checksum
+ *   payload  the settings description, step_in_file, the scoring and
+ *            objective functions as (type1, type2, length, values...) and
+ *            the pairs whose objective function could not be fitted
+ */
+namespace {
+const char tables_magic[8] = {'S', 'T', 'C', 'H', 'T', 'A', 'B', 'L'};
+const uint32_t tables_version = 1;
+const uint32_t byte_order_mark = 0x01020304;
+
+struct TablesHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byte_order;
+    uint64_t payload_size;
+    uint64_t checksum;
+};
+
+template <typename T>
+void put(string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void put_values(string& out, const AtomPairValues& values) {
+    put<uint64_t>(out, values.size());
+    for (const auto& kv : values) {
+        put<int32_t>(out, kv.first.first);
+        put<int32_t>(out, kv.first.second);
+        put<uint64_t>(out, kv.second.size());
+        out.append(reinterpret_cast<const char*>(kv.second.data()),
+                   kv.second.size() * sizeof(double));
+    }
+}
+
+// Reads the payload back, every get fails instead of reading past the end
+class Reader {
+    const char* __pos;
+    const char* const __end;
+
+   public:
+    Reader(const char* data, const size_t size)
+        : __pos(data), __end(data + size) {}
+
+    bool get_bytes(void* out, const size_t size) {
+        if (size > static_cast<size_t>(__end - __pos)) {
+            return false;
+        }
+        memcpy(out, __pos, size);
+        __pos += size;
+        return true;
+    }
+
+    template <typename T>
+    bool get(T& value) {
+        return get_bytes(&value, sizeof(value));
+    }
+
+    bool get_values(AtomPairValues& values) {
+        uint64_t num_pairs;
+        if (!get(num_pairs)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < num_pairs; ++i) {
+            int32_t first, second;
+            uint64_t length;
+            if (!get(first) || !get(second) || !get(length) ||
+                length > static_cast<size_t>(__end - __pos) / sizeof(double)) {
+                return false;
+            }
+            vector<double>& energy = values[{first, second}];
+            energy.resize(length);
+            get_bytes(energy.data(), length * sizeof(double));
+        }
+        return true;
+    }
+
+    bool at_end() const { return __pos == __end; }
+};
+}
+
+string TableCache::key(const string& distributions_file,
+                       const string& settings) const {
+    const fileio::MappedFile file(distributions_file);
+    const uint64_t hash = checksum(settings.data(), settings.size(),
+                                   checksum(file.data(), file.size()));
+    stringstream ss;
+    ss << hex << setw(16) << setfill('0') << hash;
+    return ss.str();
+}
+
+bool TableCache::load(const string& key, const string& settings,
+                      CompiledTables& tables) const {
+    const string cache_file = Path::join(__cache_dir, key + ".tables");
+    if (!boost::filesystem::exists(cache_file)) {
+        return false;
+    }
+
+    const fileio::MappedFile file(cache_file);
+    const char* const data = file.data();
+    const size_t size = file.size();
+
+    TablesHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, tables_magic, sizeof(header.magic)) != 0 ||
+        header.version != tables_version ||
+        header.byte_order != byte_order_mark ||
+        header.payload_size != size - sizeof(header) ||
+        checksum(data + sizeof(header), size - sizeof(header)) !=
+            header.checksum) {
+        dbgmsg("compiled tables " << cache_file << " are invalid");
+        return false;
+    }
+
+    Reader in(data + sizeof(header), size - sizeof(header));
+
+    uint64_t settings_size;
+    if (!in.get(settings_size) || settings_size != settings.size()) {
+        return false;
+    }
+    string stored_settings(settings_size, '\0');
+    if (!in.get_bytes(&stored_settings[0], settings_size) ||
+        stored_settings != settings) {
+        dbgmsg("compiled tables " << cache_file
+                                  << " were compiled with other settings");
+        return false;
+    }
+
+    CompiledTables loaded;
+    uint64_t num_unavailable;
+    if (!in.get(loaded.step_in_file) || !in.get_values(loaded.scoring) ||
+        !in.get_values(loaded.objective) || !in.get(num_unavailable)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < num_unavailable; ++i) {
+        int32_t first, second;
+        if (!in.get(first) || !in.get(second)) {
+            return false;
+        }
+        loaded.unavailable.insert({first, second});
+    }
+    if (!in.at_end()) {
+        return false;
+    }
+
+    tables = std::move(loaded);
+    return true;
+}
+
+void TableCache::save(const string& key, const string& settings,
+                      const CompiledTables& tables) const {
+    string payload;
+    put<uint64_t>(payload, settings.size());
+    payload.append(settings);
+    put(payload, tables.step_in_file);
+    put_values(payload, tables.scoring);
+    put_values(payload, tables.objective);
+    put<uint64_t>(payload, tables.unavailable.size());
+    for (const auto& atom_pair : tables.unavailable) {
+        put<int32_t>(payload, atom_pair.first);
+        put<int32_t>(payload, atom_pair.second);
+    }
+
+    TablesHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, tables_magic, sizeof(header.magic));
+    header.version = tables_version;
+    header.byte_order = byte_order_mark;
+    header.payload_size = payload.size();
+    header.checksum = checksum(payload.data(), payload.size());
+
+    const string cache_file = Path::join(__cache_dir, key + ".tables");
+
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(__cache_dir, ec);
+
+    // written under a temporary name and renamed, so concurrent runs never
+    // see a partial entry
+    const string temp_file =
+        cache_file + "." + boost::filesystem::unique_path().string();
+
+    ofstream out(temp_file, ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(payload.data(), payload.size());
+    out.close();
+
+    if (out) {
+        boost::filesystem::rename(temp_file, cache_file, ec);
+    }
+
+    if (!out || ec) {
+        boost::filesystem::remove(temp_file, ec);
+        log_warning << "Warning: could not write compiled tables "
+                    << cache_file << "\n";
+    }
+}
+}
+}
@@ -15,7 +15,9 @@
 
 #include "statchem/score/xscore.hpp"
 
+#include <algorithm>
 #include "statchem/helper/help.hpp"
+#include "statchem/score/distkernel.hpp"
 
 using namespace statchem;
 
@@ -186,19 +188,34 @@ std::array<double, 5> score::vina_xscore(const molib::Atom::Grid& gridrec,
     double hydrophobic = 0.0;
     double hydrogen = 0.0;
 
+    const double cutoff_sq = 8.0 * 8.0;
+    uint32_t which[distance_kernel_block];
+    double dists[distance_kernel_block];
+
     for (size_t i = 0; i < atoms.size(); ++i) {
         const molib::Atom& atom2 = *atoms[i];
 
-        for (auto& atom1p : gridrec.get_neighbors(atom2.crd(), 8.0)) {
-            auto atom1 = *atom1p;
-            const double dist = atom1.crd().distance(atom2.crd());
-
-            gauss_1 += gauss_eval(atom1, atom2, dist, 0.0, 0.5);
-            gauss_2 += gauss_eval(atom1, atom2, dist, 3.0, 2.0);
-            rep += repulsion_eval(atom1, atom2, dist, 0);
-            hydrophobic += hydrophobic_eval(atom1, atom2, dist, 1.5, 0.5);
-            hydrogen += hydrogen_eval(atom1, atom2, dist, 0, -0.7);
-        }
+        gridrec.for_each_candidate_run(atom2.crd(), 8.0, [&](
+            molib::Atom* const* points, const double* x, const double* y,
+            const double* z, const size_t n) {
+            for (size_t first = 0; first < n; first += distance_kernel_block) {
+                const size_t found = distances_within(
+                    x + first, y + first, z + first,
+                    std::min(n - first, distance_kernel_block), atom2.crd(),
+                    cutoff_sq, 1.0, which, dists, nullptr);
+                for (size_t f = 0; f < found; ++f) {
+                    const molib::Atom& atom1 = *points[first + which[f]];
+                    const double dist = dists[f];
+
+                    gauss_1 += gauss_eval(atom1, atom2, dist, 0.0, 0.5);
+                    gauss_2 += gauss_eval(atom1, atom2, dist, 3.0, 2.0);
+                    rep += repulsion_eval(atom1, atom2, dist, 0);
+                    hydrophobic +=
+                        hydrophobic_eval(atom1, atom2, dist, 1.5, 0.5);
+                    hydrogen += hydrogen_eval(atom1, atom2, dist, 0, -0.7);
+                }
+            }
+        });
     }
 
     std::array<double, 5> ret = {gauss_1, gauss_2, rep, hydrophobic, hydrogen};
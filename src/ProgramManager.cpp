@@ -26,6 +26,7 @@
 #include "programs/KBDynamics.hpp"
 #include "programs/PhysDynamics.hpp"
 #include "programs/AssignAtomTypes.hpp"
+#include "programs/MakeStore.hpp"
 
 using namespace statchem_prog;
 
@@ -39,6 +40,7 @@ ProgramManager::ProgramManager() {
     this->add_format<KBDynamics>();
     this->add_format<PhysDynamics>();
     this->add_format<AssignAtomTypes>();
+    this->add_format<MakeStore>();
 }
 
 ProgramManager& ProgramManager::get() {
@@ -12,6 +12,7 @@ namespace fs = boost::filesystem;
 #include "statchem/fileio/inout.hpp"
 #include "statchem/molib/molecules.hpp"
 #include "statchem/parser/fileparser.hpp"
+#include "statchem/score/multiscore.hpp"
 #include "statchem/score/score.hpp"
 
 #include "programs/common.hpp"
@@ -58,13 +59,13 @@ bool AllScorePose::process_options(int argc, char* argv[]) {
         return false;
     }
 
-    __constant_receptor =
-        process_starting_inputs(vm, __receptor_mols, __ligand_mols);
-
     __num_threads = vm["ncpu"].as<int>() <= 0
                         ? std::thread::hardware_concurrency()
                         : static_cast<size_t>(vm["ncpu"].as<int>());
 
+    __constant_receptor = process_starting_inputs(vm, __receptor_mols,
+                                                  __ligand_mols, __num_threads);
+
     return true;
 }
 
@@ -90,58 +91,77 @@ int AllScorePose::run() {
     statchem::score::AtomicDistributions distributions(__dist);
 
     std::vector<std::string> scoring_names;
-    std::map<std::string, std::unique_ptr<statchem::score::Score>> scoring_map;
+    std::vector<std::unique_ptr<statchem::score::Score>> scores;
+
+    // The processed histograms depend on func and ref but not on comp, and
+    // those of a cutoff are a prefix of those of a larger one, so they are
+    // processed once per func and ref at the largest cutoff and shared
+    std::map<std::pair<std::string, std::string>,
+             std::unique_ptr<statchem::score::Score>>
+        histograms;
 
     for (std::string comp : {"mean", "cumulative"}) {
         for (std::string func : {"radial", "normalized_frequency"}) {
             for (std::string ref : {"reduced", "complete"}) {
+                auto& widest = histograms[std::make_pair(func, ref)];
+                if (!widest) {
+                    widest.reset(new statchem::score::Score(comp, ref, func,
+                                                            15));
+                    widest
+                        ->define_composition(
+                            __receptor_mols.get_idatm_types(),
+                            __ligand_mols.get_idatm_types())
+                        .process_distributions(distributions);
+                }
+
                 for (auto cutoff : {4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15}) {
                     scoring_names.emplace_back(func + "_" + comp + "_" + ref +
                                                "_" + std::to_string(cutoff));
-                    scoring_map[scoring_names.back()] =
-                        std::unique_ptr<statchem::score::Score>(
-                            new statchem::score::Score(comp, ref, func,
-                                                       cutoff));
+                    scores.emplace_back(
+                        new statchem::score::Score(comp, ref, func, cutoff));
 
-                    scoring_map[scoring_names.back()]
+                    scores.back()
                         ->define_composition(__receptor_mols.get_idatm_types(),
                                              __ligand_mols.get_idatm_types())
-                        .process_distributions(distributions)
+                        .process_distributions(*widest)
                         .compile_scoring_function();
                 }
             }
         }
     }
+    histograms.clear();
+
+    // all functions are evaluated in a single pass over the neighbors
+    std::vector<const statchem::score::Score*> score_ptrs;
+    for (const auto& score : scores) score_ptrs.push_back(score.get());
+    const statchem::score::MultiScore multi_score(score_ptrs);
+    score_ptrs.clear();
+    scores.clear();
 
     std::vector<std::vector<double>> output(__ligand_mols.size());
+    statchem::parallel::ThreadPool pool(__num_threads);
 
-    std::vector<std::thread> threads;
-    for (size_t thread_id = 0; thread_id < __num_threads; ++thread_id) {
-        threads.push_back(std::thread([&, thread_id] {
-            for (size_t i = thread_id; i < __ligand_mols.size();
-                 i += __num_threads) {
-                const auto& protein = __constant_receptor ? __receptor_mols[0]
-                                                          : __receptor_mols[i];
-                const auto& ligand = __ligand_mols[i];
+    if (__constant_receptor) {
+        const statchem::molib::Atom::Grid gridrec(
+            __receptor_mols[0].get_atoms());
 
-                const statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+        std::vector<const statchem::molib::Molecule*> ligands;
+        for (const auto& ligand : __ligand_mols) ligands.push_back(&ligand);
 
-                output[i].reserve(96);
+        multi_score.score_batch(gridrec, ligands, output, pool);
+    } else {
+        pool.parallel_for(0, __ligand_mols.size(), [&](size_t i) {
+            const auto& protein = __receptor_mols[i];
+            const auto& ligand = __ligand_mols[i];
 
-                for (const auto& score_name : scoring_names) {
-                    double new_score =
-                        scoring_map[score_name]->non_bonded_energy(gridrec,
-                                                                   ligand);
-                    output[i].push_back(new_score);
-                }
-            }
-        }));
-    }
+            const statchem::molib::Atom::Grid gridrec(protein.get_atoms());
 
-    for (auto&& thread : threads) {
-        thread.join();
+            output[i] = multi_score.non_bonded_energy(gridrec, ligand);
+        }, 1);
     }
 
+    pool.log_stats("all_score_pose");
+
     for (size_t i = 0; i < __ligand_mols.size(); ++i) {
         std::cout << __ligand_mols[i].name();
         for (auto score : output[i]) std::cout << ',' << score;
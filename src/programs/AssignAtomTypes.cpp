@@ -32,8 +32,9 @@ bool AssignAtomTypes::process_options(int argc, char* argv[]) {
     starting_inputs.add_options()("help,h", "Show this help menu.")(
         "ligand,l", po::value<std::string>()->default_value("ligand.mol2"),
         "Ligand filename. This can be in either PDB or MOL2 format.")(
-        "output,o", po::value<std::string>()->default_value("output.pdb"),
-        "Output filename. Must be in the PDB format due to custom types");
+        "output,o", po::value<std::string>()->default_value(""),
+        "Output filename, the standard output if not given. Must be in the "
+        "PDB format due to custom types, compressed if it ends in .xz");
 
     po::options_description cmdln_options;
     cmdln_options.add(starting_inputs);
@@ -72,7 +73,11 @@ int AssignAtomTypes::run() {
         .compute_gaff_type()
         .erase_temporary_hydrogen();
 
-    std::cout << __molecules;
+    if (__output.empty()) {
+        std::cout << __molecules;
+    } else {
+        statchem::fileio::output_file(__molecules, __output);
+    }
 
     return 0;
 }
@@ -1,14 +1,19 @@
 #include "KBDynamics.hpp"
 
+#include <fstream>
+#include <iterator>
+#include <sstream>
 #include <thread>
 #include "statchem/helper/logger.hpp"
 
+#include <boost/algorithm/string/predicate.hpp>
 #include <boost/program_options.hpp>
 namespace po = boost::program_options;
 
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 
+#include "statchem/fileio/dcdwriter.hpp"
 #include "statchem/fileio/fileout.hpp"
 #include "statchem/fileio/inout.hpp"
 #include "statchem/modeler/forcefield.hpp"
@@ -60,16 +65,29 @@ bool KBDynamics::process_options(int argc, char* argv[]) {
         po::value<int>(&__dynamics_steps)->default_value(1000))(
         "dynamic_step_size",
         po::value<double>(&__dynamics_step_size)->default_value(2.0, "2.0"),
-        "Step size (in fempto seconds)");
+        "Step size (in fempto seconds)")(
+        "trajectory", po::value<std::string>(&__trajectory)->default_value(""),
+        "Write the frames to this DCD trajectory and the complex only once, "
+        "as its topology. With several complexes their index is added to the "
+        "name")(
+        "report_interval",
+        po::value<int>(&__report_interval)->default_value(1),
+        "Write every this many runs of dynamic_steps");
 
     auto openmm = openmm_options();
 
+    auto checkpoint = checkpoint_options();
+
+    auto output = output_options(false);
+
     po::options_description cmdln_options;
     cmdln_options.add(starting_inputs);
     cmdln_options.add(score_options);
     cmdln_options.add(ff_min);
     cmdln_options.add(dynamics_options);
     cmdln_options.add(openmm);
+    cmdln_options.add(checkpoint);
+    cmdln_options.add(output);
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, cmdln_options), vm);
@@ -87,7 +105,8 @@ bool KBDynamics::process_options(int argc, char* argv[]) {
     __constant_receptor =
         process_starting_inputs(vm, __receptor_mols, __ligand_mols);
 
-    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist);
+    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist,
+                            __cache_dir);
 
     if (__dist_cut > __cutoff) {
         throw std::out_of_range(
@@ -96,6 +115,14 @@ bool KBDynamics::process_options(int argc, char* argv[]) {
 
     process_forcefield_options(vm, __ffield, __mini_tol, __iter_max);
     process_openmm_options(vm, __platform, __precision, __accelerators, __checkpoint);
+    process_checkpoint_options(vm, __checkpoint_steps, __checkpoint_seconds);
+    process_output_options(vm, __output, __xz_threads, __receptor_once);
+
+    if (__report_interval < 1) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "report_interval",
+                                   std::to_string(__report_interval));
+    }
 
     return true;
 }
@@ -131,36 +158,76 @@ int KBDynamics::run() {
     __score = std::unique_ptr<statchem::score::KBFF>(new statchem::score::KBFF(
         __ref, __comp, __func, __cutoff, __step_size));
 
-    __score
-        ->define_composition(__receptor_mols.get_idatm_types(),
-                             __ligand_mols.get_idatm_types())
-        .process_distributions(__dist)
-        .compile_scoring_function();
-    __score->compile_objective_function();
+    __score->define_composition(__receptor_mols.get_idatm_types(),
+                                __ligand_mols.get_idatm_types());
+    __score->compile_objective_function(__dist, __cache_dir);
 
     __ffield.add_kb_forcefield(*__score, __dist_cut);
 
     statchem::OMMIface::SystemTopology::loadPlugins();
 
-    /* 
-        Need to hold track of the i and j variables in the for loops below.
-        OpenMM state does not do that for us, so we use a separte file to store the contents.
-    */
-    int x, y;
-    if(__checkpoint != "") {
-        std::string candock_checkpoint = __checkpoint + "_candock";
-        std::ifstream file(candock_checkpoint, ios::in);
-        if(file.is_open()){
-            file >> x;
-            file >> y;
-            file.close();
+    // the checkpoint stores the next ligand and iteration to run, the
+    // number of frames already in that ligand's trajectory and the size of
+    // the output up to the last pose before the checkpoint
+    size_t x = 0, y = 0, frames = 0;
+    std::streamoff poses = 0;
+    bool legacy = false;
+    if (__checkpoint != "") {
+        std::string state, progress;
+        try {
+            legacy = statchem::OMMIface::is_legacy_checkpoint(__checkpoint);
+            if (legacy) {
+                // only the ligand and the iteration were kept, in a file of
+                // their own
+                std::ifstream file(__checkpoint + "_candock", ios::in);
+                progress.assign(std::istreambuf_iterator<char>(file),
+                                std::istreambuf_iterator<char>());
+            } else {
+                statchem::OMMIface::read_checkpoint(__checkpoint, state,
+                                                    progress);
+            }
+        } catch (const statchem::Error& e) {
+            cerr << e.what() << endl;
+            exit(1);
         }
-        else {
-            cerr << "Error could not open file: " << candock_checkpoint << endl;
+        std::istringstream is(progress);
+        if (!(is >> x >> y) || (!legacy && !(is >> frames >> poses))) {
+            cerr << "Error checkpoint has no progress: " << __checkpoint
+                 << endl;
             exit(1);
         }
+        if (legacy)
+            cerr << "Warning checkpoint of an earlier release, frames and "
+                    "poses written after it are not removed\n";
     }
-    
+
+    // poses written after the checkpoint are replayed, which a compressed
+    // output cannot be cut back for
+    if (__checkpoint != "" && !legacy && !__output.empty()) {
+        try {
+            if (boost::algorithm::ends_with(__output, ".xz"))
+                throw statchem::Error(
+                    "Error compressed output cannot be continued from a "
+                    "checkpoint: " + __output);
+            if (boost::filesystem::file_size(__output) <
+                static_cast<uintmax_t>(poses))
+                throw statchem::Error(
+                    "Error output is shorter than at the checkpoint: " +
+                    __output);
+            boost::filesystem::resize_file(__output, poses);
+        } catch (const std::exception& e) {
+            cerr << e.what() << endl;
+            exit(1);
+        }
+    }
+
+    // a continued simulation adds to the frames written before
+    auto output_file = open_output(
+        __output, __xz_threads,
+        __checkpoint != "" ? std::ios_base::app : std::ios_base::out);
+    statchem::fileio::PoseWriter writer(output_file ? *output_file : std::cout,
+                                        __receptor_once);
+
     for (size_t i = 0; i < __ligand_mols.size(); ++i) {
 
         if(__checkpoint != "")
@@ -181,6 +248,8 @@ int KBDynamics::run() {
             __dynamics_step_size, __temperature, __friction, __cutoff);
 
         modeler.set_num_steps_to_run(__dynamics_steps);
+        modeler.__system_topology.set_checkpoint_policy(
+            {__checkpoint_steps, __checkpoint_seconds});
 
         modeler.add_topology(protein.get_atoms());
         modeler.add_topology(ligand.get_atoms());
@@ -192,8 +261,12 @@ int KBDynamics::run() {
         modeler.add_crds(protein.get_atoms(), protein.get_crds());
         modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
 
-        modeler.unmask(ligand.get_atoms());
-        modeler.unmask(protein.get_atoms());
+        {
+            statchem::OMMIface::ScopedMaskBatch batch(
+                modeler.__system_topology);
+            modeler.unmask(ligand.get_atoms());
+            modeler.unmask(protein.get_atoms());
+        }
 
         modeler.init_openmm_positions();
 
@@ -204,6 +277,16 @@ int KBDynamics::run() {
 
 
         
+        // a continued simulation adds to the frames written before
+        std::unique_ptr<statchem::fileio::DcdWriter> trajectory;
+        if (!__trajectory.empty()) {
+            trajectory.reset(new statchem::fileio::DcdWriter(
+                trajectory_file(__trajectory, i, __ligand_mols.size()),
+                protein.get_atoms().size() + ligand.get_atoms().size(),
+                __dynamics_steps * __report_interval,
+                __dynamics_step_size / 1000.0, __checkpoint != ""));
+        }
+
         size_t j = 0;
         // Load checkpoint
         if(__checkpoint != "") {
@@ -211,6 +294,9 @@ int KBDynamics::run() {
             modeler.__system_topology.load_checkpoint(__checkpoint);
             __checkpoint = "";
 
+            // frames written after the checkpoint are replayed
+            if (trajectory && !legacy) trajectory->truncate(frames);
+
             j = y;
         }
         
@@ -218,23 +304,50 @@ int KBDynamics::run() {
             std::cerr << "\nligand_mols " << i << std::endl;
             std::cerr << "dynamics iteration " << j << std::endl;
             modeler.dynamics();
-            modeler.__system_topology.save_checkpoint_candock(i, j);
-
-            // init with minimized coordinates
-            statchem::molib::Molecule minimized_receptor(
-                protein, modeler.get_state(protein.get_atoms()));
-            statchem::molib::Molecule minimized_ligand(
-                ligand, modeler.get_state(ligand.get_atoms()));
-
-            minimized_receptor.undo_mm_specific();
 
-            statchem::fileio::print_complex_pdb_to_file(minimized_ligand,
-                                                minimized_receptor, 0.000);
-
-            minimized_receptor.prepare_for_mm(__ffield, gridrec);
+            if ((j + 1) % __report_interval == 0) {
+                auto receptor_crds = modeler.get_state(protein.get_atoms());
+                auto ligand_crds = modeler.get_state(ligand.get_atoms());
+
+                if (trajectory)
+                    trajectory->write_frame(receptor_crds, ligand_crds);
+
+                // with a trajectory the complex is only its topology
+                if (!trajectory || trajectory->num_frames() == 1) {
+                    // init with minimized coordinates
+                    statchem::molib::Molecule minimized_receptor(
+                        protein, receptor_crds);
+                    statchem::molib::Molecule minimized_ligand(ligand,
+                                                               ligand_crds);
+
+                    minimized_receptor.undo_mm_specific();
+
+                    writer.write_complex(minimized_ligand, minimized_receptor,
+                                         0.000);
+
+                    minimized_receptor.prepare_for_mm(__ffield, gridrec);
+                }
+            }
+
+            // only after the frame and the poses are written, so a
+            // checkpoint never runs ahead of the trajectory or the output
+            if (modeler.__system_topology.checkpoint_due()) {
+                writer.flush();
+                if (output_file) {
+                    output_file->flush();
+                    poses = output_file->tellp();
+                }
+                modeler.__system_topology.set_checkpoint_progress(
+                    std::to_string(i) + " " + std::to_string(j + 1) + " " +
+                    std::to_string(trajectory ? trajectory->num_frames() : 0) +
+                    " " + std::to_string(poses));
+                modeler.__system_topology.save_checkpoint();
+            }
         }
         __ffield.erase_topology(ligand);
     }
 
+    writer.flush();
+
     return 0;
 }
@@ -19,9 +19,13 @@ class KBDynamics : public Program {
     virtual int run() override;
    private:
     std::string __dist;
+    std::string __cache_dir;
     statchem::molib::Molecules __receptor_mols;
     statchem::molib::Molecules __ligand_mols;
     bool __constant_receptor;
+    std::string __output;
+    size_t __xz_threads;
+    bool __receptor_once;
     size_t __num_threads;
 
     std::string __ref;
@@ -41,7 +45,11 @@ class KBDynamics : public Program {
     double __friction;
     int __dynamics_steps;
     double __dynamics_step_size;
+    std::string __trajectory;
+    int __report_interval;
     std::string __platform, __precision, __accelerators, __checkpoint;
+    int __checkpoint_steps;
+    double __checkpoint_seconds;
 };
 
 
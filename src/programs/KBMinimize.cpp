@@ -13,6 +13,7 @@ namespace fs = boost::filesystem;
 #include "statchem/fileio/inout.hpp"
 #include "statchem/modeler/forcefield.hpp"
 #include "statchem/modeler/modeler.hpp"
+#include "statchem/modeler/receptorfield.hpp"
 #include "statchem/molib/molecules.hpp"
 #include "statchem/parser/fileparser.hpp"
 #include "statchem/score/kbff.hpp"
@@ -42,15 +43,33 @@ bool KBMinimize::process_options(int argc, char* argv[]) {
                          po::value<double>(&__dist_cut)->default_value(6.0),
                          "Distance cutoff for intermolecular forces.")(
                          "scale", po::value<double>(&__scale)->default_value(1.0),
-                         "Scale factor for the knowledge-based force.");
+                         "Scale factor for the knowledge-based force.")(
+                         "fix_receptor",
+                         po::bool_switch(&__fix_receptor)->default_value(false),
+                         "Keep the receptor rigid and read its interactions "
+                         "from precomputed grid maps. With a single receptor "
+                         "one grid covers all ligands.")(
+                         "field_spacing",
+                         po::value<double>(&__field_spacing)
+                             ->default_value(0.375),
+                         "Grid spacing in angstroms of the --fix_receptor "
+                         "maps.")(
+                         "batch_size",
+                         po::value<size_t>(&__batch_size)->default_value(1),
+                         "Number of ligands minimized together in one system "
+                         "with --fix_receptor and a single receptor "
+                         "(at most 32).");
 
     auto openmm = openmm_options();
 
+    auto output = output_options();
+
     po::options_description cmdln_options;
     cmdln_options.add(starting_inputs);
     cmdln_options.add(score_options);
     cmdln_options.add(ff_min);
     cmdln_options.add(openmm);
+    cmdln_options.add(output);
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, cmdln_options), vm);
@@ -68,7 +87,8 @@ bool KBMinimize::process_options(int argc, char* argv[]) {
     __constant_receptor =
         process_starting_inputs(vm, __receptor_mols, __ligand_mols);
 
-    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist);
+    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist,
+                            __cache_dir);
 
     if (__dist_cut > __cutoff) {
         throw std::out_of_range(
@@ -78,6 +98,22 @@ bool KBMinimize::process_options(int argc, char* argv[]) {
     process_forcefield_options(vm, __ffield, __mini_tol, __iter_max);
     process_openmm_options(vm, __platform, __precision, __accelerators, __checkpoint);
 
+    process_output_options(vm, __output, __xz_threads, __receptor_once);
+
+    // only a rigid receptor, the same for every ligand, can be written once
+    if (__receptor_once && !(__fix_receptor && __constant_receptor)) {
+        throw po::error(
+            "The --receptor_once option needs --fix_receptor and a single "
+            "receptor.");
+    }
+
+    const size_t max_batch_size =
+        statchem::OMMIface::SystemTopology::max_batch_size;
+    if (__batch_size < 1 || __batch_size > max_batch_size) {
+        throw std::out_of_range("The --batch_size must be between 1 and " +
+                                std::to_string(max_batch_size) + ".");
+    }
+
     return true;
 }
 
@@ -111,60 +147,159 @@ int KBMinimize::run() {
     __score = std::unique_ptr<statchem::score::KBFF>(new statchem::score::KBFF(
         __ref, __comp, __func, __cutoff, __step_size));
 
-    __score
-        ->define_composition(__receptor_mols.get_idatm_types(),
-                             __ligand_mols.get_idatm_types())
-        .process_distributions(__dist)
-        .compile_scoring_function();
-    __score->compile_objective_function();
+    __score->define_composition(__receptor_mols.get_idatm_types(),
+                                __ligand_mols.get_idatm_types());
+    __score->compile_objective_function(__dist, __cache_dir);
 
     __ffield.add_kb_forcefield(*__score, __dist_cut);
 
     statchem::OMMIface::SystemTopology::loadPlugins();
 
+    auto output_file = open_output(__output, __xz_threads);
+    statchem::fileio::PoseWriter writer(output_file ? *output_file : std::cout,
+                                        __receptor_once);
+
+    if (__fix_receptor) {
+        minimize_in_receptor_field(writer);
+        writer.flush();
+        return 0;
+    }
+
+    // With a single receptor its part of the system is built only once and
+    // each ligand is swapped into a slot sized for the largest of them
+    std::unique_ptr<statchem::OMMIface::Modeler> modeler;
+    if (__constant_receptor) {
+        statchem::molib::Molecule& protein = __receptor_mols[0];
+
+        statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+        protein.prepare_for_mm(__ffield, gridrec);
+
+        __ffield.insert_topology(protein);
+
+        modeler.reset(new statchem::OMMIface::Modeler(__ffield, "kb", __scale,
+                                                      __mini_tol, __iter_max));
+        modeler->add_topology(protein.get_atoms());
+
+        for (auto& ligand : __ligand_mols) {
+            __ffield.insert_topology(ligand);
+            modeler->reserve_ligand(ligand.get_atoms());
+            __ffield.erase_topology(ligand);
+        }
+
+        modeler->init_openmm(__platform, __precision, __accelerators);
+        modeler->add_crds(protein.get_atoms(), protein.get_crds());
+    }
+
     for (size_t i = 0; i < __ligand_mols.size(); ++i) {
         statchem::molib::Molecule& protein =
             __constant_receptor ? __receptor_mols[0] : __receptor_mols[i];
         statchem::molib::Molecule& ligand = __ligand_mols[i];
 
-        statchem::molib::Atom::Grid gridrec(protein.get_atoms());
-        protein.prepare_for_mm(__ffield, gridrec);
+        if (__constant_receptor) {
+            __ffield.insert_topology(ligand);
+            modeler->set_ligand(ligand.get_atoms());
+        } else {
+            statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+            protein.prepare_for_mm(__ffield, gridrec);
 
-        __ffield.insert_topology(protein);
-        __ffield.insert_topology(ligand);
+            __ffield.insert_topology(protein);
+            __ffield.insert_topology(ligand);
 
-        statchem::OMMIface::Modeler modeler(__ffield, "kb", __scale,
-                                            __mini_tol, __iter_max);
+            modeler.reset(new statchem::OMMIface::Modeler(
+                __ffield, "kb", __scale, __mini_tol, __iter_max));
 
-        modeler.add_topology(protein.get_atoms());
-        modeler.add_topology(ligand.get_atoms());
+            modeler->add_topology(protein.get_atoms());
+            modeler->add_topology(ligand.get_atoms());
 
-        modeler.init_openmm(__platform, __precision, __accelerators);
-        modeler.get_state(ligand.get_atoms());
+            modeler->init_openmm(__platform, __precision, __accelerators);
 
-        modeler.add_crds(protein.get_atoms(), protein.get_crds());
-        modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+            modeler->add_crds(protein.get_atoms(), protein.get_crds());
+        }
 
-        modeler.unmask(ligand.get_atoms());
-        modeler.unmask(protein.get_atoms());
+        modeler->add_crds(ligand.get_atoms(), ligand.get_crds());
 
-        modeler.init_openmm_positions();
+        {
+            statchem::OMMIface::ScopedMaskBatch batch(
+                modeler->__system_topology);
+            modeler->unmask(ligand.get_atoms());
+            modeler->unmask(protein.get_atoms());
+        }
 
-        modeler.minimize_state();
+        modeler->init_openmm_positions();
+
+        modeler->minimize_state();
 
         // init with minimized coordinates
         statchem::molib::Molecule minimized_receptor(
-            protein, modeler.get_state(protein.get_atoms()));
+            protein, modeler->get_state(protein.get_atoms()));
         statchem::molib::Molecule minimized_ligand(
-            ligand, modeler.get_state(ligand.get_atoms()));
+            ligand, modeler->get_state(ligand.get_atoms()));
 
         minimized_receptor.undo_mm_specific();
 
-        statchem::fileio::print_complex_pdb(std::cout, minimized_ligand,
-                                            minimized_receptor, 0.000);
+        writer.write_complex(minimized_ligand, minimized_receptor, 0.000);
 
         __ffield.erase_topology(ligand);
     }
 
+    writer.flush();
+
     return 0;
 }
+
+void KBMinimize::minimize_in_receptor_field(
+    statchem::fileio::PoseWriter& writer) {
+    // The receptor is not part of the systems, which only hold ligands
+    std::unique_ptr<statchem::OMMIface::ReceptorField> field;
+    if (__constant_receptor && __ligand_mols.size() > 0)
+        field.reset(new statchem::OMMIface::ReceptorField(
+            __ffield, __receptor_mols[0].get_atoms(), __ligand_mols.get_atoms(),
+            __field_spacing));
+
+    // Only ligands sharing a receptor (and its field) can share a system
+    const size_t batch_size = __constant_receptor ? __batch_size : 1;
+
+    for (size_t first = 0; first < __ligand_mols.size(); first += batch_size) {
+        const size_t last = std::min(first + batch_size, __ligand_mols.size());
+
+        statchem::molib::Molecule& protein =
+            __constant_receptor ? __receptor_mols[0] : __receptor_mols[first];
+
+        if (!__constant_receptor)
+            field.reset(new statchem::OMMIface::ReceptorField(
+                __ffield, protein.get_atoms(), __ligand_mols[first].get_atoms(),
+                __field_spacing));
+
+        statchem::OMMIface::Modeler modeler(__ffield, "kb", __scale,
+                                            __mini_tol, __iter_max);
+        modeler.set_receptor_field(*field);
+
+        // The topology of each ligand is read when it is added, so ligands
+        // sharing a residue name do not clash
+        for (size_t i = first; i < last; ++i) {
+            __ffield.insert_topology(__ligand_mols[i]);
+            modeler.add_batch_ligand(__ligand_mols[i].get_atoms());
+            __ffield.erase_topology(__ligand_mols[i]);
+        }
+
+        modeler.init_openmm(__platform, __precision, __accelerators);
+
+        for (size_t i = first; i < last; ++i)
+            modeler.add_crds(__ligand_mols[i].get_atoms(),
+                             __ligand_mols[i].get_crds());
+        modeler.init_openmm_positions();
+
+        modeler.minimize_state();
+
+        const auto energies = modeler.batch_energies();
+
+        for (size_t i = first; i < last; ++i) {
+            statchem::molib::Molecule& ligand = __ligand_mols[i];
+            statchem::molib::Molecule minimized_ligand(
+                ligand, modeler.get_state(ligand.get_atoms()));
+
+            writer.write_complex(minimized_ligand, protein,
+                                 energies[i - first]);
+        }
+    }
+}
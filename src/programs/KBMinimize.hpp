@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "statchem/molib/molecules.hpp"
+#include "statchem/fileio/fileout.hpp"
 #include "statchem/modeler/forcefield.hpp"
 #include "statchem/score/kbff.hpp"
 
@@ -18,10 +19,16 @@ class KBMinimize : public Program {
     virtual bool process_options(int argc, char* argv[]) override;
     virtual int run() override;
    private:
+    void minimize_in_receptor_field(statchem::fileio::PoseWriter& writer);
+
     std::string __dist;
+    std::string __cache_dir;
     statchem::molib::Molecules __receptor_mols;
     statchem::molib::Molecules __ligand_mols;
     bool __constant_receptor;
+    std::string __output;
+    size_t __xz_threads;
+    bool __receptor_once;
     size_t __num_threads;
 
     std::string __ref;
@@ -36,6 +43,9 @@ class KBMinimize : public Program {
     double __mini_tol;
     int __iter_max;
     double __dist_cut;
+    bool __fix_receptor;
+    double __field_spacing;
+    size_t __batch_size;
     std::string __platform, __precision, __accelerators, __checkpoint;
 };
 
@@ -29,6 +29,9 @@ MakeObjective::MakeObjective() {}
 
 bool MakeObjective::process_options(int argc, char* argv[]) {
     auto starting_inputs = common_starting_inputs();
+    starting_inputs.add_options()(
+        "ncpu,n", po::value<int>()->default_value(-1),
+        "Number of CPUs to use concurrently (use -1 to use all CPUs)");
 
     auto score_options = scoring_options();
     score_options.add_options()(
@@ -42,7 +45,10 @@ bool MakeObjective::process_options(int argc, char* argv[]) {
         po::value<std::vector<std::string>>(&atom_type_names)->multitoken(),
         "Which atom types to use for compiling the objective function.")(
         "obj_dir", po::value<std::string>(&__obj_dir)->default_value("obj"),
-        "Location to store output files");
+        "Location to store output files")(
+        "packed", po::bool_switch(&__packed)->default_value(false),
+        "Write the objective function as the single indexed file "
+        "<obj_dir>/<step>.bin instead of one text file per atom type pair");
 
     po::options_description cmdln_options;
     cmdln_options.add(starting_inputs);
@@ -60,7 +66,12 @@ bool MakeObjective::process_options(int argc, char* argv[]) {
         return false;
     }
 
-    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist);
+    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist,
+                            __cache_dir);
+
+    __num_threads = vm["ncpu"].as<int>() <= 0
+                        ? std::thread::hardware_concurrency()
+                        : static_cast<size_t>(vm["ncpu"].as<int>());
 
     if (!atom_type_names.empty()) {
         for (auto a : atom_type_names) {
@@ -87,12 +98,14 @@ int MakeObjective::run() {
     __score = std::unique_ptr<statchem::score::KBFF>(new statchem::score::KBFF(
         __ref, __comp, __func, __cutoff, __step_size));
 
-    __score->define_composition(__atom_types, __atom_types)
-        .process_distributions(__dist)
-        .compile_scoring_function();
-    __score->compile_objective_function();
+    __score->define_composition(__atom_types, __atom_types);
+    __score->compile_objective_function(__dist, __cache_dir, __num_threads);
 
-    __score->output_objective_function(__obj_dir);
+    if (__packed) {
+        __score->output_objective_archive(__obj_dir);
+    } else {
+        __score->output_objective_function(__obj_dir);
+    }
 
     return 0;
 }
@@ -19,15 +19,18 @@ class MakeObjective : public Program {
     virtual int run() override;
    private:
     std::string __dist;
+    std::string __cache_dir;
     std::string __ref;
     std::string __comp;
     std::string __func;
     double __cutoff;
     double __step_size;
+    size_t __num_threads;
     std::unique_ptr<statchem::score::KBFF> __score;
 
     std::set<int> __atom_types;
     std::string __obj_dir;
+    bool __packed;
 };
 
 
@@ -0,0 +1,117 @@
+#include "MakeStore.hpp"
+
+#include <boost/program_options.hpp>
+namespace po = boost::program_options;
+
+#include "statchem/fileio/inout.hpp"
+#include "statchem/fileio/moleculestore.hpp"
+#include "statchem/helper/logger.hpp"
+#include "statchem/molib/molecules.hpp"
+#include "statchem/parser/fileparser.hpp"
+
+#include "programs/common.hpp"
+
+using namespace statchem_prog;
+using statchem::Logger;
+using statchem::Severity;
+
+template <>
+ProgramInfo statchem_prog::program_information<MakeStore>() {
+    return ProgramInfo("make_store")
+        .description(
+            "Type the molecules of MOL2/PDB files and save them in a binary "
+            "store that the other programs read without typing.");
+}
+
+MakeStore::MakeStore() {}
+
+bool MakeStore::process_options(int argc, char* argv[]) {
+    po::options_description store_options("Store Options");
+    store_options.add_options()("help,h", "Show this help menu.")(
+        "input,i", po::value<std::vector<std::string>>(&__inputs)->multitoken(),
+        "MOL2 or PDB files (optionally compressed with xz) to add to the "
+        "store, in the order given")(
+        "output,o",
+        po::value<std::string>(&__output)->default_value("molecules.stch"),
+        "The store to write, compressed if its name ends in .stch.xz. Other "
+        "programs read it in place of MOL2/PDB files")(
+        "xz_threads", po::value<size_t>(&__xz_threads)->default_value(1),
+        "Number of threads compressing an .xz store");
+
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, store_options), vm);
+    po::notify(vm);
+
+    if (vm.count("help") || __inputs.empty()) {
+        __help_text << "This program computes the atom and bond types of "
+                       "molecules once, for all programs that read them.\n\n";
+        __help_text << store_options << std::endl;
+        return false;
+    }
+
+    if (__xz_threads == 0) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "xz_threads", std::to_string(__xz_threads));
+    }
+
+    return true;
+}
+
+int MakeStore::run() {
+    auto output = statchem::fileio::open_output_file(
+        __output, __xz_threads, std::ios_base::out | std::ios_base::binary);
+    statchem::fileio::write_molecule_store_header(*output);
+
+    // a few molecules at a time, so libraries of any size fit in memory
+    const size_t batch_size = 1024;
+    size_t num_molecules = 0;
+
+    for (const auto& input : __inputs) {
+        statchem::parser::FileParser parser(
+            input, statchem::parser::pdb_read_options::all_models |
+                       statchem::parser::pdb_read_options::hydrogens);
+
+        statchem::molib::Molecules mols;
+        while (true) {
+            mols.clear();
+            while (mols.size() < batch_size &&
+                   parser.parse_next_molecule(mols)) {
+            }
+
+            if (mols.size() == 0) {
+                break;
+            }
+
+            // as the minimization programs type their input
+            if (mols.get_idatm_types().size() == 1) {
+                mols.compute_idatm_type()
+                    .compute_hydrogen()
+                    .compute_bond_order()
+                    .compute_bond_gaff_type()
+                    .refine_idatm_type()
+                    .erase_hydrogen()
+                    .compute_hydrogen()
+                    .compute_ring_type()
+                    .compute_gaff_type()
+                    .erase_hydrogen()
+                    .compute_rotatable_bonds();
+            }
+
+            for (const auto& molecule : mols) {
+                statchem::fileio::write_molecule(*output, molecule);
+            }
+
+            num_molecules += mols.size();
+        }
+
+        log_step << "Stored " << num_molecules << " molecules after " << input
+                 << "\n";
+    }
+
+    output->flush();
+    if (!*output) {
+        throw statchem::Error("Cannot write " + __output);
+    }
+
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef _STCH_MAKE_STORE_HPP_
+#define _STCH_MAKE_STORE_HPP_
+
+#include "Program.hpp"
+
+#include <string>
+#include <vector>
+
+namespace statchem_prog {
+
+class MakeStore : public Program {
+   public:
+    MakeStore();
+
+    virtual bool process_options(int argc, char* argv[]) override;
+    virtual int run() override;
+   private:
+    std::vector<std::string> __inputs;
+    std::string __output;
+    size_t __xz_threads;
+};
+
+
+template<> ProgramInfo program_information<MakeStore>();
+
+}
+
+#endif
@@ -9,6 +9,7 @@ namespace po = boost::program_options;
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 
+#include "statchem/fileio/dcdwriter.hpp"
 #include "statchem/fileio/fileout.hpp"
 #include "statchem/fileio/inout.hpp"
 #include "statchem/modeler/forcefield.hpp"
@@ -52,15 +53,28 @@ bool PhysDynamics::process_options(int argc, char* argv[]) {
         po::value<int>(&__dynamics_steps)->default_value(1000))(
         "dynamic_step_size",
         po::value<double>(&__dynamics_step_size)->default_value(2.0, "2.0"),
-        "Step size (in fempto seconds)");
+        "Step size (in fempto seconds)")(
+        "trajectory", po::value<std::string>(&__trajectory)->default_value(""),
+        "Write the frames to this DCD trajectory and the complex only once, "
+        "as its topology. With several complexes their index is added to the "
+        "name")(
+        "report_interval",
+        po::value<int>(&__report_interval)->default_value(1),
+        "Write every this many runs of dynamic_steps");
 
     auto openmm = openmm_options();
 
+    auto checkpoint = checkpoint_options();
+
+    auto output = output_options(false);
+
     po::options_description cmdln_options;
     cmdln_options.add(starting_inputs);
     cmdln_options.add(ff_min);
     cmdln_options.add(dynamics_options);
     cmdln_options.add(openmm);
+    cmdln_options.add(checkpoint);
+    cmdln_options.add(output);
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, cmdln_options), vm);
@@ -80,6 +94,14 @@ bool PhysDynamics::process_options(int argc, char* argv[]) {
 
     process_forcefield_options(vm, __ffield, __mini_tol, __iter_max);
     process_openmm_options(vm, __platform, __precision, __accelerators, __checkpoint);
+    process_checkpoint_options(vm, __checkpoint_steps, __checkpoint_seconds);
+    process_output_options(vm, __output, __xz_threads, __receptor_once);
+
+    if (__report_interval < 1) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "report_interval",
+                                   std::to_string(__report_interval));
+    }
 
     return true;
 }
@@ -113,6 +135,10 @@ int PhysDynamics::run() {
 
     statchem::OMMIface::SystemTopology::loadPlugins();
 
+    auto output_file = open_output(__output, __xz_threads);
+    statchem::fileio::PoseWriter writer(output_file ? *output_file : std::cout,
+                                        __receptor_once);
+
     for (size_t i = 0; i < __ligand_mols.size(); ++i) {
         statchem::molib::Molecule& protein =
             __constant_receptor ? __receptor_mols[0] : __receptor_mols[i];
@@ -129,6 +155,8 @@ int PhysDynamics::run() {
             __dynamics_step_size, __temperature, __friction);
 
         modeler.set_num_steps_to_run(__dynamics_steps);
+        modeler.__system_topology.set_checkpoint_policy(
+            {__checkpoint_steps, __checkpoint_seconds});
 
         modeler.add_topology(protein.get_atoms());
         modeler.add_topology(ligand.get_atoms());
@@ -140,8 +168,12 @@ int PhysDynamics::run() {
         modeler.add_crds(protein.get_atoms(), protein.get_crds());
         modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
 
-        modeler.unmask(ligand.get_atoms());
-        modeler.unmask(protein.get_atoms());
+        {
+            statchem::OMMIface::ScopedMaskBatch batch(
+                modeler.__system_topology);
+            modeler.unmask(ligand.get_atoms());
+            modeler.unmask(protein.get_atoms());
+        }
 
         modeler.init_openmm_positions();
 
@@ -150,22 +182,48 @@ int PhysDynamics::run() {
         modeler.__system_topology.set_temperature();
         modeler.__system_topology.set_box_vector();
 
+        std::unique_ptr<statchem::fileio::DcdWriter> trajectory;
+        if (!__trajectory.empty()) {
+            trajectory.reset(new statchem::fileio::DcdWriter(
+                trajectory_file(__trajectory, i, __ligand_mols.size()),
+                protein.get_atoms().size() + ligand.get_atoms().size(),
+                __dynamics_steps * __report_interval,
+                __dynamics_step_size / 1000.0));
+        }
+
         for (int i = 0; i < 100; i++) {
             modeler.dynamics();
 
-            // init with minimized coordinates
-            statchem::molib::Molecule minimized_receptor(
-                protein, modeler.get_state(protein.get_atoms()));
-            statchem::molib::Molecule minimized_ligand(
-                ligand, modeler.get_state(ligand.get_atoms()));
-            minimized_receptor.undo_mm_specific();
-            statchem::fileio::print_complex_pdb(std::cout, minimized_ligand,
-                                                minimized_receptor, 0.000);
-            minimized_receptor.prepare_for_mm(__ffield, gridrec);
+            if ((i + 1) % __report_interval == 0) {
+                auto receptor_crds = modeler.get_state(protein.get_atoms());
+                auto ligand_crds = modeler.get_state(ligand.get_atoms());
+
+                if (trajectory)
+                    trajectory->write_frame(receptor_crds, ligand_crds);
+
+                // with a trajectory the complex is only its topology
+                if (!trajectory || trajectory->num_frames() == 1) {
+                    // init with minimized coordinates
+                    statchem::molib::Molecule minimized_receptor(
+                        protein, receptor_crds);
+                    statchem::molib::Molecule minimized_ligand(ligand,
+                                                               ligand_crds);
+                    minimized_receptor.undo_mm_specific();
+                    writer.write_complex(minimized_ligand, minimized_receptor,
+                                         0.000);
+                    minimized_receptor.prepare_for_mm(__ffield, gridrec);
+                }
+            }
+
+            // only after the frame, so a checkpoint never runs ahead of the
+            // trajectory
+            modeler.__system_topology.checkpoint_if_due();
         }
 
         __ffield.erase_topology(ligand);
     }
 
+    writer.flush();
+
     return 0;
 }
@@ -34,11 +34,13 @@ bool PhysMinimize::process_options(int argc, char* argv[]) {
 
     auto ff_min = forcefield_options();
     auto openmm = openmm_options();
+    auto output = output_options(false);
 
     po::options_description cmdln_options;
     cmdln_options.add(starting_inputs);
     cmdln_options.add(ff_min);
     cmdln_options.add(openmm);
+    cmdln_options.add(output);
 
     po::variables_map vm;
     po::store(po::parse_command_line(argc, argv, cmdln_options), vm);
@@ -58,6 +60,8 @@ bool PhysMinimize::process_options(int argc, char* argv[]) {
     process_forcefield_options(vm, __ffield, __mini_tol, __iter_max);
     process_openmm_options(vm, __platform, __precision, __accelerators, __checkpoint);
 
+    process_output_options(vm, __output, __xz_threads, __receptor_once);
+
     return true;
 }
 
@@ -90,48 +94,88 @@ int PhysMinimize::run() {
 
     statchem::OMMIface::SystemTopology::loadPlugins();
 
+    auto output_file = open_output(__output, __xz_threads);
+    statchem::fileio::PoseWriter writer(output_file ? *output_file : std::cout,
+                                        __receptor_once);
+
+    // With a single receptor its part of the system is built only once and
+    // each ligand is swapped into a slot sized for the largest of them
+    std::unique_ptr<statchem::OMMIface::Modeler> modeler;
+    if (__constant_receptor) {
+        statchem::molib::Molecule& protein = __receptor_mols[0];
+
+        statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+        protein.prepare_for_mm(__ffield, gridrec);
+
+        __ffield.insert_topology(protein);
+
+        modeler.reset(new statchem::OMMIface::Modeler(__ffield, "phy", 0.0,
+                                                      __mini_tol, __iter_max));
+        modeler->add_topology(protein.get_atoms());
+
+        for (auto& ligand : __ligand_mols) {
+            __ffield.insert_topology(ligand);
+            modeler->reserve_ligand(ligand.get_atoms());
+            __ffield.erase_topology(ligand);
+        }
+
+        modeler->init_openmm(__platform, __precision, __accelerators);
+        modeler->add_crds(protein.get_atoms(), protein.get_crds());
+    }
+
     for (size_t i = 0; i < __ligand_mols.size(); ++i) {
         statchem::molib::Molecule& protein =
             __constant_receptor ? __receptor_mols[0] : __receptor_mols[i];
         statchem::molib::Molecule& ligand = __ligand_mols[i];
 
-        statchem::molib::Atom::Grid gridrec(protein.get_atoms());
-        protein.prepare_for_mm(__ffield, gridrec);
+        if (__constant_receptor) {
+            __ffield.insert_topology(ligand);
+            modeler->set_ligand(ligand.get_atoms());
+        } else {
+            statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+            protein.prepare_for_mm(__ffield, gridrec);
 
-        __ffield.insert_topology(protein);
-        __ffield.insert_topology(ligand);
+            __ffield.insert_topology(protein);
+            __ffield.insert_topology(ligand);
 
-        statchem::OMMIface::Modeler modeler(__ffield, "phy", 0.0,
-                                            __mini_tol, __iter_max);
+            modeler.reset(new statchem::OMMIface::Modeler(
+                __ffield, "phy", 0.0, __mini_tol, __iter_max));
 
-        modeler.add_topology(protein.get_atoms());
-        modeler.add_topology(ligand.get_atoms());
+            modeler->add_topology(protein.get_atoms());
+            modeler->add_topology(ligand.get_atoms());
 
-        modeler.init_openmm(__platform, __precision, __accelerators);
+            modeler->init_openmm(__platform, __precision, __accelerators);
 
-        modeler.add_crds(protein.get_atoms(), protein.get_crds());
-        modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+            modeler->add_crds(protein.get_atoms(), protein.get_crds());
+        }
 
-        modeler.unmask(ligand.get_atoms());
-        modeler.unmask(protein.get_atoms());
+        modeler->add_crds(ligand.get_atoms(), ligand.get_crds());
 
-        modeler.init_openmm_positions();
+        {
+            statchem::OMMIface::ScopedMaskBatch batch(
+                modeler->__system_topology);
+            modeler->unmask(ligand.get_atoms());
+            modeler->unmask(protein.get_atoms());
+        }
 
-        modeler.minimize_state();
+        modeler->init_openmm_positions();
+
+        modeler->minimize_state();
 
         // init with minimized coordinates
         statchem::molib::Molecule minimized_receptor(
-            protein, modeler.get_state(protein.get_atoms()));
+            protein, modeler->get_state(protein.get_atoms()));
         statchem::molib::Molecule minimized_ligand(
-            ligand, modeler.get_state(ligand.get_atoms()));
+            ligand, modeler->get_state(ligand.get_atoms()));
 
         minimized_receptor.undo_mm_specific();
 
-        statchem::fileio::print_complex_pdb(std::cout, minimized_ligand,
-                                            minimized_receptor, 0.000);
+        writer.write_complex(minimized_ligand, minimized_receptor, 0.000);
 
         __ffield.erase_topology(ligand);
     }
 
+    writer.flush();
+
     return 0;
 }
@@ -18,6 +18,9 @@ class PhysMinimize : public Program {
     statchem::molib::Molecules __receptor_mols;
     statchem::molib::Molecules __ligand_mols;
     bool __constant_receptor;
+    std::string __output;
+    size_t __xz_threads;
+    bool __receptor_once;
 
     statchem::OMMIface::ForceField __ffield;
     double __mini_tol;
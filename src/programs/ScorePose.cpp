@@ -9,6 +9,7 @@ namespace po = boost::program_options;
 #include <boost/filesystem.hpp>
 namespace fs = boost::filesystem;
 
+#include "statchem/fileio/asyncwriter.hpp"
 #include "statchem/fileio/inout.hpp"
 #include "statchem/molib/molecules.hpp"
 #include "statchem/parser/fileparser.hpp"
@@ -52,36 +53,41 @@ bool ScorePose::process_options(int argc, char* argv[]) {
         return false;
     }
 
-    __constant_receptor =
-        process_starting_inputs(vm, __receptor_mols, __ligand_mols);
-
     __num_threads = vm["ncpu"].as<int>() <= 0
                         ? std::thread::hardware_concurrency()
                         : static_cast<size_t>(vm["ncpu"].as<int>());
 
-    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist);
+    process_scoring_options(vm, __ref, __comp, __func, __cutoff, __dist,
+                            __cache_dir);
+
+    // The 'reduced' reference state depends on the atom types of all
+    // ligands, so only the 'complete' one allows scoring while reading
+    if (__comp == "complete") {
+        __constant_receptor = __stream_ligands = process_starting_inputs(
+            vm, __receptor_mols, __ligand_mols, __ligand_parser, __num_threads);
+    } else {
+        __stream_ligands = false;
+        __constant_receptor = process_starting_inputs(
+            vm, __receptor_mols, __ligand_mols, __num_threads);
+    }
 
     return true;
 }
 
-int ScorePose::run() {
-    if (__receptor_mols.get_idatm_types().size() == 1) {
-        __receptor_mols.compute_idatm_type()
+static void compute_atom_types(statchem::molib::Molecules& mols) {
+    if (mols.get_idatm_types().size() == 1) {
+        mols.compute_idatm_type()
             .compute_hydrogen()
             .compute_bond_order()
             .compute_bond_gaff_type()
             .refine_idatm_type()
             .erase_hydrogen();
     }
+}
 
-    if (__ligand_mols.get_idatm_types().size() == 1) {
-        __ligand_mols.compute_idatm_type()
-            .compute_hydrogen()
-            .compute_bond_order()
-            .compute_bond_gaff_type()
-            .refine_idatm_type()
-            .erase_hydrogen();
-    }
+int ScorePose::run() {
+    compute_atom_types(__receptor_mols);
+    compute_atom_types(__ligand_mols);
 
     __score = std::unique_ptr<statchem::score::Score>(
         new statchem::score::Score(__ref, __comp, __func, __cutoff));
@@ -89,31 +95,72 @@ int ScorePose::run() {
     __score
         ->define_composition(__receptor_mols.get_idatm_types(),
                              __ligand_mols.get_idatm_types())
-        .process_distributions(__dist)
-        .compile_scoring_function();
+        .compile_scoring_function(__dist, __cache_dir);
 
     std::vector<double> output(__ligand_mols.size());
+    statchem::parallel::ThreadPool pool(__num_threads);
+
+    if (__stream_ligands) {
+        const statchem::molib::Atom::Grid gridrec(
+            __receptor_mols[0].get_atoms());
 
-    std::vector<std::thread> threads;
-    for (size_t thread_id = 0; thread_id < __num_threads; ++thread_id) {
-        threads.push_back(std::thread([&, thread_id] {
-            for (size_t i = thread_id; i < __ligand_mols.size();
-                 i += __num_threads) {
-                const auto& protein = __constant_receptor ? __receptor_mols[0]
-                                                          : __receptor_mols[i];
-                const auto& ligand = __ligand_mols[i];
+        // enough ligands per batch to keep every thread busy
+        const size_t batch_size = 16 * pool.size();
+        statchem::fileio::AsyncWriter writer(std::cout);
+        std::vector<const statchem::molib::Molecule*> ligands;
 
-                statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+        while (true) {
+            __ligand_mols.clear();
+            while (__ligand_mols.size() < batch_size &&
+                   __ligand_parser.parse_next_molecule(__ligand_mols)) {
+            }
 
-                output[i] = __score->non_bonded_energy(gridrec, ligand);
+            if (__ligand_mols.size() == 0) {
+                break;
             }
-        }));
+
+            compute_atom_types(__ligand_mols);
+
+            ligands.clear();
+            for (const auto& ligand : __ligand_mols) ligands.push_back(&ligand);
+
+            __score->score_batch(gridrec, ligands, output, pool);
+
+            // scoring of the next batch goes on while this one is written
+            std::stringstream ss;
+            for (size_t i = 0; i < output.size(); ++i) {
+                ss << output[i] << '\n';
+            }
+            writer.write(ss.str());
+        }
+
+        writer.flush();
+        pool.log_stats("score_pose");
+
+        return 0;
     }
 
-    for (auto&& thread : threads) {
-        thread.join();
+    if (__constant_receptor) {
+        const statchem::molib::Atom::Grid gridrec(
+            __receptor_mols[0].get_atoms());
+
+        std::vector<const statchem::molib::Molecule*> ligands;
+        for (const auto& ligand : __ligand_mols) ligands.push_back(&ligand);
+
+        __score->score_batch(gridrec, ligands, output, pool);
+    } else {
+        pool.parallel_for(0, __ligand_mols.size(), [&](size_t i) {
+            const auto& protein = __receptor_mols[i];
+            const auto& ligand = __ligand_mols[i];
+
+            statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+
+            output[i] = __score->non_bonded_energy(gridrec, ligand);
+        }, 1);
     }
 
+    pool.log_stats("score_pose");
+
     for (size_t i = 0; i < output.size(); ++i) {
         std::cout << output[i] << '\n';
     }
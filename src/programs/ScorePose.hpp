@@ -6,6 +6,7 @@
 #include <memory>
 
 #include "statchem/molib/molecules.hpp"
+#include "statchem/parser/fileparser.hpp"
 #include "statchem/score/score.hpp"
 
 namespace statchem_prog {
@@ -18,9 +19,12 @@ class ScorePose : public Program {
     virtual int run() override;
    private:
     std::string __dist;
+    std::string __cache_dir;
     statchem::molib::Molecules __receptor_mols;
     statchem::molib::Molecules __ligand_mols;
     bool __constant_receptor;
+    bool __stream_ligands;
+    statchem::parser::FileParser __ligand_parser;
     size_t __num_threads;
 
     std::string __ref;
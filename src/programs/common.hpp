@@ -43,9 +43,12 @@ inline std::string starting_inputs_help() {
            "small-molecules\n";
 }
 
+// With num_threads > 1 the molecules of a mol2 ligand file are parsed
+// concurrently
 inline bool process_starting_inputs(po::variables_map& vm,
                                     statchem::molib::Molecules& rec_mols,
-                                    statchem::molib::Molecules& lig_mols) {
+                                    statchem::molib::Molecules& lig_mols,
+                                    const size_t num_threads = 1) {
     if (vm.count("complex")) {
         auto complex = vm["complex"].as<std::string>();
 
@@ -72,7 +75,12 @@ inline bool process_starting_inputs(po::variables_map& vm,
         statchem::parser::FileParser lpdb(
             ligand, statchem::parser::pdb_read_options::all_models |
                         statchem::parser::pdb_read_options::hydrogens);
-        lpdb.parse_molecule(lig_mols);
+        if (num_threads > 1) {
+            statchem::parallel::ThreadPool pool(num_threads);
+            lpdb.parse_molecule(lig_mols, pool);
+        } else {
+            lpdb.parse_molecule(lig_mols);
+        }
 
         if (rec_mols.size() == 1) {
             return true;
@@ -84,6 +92,50 @@ inline bool process_starting_inputs(po::variables_map& vm,
     return false;
 }
 
+// Same inputs as above, but a ligand file scored against a single receptor
+// is not read here: lig_parser is prepared to yield its molecules one at a
+// time instead and true is returned. Otherwise behaves as above.
+inline bool process_starting_inputs(po::variables_map& vm,
+                                    statchem::molib::Molecules& rec_mols,
+                                    statchem::molib::Molecules& lig_mols,
+                                    statchem::parser::FileParser& lig_parser,
+                                    const size_t num_threads = 1) {
+    if (vm.count("complex")) {
+        return process_starting_inputs(vm, rec_mols, lig_mols, num_threads);
+    }
+
+    auto receptor = vm["receptor"].as<std::string>();
+    statchem::parser::FileParser rpdb(
+        receptor, statchem::parser::pdb_read_options::all_models |
+                      statchem::parser::pdb_read_options::hydrogens);
+    rpdb.parse_molecule(rec_mols);
+
+    auto ligand = vm["ligand"].as<std::string>();
+
+    if (rec_mols.size() == 1) {
+        lig_parser.prepare_parser(
+            ligand, statchem::parser::pdb_read_options::all_models |
+                        statchem::parser::pdb_read_options::hydrogens);
+        return true;
+    }
+
+    statchem::parser::FileParser lpdb(
+        ligand, statchem::parser::pdb_read_options::all_models |
+                    statchem::parser::pdb_read_options::hydrogens);
+    if (num_threads > 1) {
+        statchem::parallel::ThreadPool pool(num_threads);
+        lpdb.parse_molecule(lig_mols, pool);
+    } else {
+        lpdb.parse_molecule(lig_mols);
+    }
+
+    if (lig_mols.size() != rec_mols.size()) {
+        throw std::length_error("Differing number of complexes!");
+    }
+
+    return false;
+}
+
 inline po::options_description forcefield_options() {
     po::options_description ff_min("Forcefield and Minimization Options");
     ff_min.add_options()(
@@ -149,6 +201,99 @@ inline void process_openmm_options(po::variables_map& vm, std::string& platform,
     checkpoint = vm["checkpoint"].as<std::string>();
 }
 
+inline po::options_description checkpoint_options() {
+    po::options_description checkpoint("Checkpoint options");
+    checkpoint.add_options()(
+        "checkpoint_steps", po::value<int>()->default_value(1),
+        "Save a checkpoint after at least this many dynamics steps, 0 turns "
+        "step based checkpoints off")(
+        "checkpoint_seconds", po::value<double>()->default_value(0.0, "0"),
+        "Save a checkpoint after at least this many seconds of wall-clock "
+        "time, 0 turns time based checkpoints off");
+
+    return checkpoint;
+}
+
+inline void process_checkpoint_options(po::variables_map& vm, int& steps,
+                                       double& seconds) {
+    steps = vm["checkpoint_steps"].as<int>();
+    if (steps < 0) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "checkpoint_steps", std::to_string(steps));
+    }
+
+    seconds = vm["checkpoint_seconds"].as<double>();
+    if (seconds < 0.0) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "checkpoint_seconds",
+                                   std::to_string(seconds));
+    }
+}
+
+// Programs in which the receptor moves leave out --receptor_once, as every
+// model would show the first receptor
+inline po::options_description output_options(
+    const bool with_receptor_once = true) {
+    po::options_description output_options("Output Options");
+    output_options.add_options()(
+        "output,o", po::value<std::string>()->default_value(""),
+        "File to write the complexes to instead of the standard output. It "
+        "is compressed if its name ends in .xz")(
+        "xz_threads", po::value<size_t>()->default_value(1),
+        "Number of threads compressing an .xz output file");
+
+    if (with_receptor_once) {
+        output_options.add_options()(
+            "receptor_once",
+            "Write the receptor a single time ahead of the first model, so "
+            "that each model only holds the ligand");
+    }
+
+    return output_options;
+}
+
+inline void process_output_options(po::variables_map& vm, std::string& output,
+                                   size_t& xz_threads, bool& receptor_once) {
+    output = vm["output"].as<std::string>();
+
+    xz_threads = vm["xz_threads"].as<size_t>();
+    if (xz_threads == 0) {
+        throw po::validation_error(po::validation_error::invalid_option_value,
+                                   "xz_threads", std::to_string(xz_threads));
+    }
+
+    receptor_once = vm.count("receptor_once") != 0;
+}
+
+// Opens the --output file, returns nullptr when writing to the standard
+// output
+inline std::unique_ptr<std::ostream> open_output(
+    const std::string& output, const size_t xz_threads,
+    std::ios_base::openmode mode = std::ios_base::out) {
+    if (output.empty()) {
+        return nullptr;
+    }
+    return statchem::fileio::open_output_file(output, xz_threads, mode);
+}
+
+// Adds the index of the complex to a trajectory name when there are several,
+// so that traj.dcd becomes traj_0.dcd, traj_1.dcd, ...
+inline std::string trajectory_file(const std::string& trajectory,
+                                   const size_t i, const size_t count) {
+    if (count == 1) {
+        return trajectory;
+    }
+
+    const size_t slash = trajectory.find_last_of("/\\");
+    size_t dot = trajectory.rfind('.');
+    if (dot == std::string::npos ||
+        (slash != std::string::npos && dot < slash)) {
+        dot = trajectory.size();
+    }
+    return trajectory.substr(0, dot) + "_" + std::to_string(i) +
+           trajectory.substr(dot);
+}
+
 inline po::options_description scoring_options() {
     po::options_description scoring_options("Scoring Function Arguments");
     scoring_options.add_options()(
@@ -170,14 +315,19 @@ inline po::options_description scoring_options() {
         "func", po::value<std::string>()->default_value("radial"),
         "Function for calculating scores 'radial' or "
         "'normalized_frequency'")("cutoff", po::value<int>()->default_value(6),
-                                  "Cutoff length [4-15].");
+                                  "Cutoff length [4-15].")(
+        "cache_dir", po::value<std::string>()->default_value(""),
+        "Directory in which compiled scoring functions are kept, so that "
+        "later runs with the same settings skip compiling them (empty to "
+        "disable)");
 
     return scoring_options;
 }
 
 inline void process_scoring_options(po::variables_map& vm, std::string& ref,
                                     std::string& comp, std::string& func,
-                                    double& cutoff, std::string& dist) {
+                                    double& cutoff, std::string& dist,
+                                    std::string& cache_dir) {
     ref = vm["ref"].as<std::string>();
     comp = vm["comp"].as<std::string>();
     func = vm["func"].as<std::string>();
@@ -210,6 +360,8 @@ inline void process_scoring_options(po::variables_map& vm, std::string& ref,
         throw std::runtime_error(std::string("File: '") + dist +
                                  std::string("' is invalid"));
     }
+
+    cache_dir = vm["cache_dir"].as<std::string>();
 }
 
 }  // namespace statchem_prog
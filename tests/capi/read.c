@@ -55,5 +55,9 @@ int main(int argc, char** argv) {
     free(lelem);
     free(ltype);
 
+    if (set_scoring_cache(NULL)) {
+        return 6;
+    }
+
     return 0;
 }
@@ -0,0 +1,130 @@
+#include "statchem/helper/error.hpp"
+#include "statchem/modeler/checkpointwriter.hpp"
+
+#include <boost/filesystem.hpp>
+#include <fstream>
+
+namespace fs = boost::filesystem;
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+using statchem::OMMIface::CheckpointPolicy;
+using statchem::OMMIface::CheckpointWriter;
+using statchem::OMMIface::is_legacy_checkpoint;
+using statchem::OMMIface::read_checkpoint;
+
+TEST_CASE("Decide when a checkpoint is due") {
+    SECTION("by steps") {
+        const CheckpointPolicy policy{100, 0};
+        CHECK_FALSE(policy.is_due(99, 1e6));
+        CHECK(policy.is_due(100, 0));
+        CHECK(policy.is_due(150, 0));
+    }
+    SECTION("by time") {
+        const CheckpointPolicy policy{0, 60.0};
+        CHECK_FALSE(policy.is_due(1000000, 59.9));
+        CHECK(policy.is_due(0, 60.0));
+    }
+    SECTION("whichever comes first") {
+        const CheckpointPolicy policy{100, 60.0};
+        CHECK_FALSE(policy.is_due(99, 59.9));
+        CHECK(policy.is_due(100, 0));
+        CHECK(policy.is_due(0, 60.0));
+    }
+    SECTION("never") {
+        const CheckpointPolicy policy{0, 0};
+        CHECK_FALSE(policy.is_due(1000000, 1e6));
+    }
+}
+
+TEST_CASE("Write a checkpoint and read it back") {
+    const auto dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directory(dir);
+    const std::string filename = (dir / "state.chk").string();
+
+    // binary, with zeros and newlines, as written by OpenMM
+    std::string state("STATE\0\n\r\xff", 9);
+    for (int i = 0; i < 100000; ++i) state += static_cast<char>(i % 256);
+
+    SECTION("single snapshot") {
+        CheckpointWriter writer;
+        writer.write(filename, state, "3 42 7");
+        writer.flush();
+        CHECK(writer.num_written() == 1);
+        CHECK(writer.num_skipped() == 0);
+
+        std::string read_state, read_progress;
+        read_checkpoint(filename, read_state, read_progress);
+        CHECK(read_state == state);
+        CHECK(read_progress == "3 42 7");
+    }
+
+    SECTION("a newer snapshot replaces the pending one") {
+        const size_t submitted = 50;
+        CheckpointWriter writer;
+        for (size_t i = 0; i < submitted; ++i) {
+            writer.write(filename, state + std::to_string(i),
+                         std::to_string(i));
+        }
+        writer.flush();
+        CHECK(writer.num_written() + writer.num_skipped() == submitted);
+
+        std::string read_state, read_progress;
+        read_checkpoint(filename, read_state, read_progress);
+        CHECK(read_state == state + std::to_string(submitted - 1));
+        CHECK(read_progress == std::to_string(submitted - 1));
+    }
+
+    // only the checkpoint itself, no temporary file is left behind
+    size_t num_files = 0;
+    for (fs::directory_iterator it(dir); it != fs::directory_iterator(); ++it) {
+        CHECK(it->path().filename() == "state.chk");
+        ++num_files;
+    }
+    CHECK(num_files == 1);
+    fs::remove_all(dir);
+}
+
+TEST_CASE("Reject a damaged checkpoint") {
+    const auto path = fs::temp_directory_path() / fs::unique_path("%%%%.chk");
+    {
+        CheckpointWriter writer;
+        writer.write(path.string(), "state", "0 1 0");
+    }  // the destructor writes what is still pending
+
+    std::string state, progress;
+    read_checkpoint(path.string(), state, progress);
+    CHECK(state == "state");
+
+    // a checkpoint cut short
+    fs::resize_file(path, fs::file_size(path) - 1);
+    CHECK_THROWS_AS(read_checkpoint(path.string(), state, progress),
+                    const statchem::Error&);
+
+    // not a checkpoint at all
+    std::ofstream(path.string()) << "0 1";
+    CHECK_THROWS_AS(read_checkpoint(path.string(), state, progress),
+                    const statchem::Error&);
+    fs::remove(path);
+
+    CHECK_THROWS_AS(read_checkpoint(path.string(), state, progress),
+                    const statchem::Error&);
+}
+
+TEST_CASE("Recognize a checkpoint of an earlier release") {
+    const auto path = fs::temp_directory_path() / fs::unique_path("%%%%.chk");
+    {
+        CheckpointWriter writer;
+        writer.write(path.string(), "state", "0 1 0 0");
+    }
+    CHECK(!is_legacy_checkpoint(path.string()));
+
+    // the bare state of the context
+    std::ofstream(path.string()) << "state";
+    CHECK(is_legacy_checkpoint(path.string()));
+    fs::remove(path);
+
+    CHECK_THROWS_AS(is_legacy_checkpoint(path.string()),
+                    const statchem::Error&);
+}
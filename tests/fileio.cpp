@@ -0,0 +1,150 @@
+#include "statchem/fileio/dcdwriter.hpp"
+#include "statchem/fileio/inout.hpp"
+#include "statchem/fileio/xzfile.hpp"
+#include "statchem/helper/error.hpp"
+
+#include <boost/filesystem.hpp>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+namespace fs = boost::filesystem;
+
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+
+TEST_CASE("Write an xz file and read it back") {
+    // large enough for the multi-threaded encoder to split it into blocks
+    std::string text;
+    for (int i = 0; i < 200000; ++i) {
+        text += "ATOM  " + std::to_string(i) + " C   LIG A   1\n";
+    }
+
+    size_t threads = 1;
+    SECTION("single-threaded encoder") { threads = 1; }
+    SECTION("multi-threaded encoder") { threads = 4; }
+
+    auto path = fs::temp_directory_path() / fs::unique_path("%%%%.xz");
+    {
+        auto out = statchem::fileio::open_output_file(path.string(), threads);
+        *out << text;
+        REQUIRE(*out);
+    }
+    {
+        // appending starts a second .xz stream
+        auto out = statchem::fileio::open_output_file(
+            path.string(), threads, std::ios_base::app);
+        *out << "END\n";
+        REQUIRE(*out);
+    }
+
+    CHECK(statchem::fileio::read_xzfile(path.string()) == text + "END\n");
+
+    auto in = statchem::fileio::open_input_file(path.string());
+    std::stringstream read_back;
+    read_back << in->rdbuf();
+    fs::remove(path);
+
+    CHECK(read_back.str() == text + "END\n");
+}
+
+TEST_CASE("Append frames to a DCD trajectory") {
+    const size_t num_atoms = 3;
+    auto frame = [](const int n) {
+        statchem::geometry::Point::Vec crds;
+        for (int i = 0; i < 3; ++i) {
+            crds.push_back(statchem::geometry::Point(n, i, -0.5 * n));
+        }
+        return crds;
+    };
+
+    auto path = fs::temp_directory_path() / fs::unique_path("%%%%.dcd");
+    {
+        statchem::fileio::DcdWriter dcd(path.string(), num_atoms, 10, 0.002);
+        for (int n = 0; n < 3; ++n) dcd.write_frame(frame(n));
+    }
+    {
+        statchem::fileio::DcdWriter dcd(path.string(), num_atoms, 10, 0.002,
+                                        true);
+        CHECK(dcd.num_frames() == 3);
+        for (int n = 3; n < 5; ++n) dcd.write_frame(frame(n));
+        CHECK(dcd.num_frames() == 5);
+    }
+
+    std::ifstream in(path.string(), std::ios::binary);
+    std::string data((std::istreambuf_iterator<char>(in)),
+                     std::istreambuf_iterator<char>());
+    in.close();
+    fs::remove(path);
+
+    auto get = [&data](const size_t pos) {
+        int32_t value;
+        std::memcpy(&value, data.data() + pos, sizeof(value));
+        return value;
+    };
+
+    // control, title and number of atoms records
+    REQUIRE(data.size() == 92 + 92 + 12 + 5 * 3 * (4 + 4 * num_atoms + 4));
+    CHECK(get(0) == 84);
+    CHECK(data.substr(4, 4) == "CORD");
+    CHECK(get(8) == 5);             // number of frames
+    CHECK(get(12) == 10);           // first step
+    CHECK(get(20) == 10 + 4 * 10);  // last step
+    CHECK(get(88) == 84);
+    CHECK(get(184) == 4);
+    CHECK(get(188) == static_cast<int32_t>(num_atoms));
+    CHECK(get(192) == 4);
+
+    size_t pos = 196;
+    for (int n = 0; n < 5; ++n) {
+        const auto crds = frame(n);
+        for (int component = 0; component < 3; ++component) {
+            CHECK(get(pos) == static_cast<int32_t>(4 * num_atoms));
+            for (size_t i = 0; i < num_atoms; ++i) {
+                float value;
+                std::memcpy(&value, data.data() + pos + 4 + 4 * i, 4);
+                const double expected = component == 0   ? crds[i].x()
+                                        : component == 1 ? crds[i].y()
+                                                         : crds[i].z();
+                CHECK(value == Approx(expected));
+            }
+            pos += 4 + 4 * num_atoms;
+            CHECK(get(pos) == static_cast<int32_t>(4 * num_atoms));
+            pos += 4;
+        }
+    }
+}
+
+TEST_CASE("Truncate a DCD trajectory to the frames of a checkpoint") {
+    const size_t num_atoms = 2;
+    statchem::geometry::Point::Vec crds(num_atoms,
+                                        statchem::geometry::Point(1, 2, 3));
+
+    auto path = fs::temp_directory_path() / fs::unique_path("%%%%.dcd");
+    {
+        statchem::fileio::DcdWriter dcd(path.string(), num_atoms, 10, 0.002);
+        for (int n = 0; n < 5; ++n) dcd.write_frame(crds);
+    }
+    {
+        // frames 3 and 4 were written after the checkpoint
+        statchem::fileio::DcdWriter dcd(path.string(), num_atoms, 10, 0.002,
+                                        true);
+        CHECK_THROWS_AS(dcd.truncate(6), const statchem::Error&);
+        dcd.truncate(3);
+        CHECK(dcd.num_frames() == 3);
+        dcd.write_frame(crds);
+        CHECK(dcd.num_frames() == 4);
+    }
+
+    const size_t frame_size = 3 * (4 + 4 * num_atoms + 4);
+    CHECK(fs::file_size(path) == 92 + 92 + 12 + 4 * frame_size);
+
+    std::ifstream in(path.string(), std::ios::binary);
+    int32_t header[6];
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    in.close();
+    fs::remove(path);
+
+    CHECK(header[2] == 4);            // number of frames
+    CHECK(header[5] == 10 + 3 * 10);  // last step
+}
@@ -1,5 +1,6 @@
 #include "statchem/modeler/forcefield.hpp"
 #include "statchem/modeler/modeler.hpp"
+#include "statchem/modeler/receptorfield.hpp"
 #include "statchem/molib/molecules.hpp"
 #include "statchem/parser/fileparser.hpp"
 #include "statchem/score/kbff.hpp"
@@ -86,6 +87,15 @@ TEST_CASE("Knowledge-based energy minization") {
 
     modeler.init_openmm_positions();
     double potential = modeler.potential_energy();
+
+    // Masking and unmasking the ligand in one batch leaves the energy alone
+    {
+        statchem::OMMIface::ScopedMaskBatch batch(modeler.__system_topology);
+        modeler.mask(ligand.get_atoms());
+        modeler.unmask(ligand.get_atoms());
+    }
+    CHECK(modeler.potential_energy() == Approx(potential));
+
     modeler.minimize_state();
 
     // init with minimized coordinates
@@ -180,3 +190,403 @@ TEST_CASE("Physics-based energy minization") {
 
     CHECK(min_potential < potential);
 }
+
+TEST_CASE("Knowledge-based energy minization with a ligand slot") {
+    statchem::parser::FileParser lpdb("files/6drw_lig.pdb");
+    statchem::parser::FileParser rpdb("files/6drw.pdb");
+
+    statchem::molib::Molecules lmol;
+    statchem::molib::Molecules rmol;
+    lpdb.parse_molecule(lmol);
+    rpdb.parse_molecule(rmol);
+
+    lmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    rmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    statchem::score::AtomicDistributions distributions(
+        "../data/csd_complete_distance_distributions.txt.xz");
+
+    statchem::score::KBFF objective_func("mean", "complete", "radial", 15,
+                                         0.01);
+    objective_func
+        .define_composition(rmol.get_idatm_types(), lmol.get_idatm_types())
+        .process_distributions(distributions)
+        .compile_scoring_function();
+    objective_func.compile_objective_function();
+
+    statchem::OMMIface::ForceField ffield;
+
+    ffield.parse_gaff_dat_file("../data/gaff.dat")
+        .add_kb_forcefield(objective_func, 6.0)
+        .parse_forcefield_file("../data/amber10.xml")
+        .parse_forcefield_file("../data/tip3p.xml");
+
+    statchem::molib::Molecule& protein = rmol[0];
+    statchem::molib::Molecule& ligand = lmol[0];
+
+    statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+    protein.prepare_for_mm(ffield, gridrec);
+
+    ffield.insert_topology(protein);
+    ffield.insert_topology(ligand);
+
+    statchem::OMMIface::Modeler modeler(ffield, "kb", 1.0, 0.00001, 100);
+
+    modeler.add_topology(protein.get_atoms());
+    modeler.add_topology(ligand.get_atoms());
+    modeler.init_openmm("Reference");
+    modeler.add_crds(protein.get_atoms(), protein.get_crds());
+    modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+    modeler.init_openmm_positions();
+    double potential = modeler.potential_energy();
+
+    statchem::OMMIface::Modeler slot_modeler(ffield, "kb", 1.0, 0.00001, 100);
+
+    slot_modeler.add_topology(protein.get_atoms());
+    slot_modeler.reserve_ligand(ligand.get_atoms());
+    slot_modeler.init_openmm("Reference");
+    slot_modeler.add_crds(protein.get_atoms(), protein.get_crds());
+
+    // Swapping the same ligand in twice must not change anything
+    for (int i = 0; i < 2; ++i) {
+        slot_modeler.set_ligand(ligand.get_atoms());
+        slot_modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+        slot_modeler.init_openmm_positions();
+        double slot_potential = slot_modeler.potential_energy();
+
+        CHECK(std::fabs(slot_potential - potential) <
+              1e-6 * std::fabs(potential));
+    }
+
+    slot_modeler.minimize_state();
+    CHECK(slot_modeler.potential_energy() < potential);
+}
+
+TEST_CASE("Physics-based energy minization with a ligand slot") {
+    statchem::parser::FileParser lpdb("files/6drw_lig.pdb");
+    statchem::parser::FileParser rpdb("files/6drw.pdb");
+    statchem::parser::FileParser bmol2("files/benzene.mol2");
+
+    statchem::molib::Molecules lmol;
+    statchem::molib::Molecules rmol;
+    statchem::molib::Molecules bmol;
+    lpdb.parse_molecule(lmol);
+    rpdb.parse_molecule(rmol);
+    bmol2.parse_molecule(bmol);
+
+    lmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    rmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    bmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    statchem::OMMIface::ForceField ffield;
+
+    ffield.parse_gaff_dat_file("../data/gaff.dat")
+        .parse_forcefield_file("../data/amber10.xml")
+        .parse_forcefield_file("../data/tip3p.xml");
+
+    statchem::molib::Molecule& protein = rmol[0];
+    statchem::molib::Molecule& ligand = lmol[0];
+    statchem::molib::Molecule& benzene = bmol[0];
+
+    statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+    protein.prepare_for_mm(ffield, gridrec);
+
+    ffield.insert_topology(protein);
+    ffield.insert_topology(ligand);
+    ffield.insert_topology(benzene);
+
+    statchem::OMMIface::Modeler modeler(ffield, "phy", 1.0, 0.00001, 100);
+
+    modeler.add_topology(protein.get_atoms());
+    modeler.add_topology(ligand.get_atoms());
+    modeler.init_openmm("Reference");
+    modeler.add_crds(protein.get_atoms(), protein.get_crds());
+    modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+    modeler.init_openmm_positions();
+    double potential = modeler.potential_energy();
+
+    statchem::OMMIface::Modeler slot_modeler(ffield, "phy", 1.0, 0.00001,
+                                             100);
+
+    slot_modeler.add_topology(protein.get_atoms());
+    slot_modeler.reserve_ligand(ligand.get_atoms());
+    slot_modeler.reserve_ligand(benzene.get_atoms());
+    slot_modeler.init_openmm("Reference");
+    slot_modeler.add_crds(protein.get_atoms(), protein.get_crds());
+
+    // Includes the 1-4 scaled and the full 1-5 and further pairs of the
+    // ligand, which the slot computes outside of the NonbondedForce
+    slot_modeler.set_ligand(ligand.get_atoms());
+    slot_modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+    slot_modeler.init_openmm_positions();
+
+    CHECK(std::fabs(slot_modeler.potential_energy() - potential) <
+          1e-5 * std::fabs(potential));
+
+    // A smaller, different ligand moves the bonded terms of the slot onto
+    // other particles
+    statchem::OMMIface::Modeler small_modeler(ffield, "phy", 1.0, 0.00001,
+                                              100);
+
+    small_modeler.add_topology(protein.get_atoms());
+    small_modeler.add_topology(benzene.get_atoms());
+    small_modeler.init_openmm("Reference");
+    small_modeler.add_crds(protein.get_atoms(), protein.get_crds());
+    small_modeler.add_crds(benzene.get_atoms(), benzene.get_crds());
+    small_modeler.init_openmm_positions();
+    const double small_potential = small_modeler.potential_energy();
+
+    slot_modeler.set_ligand(benzene.get_atoms());
+    slot_modeler.add_crds(benzene.get_atoms(), benzene.get_crds());
+    slot_modeler.init_openmm_positions();
+
+    CHECK(std::fabs(slot_modeler.potential_energy() - small_potential) <
+          1e-5 * std::fabs(small_potential));
+
+    statchem::molib::Atom::Vec atoms = protein.get_atoms();
+    for (auto atom : benzene.get_atoms()) atoms.push_back(atom);
+
+    const auto expected = small_modeler.get_forces(atoms);
+    const auto forces = slot_modeler.get_forces(atoms);
+    double max_error = 0.0;
+    for (size_t i = 0; i < atoms.size(); ++i)
+        max_error = std::max(
+            max_error, forces[i].distance(expected[i]) /
+                           (1.0 + expected[i].distance(
+                                      statchem::geometry::Point())));
+    CHECK(max_error < 1e-5);
+
+    // and back again
+    slot_modeler.set_ligand(ligand.get_atoms());
+    slot_modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+    slot_modeler.init_openmm_positions();
+
+    CHECK(std::fabs(slot_modeler.potential_energy() - potential) <
+          1e-5 * std::fabs(potential));
+}
+
+TEST_CASE("Knowledge-based energy minization in a receptor field") {
+    statchem::parser::FileParser lpdb("files/6drw_lig.pdb");
+    statchem::parser::FileParser rpdb("files/6drw.pdb");
+
+    statchem::molib::Molecules lmol;
+    statchem::molib::Molecules rmol;
+    lpdb.parse_molecule(lmol);
+    rpdb.parse_molecule(rmol);
+
+    lmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    rmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen();
+
+    statchem::score::AtomicDistributions distributions(
+        "../data/csd_complete_distance_distributions.txt.xz");
+
+    statchem::score::KBFF objective_func("mean", "complete", "radial", 15,
+                                         0.01);
+    objective_func
+        .define_composition(rmol.get_idatm_types(), lmol.get_idatm_types())
+        .process_distributions(distributions)
+        .compile_scoring_function();
+    objective_func.compile_objective_function();
+
+    statchem::OMMIface::ForceField ffield;
+
+    ffield.parse_gaff_dat_file("../data/gaff.dat")
+        .add_kb_forcefield(objective_func, 6.0)
+        .parse_forcefield_file("../data/amber10.xml")
+        .parse_forcefield_file("../data/tip3p.xml");
+
+    statchem::molib::Molecule& protein = rmol[0];
+    statchem::molib::Molecule& ligand = lmol[0];
+
+    statchem::molib::Atom::Grid gridrec(protein.get_atoms());
+    protein.prepare_for_mm(ffield, gridrec);
+
+    statchem::OMMIface::ReceptorField field(ffield, protein.get_atoms(),
+                                            ligand.get_atoms(), 0.375);
+
+    ffield.insert_topology(protein);
+    ffield.insert_topology(ligand);
+
+    statchem::OMMIface::Modeler modeler(ffield, "kb", 1.0, 0.00001, 100);
+    modeler.set_receptor_field(field);
+
+    modeler.add_topology(ligand.get_atoms());
+    modeler.init_openmm("Reference");
+    modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+    modeler.init_openmm_positions();
+
+    double potential = modeler.potential_energy();
+
+    // Energy of the molecules without the receptor field
+    auto explicit_energy = [&ffield](
+        const std::vector<statchem::molib::Molecule*>& molecules) {
+        statchem::OMMIface::Modeler explicit_modeler(ffield, "kb", 1.0,
+                                                     0.00001, 100);
+        for (auto molecule : molecules)
+            explicit_modeler.add_topology(molecule->get_atoms());
+        explicit_modeler.init_openmm("Reference");
+        for (auto molecule : molecules)
+            explicit_modeler.add_crds(molecule->get_atoms(),
+                                      molecule->get_crds());
+        explicit_modeler.init_openmm_positions();
+        return explicit_modeler.potential_energy();
+    };
+
+    const double ligand_potential = explicit_energy({&ligand});
+
+    // On the grid points the field gives the tabulated value of each atom
+    // type exactly
+    const statchem::geometry::Point& grid_min = field.get_min();
+    const double spacing = 0.375;
+    statchem::geometry::Point::Vec on_grid;
+    double tabulated = 0.0;
+    long imax = 0;
+    for (auto patom : ligand.get_atoms()) {
+        const statchem::geometry::Point& crd = patom->crd();
+        const long i = std::lround((crd.x() - grid_min.x()) / spacing);
+        const long j = std::lround((crd.y() - grid_min.y()) / spacing);
+        const long k = std::lround((crd.z() - grid_min.z()) / spacing);
+        on_grid.push_back(statchem::geometry::Point(
+            grid_min.x() + i * spacing, grid_min.y() + j * spacing,
+            grid_min.z() + k * spacing));
+        const long idx = i + field.size_x() * (j + field.size_y() * k);
+        tabulated += field.get_map(patom->idatm_type())[idx];
+        imax = std::max(imax, i);
+    }
+
+    statchem::molib::Molecule snapped(ligand, on_grid);
+    modeler.add_crds(ligand.get_atoms(), on_grid);
+    modeler.init_openmm_positions();
+    CHECK(modeler.potential_energy() - explicit_energy({&snapped}) ==
+          Approx(tabulated).epsilon(1e-6).margin(1e-6));
+
+    // Crossing the edge of the grid does not make the energy jump to the cap
+    auto shifted = [&on_grid](const double dx) {
+        statchem::geometry::Point::Vec crds;
+        for (auto& crd : on_grid)
+            crds.push_back(
+                statchem::geometry::Point(crd.x() + dx, crd.y(), crd.z()));
+        return crds;
+    };
+    const double to_edge = (field.size_x() - 1 - imax) * spacing;
+
+    modeler.add_crds(ligand.get_atoms(), shifted(to_edge));
+    modeler.init_openmm_positions();
+    const double at_edge = modeler.potential_energy();
+
+    modeler.add_crds(ligand.get_atoms(), shifted(to_edge + 0.01));
+    modeler.init_openmm_positions();
+    CHECK(std::fabs(modeler.potential_energy() - at_edge) < 1.0);
+
+    // Outside of the grid every atom gets the capped energy
+    statchem::geometry::Point::Vec outside;
+    for (auto& crd : ligand.get_crds())
+        outside.push_back(
+            statchem::geometry::Point(crd.x() + 100.0, crd.y(), crd.z()));
+
+    modeler.add_crds(ligand.get_atoms(), outside);
+    modeler.init_openmm_positions();
+    CHECK(modeler.potential_energy() - ligand_potential ==
+          Approx(ligand.get_atoms().size() *
+                 statchem::OMMIface::ReceptorField::max_energy));
+
+    modeler.add_crds(ligand.get_atoms(), ligand.get_crds());
+    modeler.init_openmm_positions();
+
+    // A batch of two copies of the ligand, which must not see each other
+    statchem::molib::Molecule copy(ligand);
+
+    statchem::OMMIface::Modeler batch(ffield, "kb", 1.0, 0.00001, 100);
+    batch.set_receptor_field(field);
+
+    batch.add_batch_ligand(ligand.get_atoms());
+    batch.add_batch_ligand(copy.get_atoms());
+    batch.init_openmm("Reference");
+    batch.add_crds(ligand.get_atoms(), ligand.get_crds());
+    batch.add_crds(copy.get_atoms(), copy.get_crds());
+    batch.init_openmm_positions();
+
+    // the bonded forces are per ligand, masking is not supported
+    CHECK_THROWS(batch.mask(copy.get_atoms()));
+    CHECK_THROWS(batch.unmask(copy.get_atoms()));
+
+    auto energies = batch.batch_energies();
+    REQUIRE(energies.size() == 2);
+    CHECK(std::fabs(energies[0] - potential) < 1e-6 * std::fabs(potential));
+    CHECK(std::fabs(energies[1] - potential) < 1e-6 * std::fabs(potential));
+
+    modeler.minimize_state();
+    batch.minimize_state();
+
+    energies = batch.batch_energies();
+    CHECK(modeler.potential_energy() < potential);
+    CHECK(energies[0] < potential);
+    CHECK(energies[1] < potential);
+}
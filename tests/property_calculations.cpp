@@ -1,8 +1,11 @@
 #include "statchem/parser/fileparser.hpp"
+#include "statchem/fileio/moleculestore.hpp"
+#include "statchem/helper/error.hpp"
 #include "statchem/helper/grep.hpp"
 #include "statchem/helper/help.hpp"
 
 #include <boost/filesystem.hpp>
+#include <sstream>
 
 namespace fs = boost::filesystem;
 
@@ -70,3 +73,139 @@ TEST_CASE("Read a mol2 file and assign rotable bonds") {
     CHECK(count == frags.size());
     fs::remove(path);
 }
+
+TEST_CASE("Read a mol2 file one molecule at a time") {
+    statchem::parser::FileParser lmol2("files/drugs.mol2");
+    statchem::molib::Molecules mols;
+
+    CHECK(lmol2.parse_next_molecule(mols));
+    CHECK(mols.size() == 1);
+    CHECK(mols[0].name() == "random");
+    CHECK(mols[0].first().first().first().first().size() == 28);
+
+    mols.clear();
+    CHECK(lmol2.parse_next_molecule(mols));
+    CHECK(lmol2.parse_next_molecule(mols));
+    CHECK(mols.size() == 2);
+    CHECK(mols[0].name() == "tibolone");
+    CHECK(mols[0].first().first().first().first().size() == 23);
+    CHECK(mols[1].name() == "loratadine");
+
+    CHECK_FALSE(lmol2.parse_next_molecule(mols));
+    CHECK(mols.size() == 2);
+}
+
+TEST_CASE("Read a pdb file through a memory map and a stream") {
+    statchem::parser::FileParser mapped("files/6drw.pdb");
+    statchem::molib::Molecules mols_mapped;
+    mapped.parse_molecule(mols_mapped);
+
+    std::shared_ptr<std::istream> stream =
+        std::make_shared<std::ifstream>("files/6drw.pdb");
+    statchem::parser::FileParser streamed;
+    streamed.prepare_parser(stream, "PDB");
+    statchem::molib::Molecules mols_streamed;
+    streamed.parse_molecule(mols_streamed);
+
+    auto atoms_mapped = mols_mapped.get_atoms();
+    auto atoms_streamed = mols_streamed.get_atoms();
+    REQUIRE(atoms_mapped.size() == atoms_streamed.size());
+
+    for (size_t i = 0; i < atoms_mapped.size(); ++i) {
+        CHECK(atoms_mapped[i]->atom_name() == atoms_streamed[i]->atom_name());
+        CHECK(atoms_mapped[i]->crd() == atoms_streamed[i]->crd());
+    }
+
+    // the file is read once, a second call finds nothing left
+    statchem::molib::Molecules again_mapped, again_streamed;
+    CHECK_FALSE(mapped.parse_molecule(again_mapped));
+    CHECK_FALSE(streamed.parse_molecule(again_streamed));
+}
+
+TEST_CASE("Store typed molecules and read them back") {
+    statchem::parser::FileParser lmol2("files/drugs.mol2");
+    statchem::molib::Molecules mols;
+    lmol2.parse_molecule(mols);
+
+    mols.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen()
+        .compute_hydrogen()
+        .compute_ring_type()
+        .compute_gaff_type()
+        .erase_hydrogen()
+        .compute_rotatable_bonds();
+
+    auto path = fs::temp_directory_path() / fs::unique_path("%%%%.stch");
+    {
+        std::ofstream out(path.string(), std::ios::binary);
+        statchem::fileio::write_molecule_store_header(out);
+        for (auto& molecule : mols) {
+            statchem::fileio::write_molecule(out, molecule);
+        }
+    }
+
+    statchem::parser::FileParser lstore(path.string());
+    statchem::molib::Molecules stored;
+    lstore.parse_molecule(stored);
+    fs::remove(path);
+
+    REQUIRE(stored.size() == 3);
+    CHECK(stored[1].name() == "tibolone");
+    CHECK(stored.get_idatm_types() == mols.get_idatm_types());
+
+    auto atoms = mols.get_atoms();
+    auto stored_atoms = stored.get_atoms();
+    REQUIRE(atoms.size() == stored_atoms.size());
+
+    size_t num_rotatable = 0;
+    for (size_t i = 0; i < atoms.size(); ++i) {
+        CHECK(atoms[i]->atom_name() == stored_atoms[i]->atom_name());
+        CHECK(atoms[i]->crd() == stored_atoms[i]->crd());
+        CHECK(atoms[i]->gaff_type() == stored_atoms[i]->gaff_type());
+        CHECK(atoms[i]->size() == stored_atoms[i]->size());
+
+        for (auto& neighbour : *atoms[i]) {
+            const auto& bond = atoms[i]->get_bond(neighbour);
+            const auto& stored_bond = stored_atoms[i]->get_bond(
+                *stored_atoms[std::find(atoms.begin(), atoms.end(),
+                                        &neighbour) -
+                              atoms.begin()]);
+            CHECK(bond.get_bo() == stored_bond.get_bo());
+            CHECK(bond.get_bond_gaff_type() ==
+                  stored_bond.get_bond_gaff_type());
+            CHECK(bond.get_rotatable() == stored_bond.get_rotatable());
+            num_rotatable += stored_bond.is_rotatable();
+        }
+    }
+    CHECK(num_rotatable != 0);
+}
+
+TEST_CASE("Reject a damaged molecule store") {
+    statchem::parser::FileParser lmol2("files/benzene.mol2");
+    statchem::molib::Molecules mols;
+    lmol2.parse_molecule(mols);
+
+    std::stringstream store;
+    statchem::fileio::write_molecule(store, mols[0]);
+    const std::string record = store.str();
+
+    statchem::molib::Molecules read;
+    SECTION("truncated record") {
+        std::stringstream in(record.substr(0, record.size() - 1));
+        CHECK_THROWS_AS(statchem::fileio::read_molecule(in, read),
+                        const statchem::Error&);
+    }
+    SECTION("size larger than the file") {
+        const uint64_t size = uint64_t(1) << 60;
+        std::stringstream in(
+            std::string(reinterpret_cast<const char*>(&size), sizeof(size)) +
+            record.substr(sizeof(size)));
+        CHECK_THROWS_AS(statchem::fileio::read_molecule(in, read),
+                        const statchem::Error&);
+    }
+    CHECK(read.empty());
+}
@@ -1,8 +1,15 @@
 #include "statchem/score/score.hpp"
+#include "statchem/score/distkernel.hpp"
+#include "statchem/score/multiscore.hpp"
+#include "statchem/score/potentialgrid.hpp"
 #include "statchem/fileio/inout.hpp"
 #include "statchem/helper/grep.hpp"
 #include "statchem/parser/fileparser.hpp"
 
+#include <boost/filesystem.hpp>
+#include <cstdlib>
+#include <fstream>
+
 #define CATCH_CONFIG_MAIN
 #include "catch.hpp"
 
@@ -41,6 +48,161 @@ TEST_CASE("RMR6 Score") {
     CHECK(std::fabs(my_score - (-4.832775)) < 1e-6);
 }
 
+TEST_CASE("Distance kernels agree with the scalar code") {
+    using statchem::score::distance_kernel_block;
+
+    // points on a lattice around crd, so that some lie exactly on the cutoff
+    // or on a bin boundary and one coincides with crd
+    double x[distance_kernel_block], y[distance_kernel_block],
+        z[distance_kernel_block];
+    for (size_t i = 0; i < distance_kernel_block; ++i) {
+        x[i] = 0.5 * (i % 4);
+        y[i] = 0.5 * (i / 4 % 4);
+        z[i] = 0.5 * (i / 16) - 0.25;
+    }
+    const statchem::geometry::Coordinate crd(0.5, 0.5, 0.25);
+
+    auto run = [&](const std::string& kernel, const size_t n,
+                   std::vector<uint32_t>& which, std::vector<double>& dist,
+                   std::vector<int>& bins) {
+        REQUIRE(statchem::score::set_distance_kernel(kernel));
+        which.resize(distance_kernel_block);
+        dist.resize(distance_kernel_block);
+        bins.resize(distance_kernel_block);
+        const size_t found = statchem::score::distances_within(
+            x, y, z, n, crd, 1.0, 0.1, which.data(), dist.data(),
+            bins.data());
+        which.resize(found);
+        dist.resize(found);
+        bins.resize(found);
+    };
+
+    const std::string default_kernel =
+        statchem::score::distance_kernel_name();
+
+    for (const std::string kernel : {"sse2", "avx2"}) {
+        if (!statchem::score::set_distance_kernel(kernel)) continue;
+
+        // also lengths that leave a tail for the scalar loop
+        for (size_t n : {distance_kernel_block, size_t(63), size_t(5)}) {
+            std::vector<uint32_t> which, which_scalar;
+            std::vector<double> dist, dist_scalar;
+            std::vector<int> bins, bins_scalar;
+            run(kernel, n, which, dist, bins);
+            run("scalar", n, which_scalar, dist_scalar, bins_scalar);
+
+            CHECK(!which_scalar.empty());
+            CHECK(which == which_scalar);
+            CHECK(dist == dist_scalar);
+            CHECK(bins == bins_scalar);
+        }
+    }
+
+    CHECK_FALSE(statchem::score::set_distance_kernel("neon"));
+    statchem::score::set_distance_kernel(default_kernel);
+}
+
+TEST_CASE("Compiled scoring function cache") {
+    statchem::parser::FileParser lpdb("files/6drw_lig.pdb");
+    statchem::parser::FileParser rpdb("files/6drw.pdb");
+
+    statchem::molib::Molecules lmol;
+    statchem::molib::Molecules rmol;
+    lpdb.parse_molecule(lmol);
+    rpdb.parse_molecule(rmol);
+
+    lmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen();
+
+    rmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen();
+
+    const std::string cache_dir =
+        (boost::filesystem::temp_directory_path() /
+         boost::filesystem::unique_path())
+            .string();
+    const std::string dist =
+        "../data/csd_complete_distance_distributions.txt.xz";
+
+    statchem::molib::Atom::Grid gridrec(rmol[0].get_atoms());
+
+    // the first run compiles and stores the tables, the second loads them
+    for (int run = 0; run < 2; ++run) {
+        statchem::score::Score score("mean", "reduced", "radial", 6);
+        score.define_composition(rmol.get_idatm_types(),
+                                 lmol.get_idatm_types())
+            .compile_scoring_function(dist, cache_dir);
+
+        CHECK(std::fabs(score.non_bonded_energy(gridrec, lmol[0]) -
+                        (-4.832775)) < 1e-6);
+        CHECK(std::distance(boost::filesystem::directory_iterator(cache_dir),
+                            boost::filesystem::directory_iterator()) == 1);
+
+        // loaded tables have no distributions to share
+        statchem::score::Score narrower("mean", "reduced", "radial", 4);
+        narrower.define_composition(rmol.get_idatm_types(),
+                                    lmol.get_idatm_types());
+        if (run == 0) {
+            CHECK_NOTHROW(narrower.process_distributions(score));
+        } else {
+            CHECK_THROWS_AS(narrower.process_distributions(score),
+                            const statchem::Error&);
+        }
+    }
+
+    // other settings are a separate entry
+    statchem::score::Score other("cumulative", "reduced", "radial", 6);
+    other.define_composition(rmol.get_idatm_types(), lmol.get_idatm_types())
+        .compile_scoring_function(dist, cache_dir);
+    CHECK(std::distance(boost::filesystem::directory_iterator(cache_dir),
+                        boost::filesystem::directory_iterator()) == 2);
+
+    boost::filesystem::remove_all(cache_dir);
+}
+
+#ifndef _MSC_VER
+TEST_CASE("Distributions cache in the user cache directory") {
+    namespace fs = boost::filesystem;
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directory(dir);
+
+    const std::string filename = (dir / "distributions.txt").string();
+    std::ofstream(filename) << "C3 C3 0.0 0.1 1\n"
+                            << "C3 C3 0.1 0.2 2\n"
+                            << "C3 N3 0.0 0.1 3\n"
+                            << "C3 N3 0.2 0.3 4\n";
+
+    // a directory in the way, so the cache cannot be written next to the file
+    fs::create_directory(filename + ".bin");
+    setenv("XDG_CACHE_HOME", (dir / "cache").c_str(), 1);
+
+    statchem::score::AtomicDistributions parsed(filename);
+    size_t num_cached = 0;
+    for (fs::directory_iterator it(dir / "cache" / "statchem");
+         it != fs::directory_iterator(); ++it) {
+        CHECK(it->path().extension() == ".bin");
+        ++num_cached;
+    }
+    CHECK(num_cached == 1);
+
+    statchem::score::AtomicDistributions cached(filename);
+    CHECK(cached.values == parsed.values);
+    CHECK(cached.step_in_file == parsed.step_in_file);
+    CHECK(cached.max_distance == parsed.max_distance);
+
+    unsetenv("XDG_CACHE_HOME");
+    fs::remove_all(dir);
+}
+#endif
+
 TEST_CASE("Muliple Scoring Functions") {
     statchem::parser::FileParser lpdb("files/6drw_lig.pdb");
     statchem::parser::FileParser rpdb("files/6drw.pdb");
@@ -96,4 +258,167 @@ TEST_CASE("Muliple Scoring Functions") {
     CHECK(std::fabs(rmc15_score - (-10932.8691688)) < 1e-6);
     CHECK(std::fabs(fmc10_score - (-3962.8519988)) < 1e-6);
     CHECK(std::fabs(fcc4_score - (0.0451727)) < 1e-6);
+
+    // histograms shared from the widest cutoff, all scored in one pass
+    statchem::score::Score fmc15("mean", "complete", "normalized_frequency",
+                                 15);
+    fmc15.define_composition(rtypes, ltypes)
+        .process_distributions(distributions)
+        .compile_scoring_function();
+
+    statchem::score::Score shared_fmc10("mean", "complete",
+                                        "normalized_frequency", 10);
+    shared_fmc10.define_composition(rtypes, ltypes)
+        .process_distributions(fmc15)
+        .compile_scoring_function();
+
+    statchem::score::Score shared_fcc4("cumulative", "complete",
+                                       "normalized_frequency", 4);
+    shared_fcc4.define_composition(rtypes, ltypes)
+        .process_distributions(fmc15)
+        .compile_scoring_function();
+
+    statchem::score::Score rmc10("mean", "complete", "radial", 10);
+    rmc10.define_composition(rtypes, ltypes);
+    CHECK_THROWS(rmc10.process_distributions(fmc15));
+    CHECK_THROWS(fmc15.process_distributions(shared_fmc10));
+
+    statchem::score::MultiScore multi(
+        {&rmc15, &shared_fmc10, &shared_fcc4, &fmc15});
+    auto scores = multi.non_bonded_energy(gridrec, lmol[0]);
+    REQUIRE(scores.size() == 4);
+    CHECK(scores[0] == rmc15_score);
+    CHECK(scores[1] == fmc10_score);
+    CHECK(scores[2] == fcc4_score);
+    CHECK(scores[3] == fmc15.non_bonded_energy(gridrec, lmol[0]));
+}
+
+TEST_CASE("Receptor Potential Grid") {
+    statchem::parser::FileParser lpdb("files/6drw_lig.pdb");
+    statchem::parser::FileParser rpdb("files/6drw.pdb");
+
+    statchem::molib::Molecules lmol;
+    statchem::molib::Molecules rmol;
+    lpdb.parse_molecule(lmol);
+    rpdb.parse_molecule(rmol);
+
+    lmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen();
+
+    rmol.compute_idatm_type()
+        .compute_hydrogen()
+        .compute_bond_order()
+        .compute_bond_gaff_type()
+        .refine_idatm_type()
+        .erase_hydrogen();
+
+    auto ltypes = lmol.get_idatm_types();
+
+    statchem::score::Score score("mean", "reduced", "radial", 6);
+    score.define_composition(rmol.get_idatm_types(), ltypes)
+        .process_distributions(
+            "../data/csd_complete_distance_distributions.txt.xz")
+        .compile_scoring_function();
+
+    statchem::molib::Atom::Grid gridrec(rmol[0].get_atoms());
+
+    // box around the ligand only, to keep the test fast
+    auto crds = lmol[0].get_crds();
+    statchem::geometry::Coordinate min_crd = crds[0], max_crd = crds[0];
+    for (auto& crd : crds) {
+        min_crd = statchem::geometry::Coordinate(
+            std::min(min_crd.x(), crd.x()), std::min(min_crd.y(), crd.y()),
+            std::min(min_crd.z(), crd.z()));
+        max_crd = statchem::geometry::Coordinate(
+            std::max(max_crd.x(), crd.x()), std::max(max_crd.y(), crd.y()),
+            std::max(max_crd.z(), crd.z()));
+    }
+
+    statchem::score::ReceptorPotentialGrid grid(
+        score, gridrec, min_crd - 1.0, max_crd + 1.0, ltypes, 0.5, 2);
+
+    // lattice points reproduce the exact energies
+    const statchem::geometry::Coordinate node =
+        grid.get_origin() + grid.get_spacing() * 4;
+    auto exact = score.compute_energy(gridrec, node, ltypes);
+    for (auto& type : ltypes) {
+        CHECK(std::fabs(grid.energy(type, node) - exact.data[type]) < 1e-6);
+    }
+
+    CHECK_THROWS(grid.energy(*ltypes.rbegin() + 1, node));
+
+    // The energies are histograms of the distance, so they do not converge
+    // between the nodes. Off the lattice, each ligand atom gets the trilinear
+    // mix of the exact energies on the corners of its cell.
+    double mixed_sum = 0.0;
+    for (size_t n = 0; n < crds.size(); ++n) {
+        const int type = lmol[0].get_atoms()[n]->idatm_type();
+        const statchem::geometry::Coordinate f =
+            (crds[n] - grid.get_origin()) / grid.get_spacing();
+        const double fi = std::floor(f.x()), fj = std::floor(f.y()),
+                     fk = std::floor(f.z());
+        const double t[3] = {f.x() - fi, f.y() - fj, f.z() - fk};
+
+        double mixed = 0.0;
+        for (int corner = 0; corner < 8; ++corner) {
+            const int di = corner & 1, dj = corner >> 1 & 1, dk = corner >> 2;
+            const statchem::geometry::Coordinate node =
+                grid.get_origin() +
+                statchem::geometry::Coordinate(fi + di, fj + dj, fk + dk) *
+                    grid.get_spacing();
+            mixed += score.compute_energy(gridrec, node, ltypes).data[type] *
+                     (di ? t[0] : 1 - t[0]) * (dj ? t[1] : 1 - t[1]) *
+                     (dk ? t[2] : 1 - t[2]);
+        }
+        CHECK(grid.energy(type, crds[n]) == Approx(mixed).margin(1e-9));
+        mixed_sum += mixed;
+    }
+    CHECK(grid.non_bonded_energy(lmol[0]) == Approx(mixed_sum).margin(1e-9));
+
+    // and on the lattice the grid scores the same as Score
+    statchem::geometry::Point::Vec node_crds;
+    for (size_t n = 0; n < crds.size(); ++n) {
+        node_crds.push_back(grid.get_origin() +
+                            statchem::geometry::Coordinate(n % 3 + 1, n / 3 % 3,
+                                                           n / 9 + 2) *
+                                grid.get_spacing());
+    }
+    CHECK(grid.non_bonded_energy(lmol[0].get_atoms(), node_crds) ==
+          Approx(score.non_bonded_energy(gridrec, lmol[0].get_atoms(),
+                                         node_crds))
+              .margin(1e-9));
+
+    const std::string filename =
+        (boost::filesystem::temp_directory_path() /
+         boost::filesystem::unique_path("%%%%-potential-grid.bin"))
+            .string();
+    grid.save(filename);
+    statchem::score::ReceptorPotentialGrid loaded(filename, score, gridrec);
+
+    CHECK(grid.non_bonded_energy(lmol[0]) ==
+          loaded.non_bonded_energy(lmol[0]));
+
+    // a grid is only loaded for the receptor and scoring function it was
+    // computed for
+    statchem::molib::Atom::Vec fewer_atoms = rmol[0].get_atoms();
+    fewer_atoms.pop_back();
+    statchem::molib::Atom::Grid other_receptor(fewer_atoms);
+    CHECK_THROWS(statchem::score::ReceptorPotentialGrid(filename, score,
+                                                        other_receptor));
+
+    statchem::score::Score other_score("mean", "reduced", "radial", 5);
+    other_score.define_composition(rmol.get_idatm_types(), ltypes)
+        .process_distributions(
+            "../data/csd_complete_distance_distributions.txt.xz")
+        .compile_scoring_function();
+    CHECK_THROWS(
+        statchem::score::ReceptorPotentialGrid(filename, other_score, gridrec));
+    std::remove(filename.c_str());
+
+    CHECK_THROWS(statchem::score::ReceptorPotentialGrid("files/6drw.pdb",
+                                                        score, gridrec));
 }